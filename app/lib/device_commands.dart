@@ -0,0 +1,58 @@
+import 'dart:async';
+
+import 'package:firebase_database/firebase_database.dart';
+
+// Typed commands for a controller (firmware: runCommand in main.cpp).
+// Each command is pushed under devices/<mac>/command and answered at
+// devices/<mac>/command_results/<id> with its status and timings.
+class CommandResult {
+  final String status;
+  final String? error;
+  final Map<String, dynamic> result;
+  // Server time from push to completion, when the controller reported it.
+  final Duration? latency;
+
+  CommandResult(this.status, this.error, this.result, this.latency);
+
+  bool get ok => status == 'ok';
+
+  factory CommandResult.fromJson(Map<String, dynamic> json) {
+    final sent = json['sent'];
+    final completed = json['completed_at'];
+    return CommandResult(
+      json['status'] ?? 'error',
+      json['error'],
+      Map<String, dynamic>.from(json['result'] ?? {}),
+      sent is int && completed is int ? Duration(milliseconds: completed - sent) : null,
+    );
+  }
+}
+
+class DeviceCommands {
+  static const int version = 1;
+
+  // Pushes a command and completes with its result, or with null when the
+  // controller does not answer within [timeout] (offline, or older firmware).
+  static Future<CommandResult?> send(String deviceId, String type,
+      {Map<String, dynamic>? args, Duration timeout = const Duration(seconds: 15)}) async {
+    final devices = FirebaseDatabase.instance.ref('devices/$deviceId');
+    final commandRef = devices.child('command').push();
+    final resultRef = devices.child('command_results/${commandRef.key}');
+
+    final answered = resultRef.onValue
+        .where((event) => event.snapshot.value != null)
+        .map((event) => CommandResult.fromJson(Map<String, dynamic>.from(event.snapshot.value as Map)))
+        .first;
+    await commandRef.set({
+      'type': type,
+      'v': version,
+      if (args != null) 'args': args,
+      'sent': ServerValue.timestamp,
+    });
+    try {
+      return await answered.timeout(timeout);
+    } on TimeoutException {
+      return null;
+    }
+  }
+}
@@ -1,6 +1,7 @@
 import 'package:flutter/material.dart';
-import 'package:http/http.dart' as http;
 import 'main.dart'; // Contains AuraController and Appliance models
+import 'lan_auth.dart';
+import 'lan_control.dart';
 import 'device_settings_page.dart';
 
 class DeviceDetailPage extends StatelessWidget {
@@ -9,9 +10,12 @@ class DeviceDetailPage extends StatelessWidget {
   const DeviceDetailPage({super.key, required this.controller});
 
   Future<void> _toggleApplianceState(Appliance appliance) async {
-    final url = 'http://${controller.ip}/toggle?pin=${appliance.pin}';
     try {
-      await http.get(Uri.parse(url)).timeout(const Duration(seconds: 3));
+      if (LanControl.isAvailable) {
+        await LanControl.toggle(controller.id, controller.ip, appliance.pin);
+        return;
+      }
+      await LanAuth.send(controller.id, controller.ip, 'GET', '/toggle?pin=${appliance.pin}');
     } catch (e) {
       print("Error toggling appliance: $e");
     }
@@ -1,10 +1,11 @@
 import 'dart:convert';
 import 'package:flutter/material.dart';
 import 'package:cloud_firestore/cloud_firestore.dart';
-import 'package:firebase_database/firebase_database.dart';
 import 'package:firebase_auth/firebase_auth.dart';
 import 'package:aura_app/main.dart'; 
 import 'package:aura_app/manage_rooms_page.dart';
+import 'package:aura_app/device_commands.dart';
+import 'package:aura_app/lan_auth.dart';
 
 // Data model for a single appliance configuration
 class ApplianceConfig {
@@ -35,12 +36,14 @@ class DeviceSettingsPage extends StatefulWidget {
 
 class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
   List<ApplianceConfig> _appliances = [];
+  int _expanderChannels = 0;
   String? _selectedRoomId;
+  String? _lanKey;
   bool _isLoading = true;
   bool _isSaving = false;
 
   final List<int> safeGpioPins = [4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33];
-  final List<String> applianceTypes = ["Light", "Fan", "Socket", "Other"];
+  final List<String> applianceTypes = ["Light", "Dimmer", "Fan", "Socket", "Other"];
 
   @override
   void initState() {
@@ -60,6 +63,8 @@ class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
         if(mounted) {
           setState(() {
             _selectedRoomId = data['roomId'];
+            _lanKey = data['lan_key'];
+            _expanderChannels = _channelsFor(data['expander']);
             _appliances = configData.map((data) => ApplianceConfig.fromJson(data)).toList();
           });
         }
@@ -71,6 +76,17 @@ class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
     }
   }
 
+  // Outputs on a relay expander are numbered from 100 (see firmware output_driver.h).
+  static const int expanderChannelBase = 100;
+
+  int _channelsFor(dynamic expander) {
+    if (expander is! Map) return 0;
+    final int count = expander['count'] ?? 1;
+    return (expander['type'] == 'mcp23017' ? 16 : 8) * count;
+  }
+
+  String _pinLabel(int pin) => pin >= expanderChannelBase ? "Relay ${pin - expanderChannelBase + 1}" : "GPIO $pin";
+
   Future<void> _saveConfigurationToFirestore() async {
     if (_selectedRoomId == null) {
       ScaffoldMessenger.of(context).showSnackBar(
@@ -83,19 +99,27 @@ class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
       final docRef = FirebaseFirestore.instance.collection('device_configs').doc(widget.controller.id);
       final configToSave = _appliances.map((a) => a.toJson()).toList();
       
+      // Merged so fields the page does not edit (e.g. 'expander') survive.
+      // The first save also gives the controller a key for its local API.
       await docRef.set({
         'controllerName': widget.controller.name,
         'roomId': _selectedRoomId,
         'appliances': configToSave,
-      });
+        if (_lanKey == null) 'lan_key': LanAuth.newKey(),
+      }, SetOptions(merge: true));
+      LanAuth.keyChanged(widget.controller.id);
+
+      // The controller diffs the new list against the running one and applies
+      // it in place; relays that were not edited keep their state.
+      final result = await DeviceCommands.send(widget.controller.id, 'reload_config');
+      final message = result == null
+          ? "Configuration saved. The controller will apply it when it is back online."
+          : result.ok
+              ? "Configuration applied (${result.result['changes']} change(s))."
+              : "Configuration saved, but the controller reported: ${result.error}";
 
-      final rtdbRef = FirebaseDatabase.instance.ref('devices/${widget.controller.id}/command');
-      await rtdbRef.set('REBOOT');
-      
       if (mounted) {
-        ScaffoldMessenger.of(context).showSnackBar(
-          const SnackBar(content: Text("Configuration saved! Device will restart.")),
-        );
+        ScaffoldMessenger.of(context).showSnackBar(SnackBar(content: Text(message)));
         Navigator.of(context).pop();
       }
     } catch (e) {
@@ -107,7 +131,8 @@ class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
 
   void _showAddApplianceDialog() {
     final usedPins = _appliances.map((a) => a.pin).toSet();
-    final availablePins = safeGpioPins.where((pin) => !usedPins.contains(pin)).toList();
+    final expanderPins = List.generate(_expanderChannels, (i) => expanderChannelBase + i);
+    final availablePins = [...safeGpioPins, ...expanderPins].where((pin) => !usedPins.contains(pin)).toList();
 
     if (availablePins.isEmpty) {
       ScaffoldMessenger.of(context).showSnackBar(
@@ -139,7 +164,7 @@ class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
                     DropdownButtonFormField<int>(
                       value: selectedPin,
                       decoration: const InputDecoration(labelText: "GPIO Pin", border: OutlineInputBorder()),
-                      items: availablePins.map((pin) => DropdownMenuItem<int>(value: pin, child: Text("GPIO $pin"))).toList(),
+                      items: availablePins.map((pin) => DropdownMenuItem<int>(value: pin, child: Text(_pinLabel(pin)))).toList(),
                       onChanged: (val) => setDialogState(() => selectedPin = val),
                     ),
                     const SizedBox(height: 16),
@@ -177,6 +202,7 @@ class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
     switch (type) {
       case "Fan": return Icons.air_outlined;
       case "Socket": return Icons.power_outlined;
+      case "Dimmer": return Icons.tungsten_outlined;
       case "Light":
       default:
         return Icons.lightbulb_outline;
@@ -252,7 +278,7 @@ class _DeviceSettingsPageState extends State<DeviceSettingsPage> {
                             return ListTile(
                               leading: Icon(getIconForType(appliance.type)),
                               title: Text(appliance.name),
-                              subtitle: Text("GPIO ${appliance.pin} • ${appliance.type}"),
+                              subtitle: Text("${_pinLabel(appliance.pin)} • ${appliance.type}"),
                               trailing: IconButton(
                                 icon: const Icon(Icons.delete_outline, color: Colors.red),
                                 onPressed: () => setState(() => _appliances.removeAt(index)),
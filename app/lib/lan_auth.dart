@@ -0,0 +1,111 @@
+import 'dart:convert';
+import 'dart:math';
+
+import 'package:cloud_firestore/cloud_firestore.dart';
+import 'package:crypto/crypto.dart';
+import 'package:http/http.dart' as http;
+
+// Signs requests to a controller's local API (firmware include/lan_auth.h).
+// The controller's key is the 'lan_key' field of its config document. A
+// session is opened once per controller through /session; after that each
+// request costs one HMAC and three headers.
+class LanAuth {
+  static final Map<String, _LanSession> _sessions = {};
+  static final Map<String, String?> _keys = {};
+  static final Random _random = Random.secure();
+
+  static Future<String?> _keyFor(String deviceId) async {
+    if (_keys.containsKey(deviceId)) return _keys[deviceId];
+    final doc = await FirebaseFirestore.instance.collection('device_configs').doc(deviceId).get();
+    final key = doc.data()?['lan_key'] as String?;
+    _keys[deviceId] = key;
+    return key;
+  }
+
+  // A fresh random key for a config that has none yet.
+  static String newKey() => _hex(List<int>.generate(32, (_) => _random.nextInt(256)));
+
+  static void keyChanged(String deviceId) => _keys.remove(deviceId);
+
+  // Headers for one request; empty when the controller has no key configured.
+  // |target| is the path plus query exactly as it will be sent.
+  static Future<Map<String, String>> headers(String deviceId, String host, String method, String target,
+      [String body = '']) async {
+    final key = await _keyFor(deviceId);
+    if (key == null || key.isEmpty) return {};
+    var session = _sessions[host];
+    if (session == null || session.expired) {
+      session = await _open(host, key);
+      _sessions[host] = session;
+    }
+    final counter = ++session.counter;
+    session.usedAt = DateTime.now();
+    final mac = Hmac(sha256, session.key).convert(utf8.encode('$method\n$target\n$counter\n$body'));
+    return {'X-Aura-Session': '${session.id}', 'X-Aura-Counter': '$counter', 'X-Aura-Auth': mac.toString()};
+  }
+
+  // The controller answered 401: its sessions are gone (e.g. it rebooted).
+  static void forget(String host) => _sessions.remove(host);
+
+  // Sends a signed request, opening a new session and retrying once if the
+  // controller no longer knows the old one.
+  static Future<http.Response> send(String deviceId, String host, String method, String target,
+      {String body = '', Duration timeout = const Duration(seconds: 3)}) async {
+    for (var attempt = 0;; attempt++) {
+      final signed = await headers(deviceId, host, method, target, body);
+      final uri = Uri.parse('http://$host$target');
+      final response = method == 'POST'
+          ? await http.post(uri, headers: {'Content-Type': 'application/json', ...signed}, body: body).timeout(timeout)
+          : await http.get(uri, headers: signed).timeout(timeout);
+      if (response.statusCode != 401 || attempt > 0) return response;
+      forget(host);
+    }
+  }
+
+  // A challenge first, spent by the proof, so a captured open cannot be replayed.
+  static Future<_LanSession> _open(String host, String key) async {
+    final keyBytes = utf8.encode(key);
+    final issued = await http.get(Uri.parse('http://$host/session')).timeout(const Duration(seconds: 3));
+    if (issued.statusCode != 200) throw Exception('LAN session refused: ${issued.body}');
+    final challengeHex = (jsonDecode(issued.body) as Map<String, dynamic>)['challenge'] as String;
+    final challenge = _unhex(challengeHex);
+    final clientNonce = List<int>.generate(16, (_) => _random.nextInt(256));
+    final proof = Hmac(sha256, keyBytes).convert([...utf8.encode('aura-open'), ...challenge, ...clientNonce]);
+    final response = await http
+        .post(Uri.parse('http://$host/session'),
+            headers: {'Content-Type': 'application/json'},
+            body: jsonEncode({'challenge': challengeHex, 'nonce': _hex(clientNonce), 'proof': proof.toString()}))
+        .timeout(const Duration(seconds: 3));
+    if (response.statusCode != 200) throw Exception('LAN session refused: ${response.body}');
+    final reply = jsonDecode(response.body) as Map<String, dynamic>;
+    final sessionKey = Hmac(sha256, keyBytes).convert([...utf8.encode('aura-session'), ...clientNonce, ...challenge]).bytes;
+    // The controller proves it holds the same key.
+    final expected = Hmac(sha256, sessionKey).convert(utf8.encode('aura-ready')).toString();
+    if (expected != reply['proof']) throw Exception('LAN session proof mismatch');
+    return _LanSession(reply['id'] as int, sessionKey, Duration(seconds: reply['idle_s'] as int),
+        Duration(seconds: reply['lifetime_s'] as int));
+  }
+
+  static String _hex(List<int> bytes) => bytes.map((b) => b.toRadixString(16).padLeft(2, '0')).join();
+
+  static List<int> _unhex(String text) =>
+      List<int>.generate(text.length ~/ 2, (i) => int.parse(text.substring(2 * i, 2 * i + 2), radix: 16));
+}
+
+class _LanSession {
+  final int id;
+  final List<int> key;
+  final Duration idle;
+  final Duration lifetime;
+  final DateTime openedAt = DateTime.now();
+  DateTime usedAt = DateTime.now();
+  int counter = 0;
+
+  _LanSession(this.id, this.key, this.idle, this.lifetime);
+
+  // A margin so a request does not race the controller's own expiry.
+  bool get expired {
+    final now = DateTime.now();
+    return now.difference(usedAt) > idle * 0.9 || now.difference(openedAt) > lifetime * 0.9;
+  }
+}
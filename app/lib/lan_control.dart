@@ -0,0 +1,52 @@
+import 'dart:convert';
+import 'dart:io' show Platform;
+
+import 'package:flutter/foundation.dart' show kIsWeb;
+import 'package:flutter/services.dart';
+
+import 'lan_auth.dart';
+
+// Native LAN control provided by the Linux desktop runner
+// (linux/runner/aura_lan_plugin.cc): pooled connections to every controller,
+// commands fanned out concurrently, and state changes pushed from GET /state.
+class LanControl {
+  static const MethodChannel _channel = MethodChannel('aura/lan');
+  static const EventChannel _events = EventChannel('aura/lan/events');
+
+  static bool get isAvailable => !kIsWeb && Platform.isLinux;
+
+  // Replaces the set of controllers whose state is watched.
+  static Future<void> setControllers(List<String> hosts, {int intervalMs = 1000}) {
+    return _channel.invokeMethod('setControllers', {'hosts': hosts, 'intervalMs': intervalMs});
+  }
+
+  // Sends every command at once; results come back in the same order.
+  static Future<List<Map<String, dynamic>>> batch(List<({String host, String path, Map<String, String> headers})> commands) async {
+    final List<dynamic> results = await _channel.invokeMethod('batch', [
+      for (final c in commands) {'host': c.host, 'path': c.path, 'headers': c.headers},
+    ]);
+    return results.map((r) => Map<String, dynamic>.from(r as Map)).toList();
+  }
+
+  // Signed for controllers with a LAN key (lan_auth.dart); a 401 means the
+  // controller dropped the session, so it is reopened and the toggle retried.
+  static Future<bool> toggle(String deviceId, String host, int pin) async {
+    final path = '/toggle?pin=$pin';
+    for (var attempt = 0; attempt < 2; attempt++) {
+      final headers = await LanAuth.headers(deviceId, host, 'GET', path);
+      final results = await batch([(host: host, path: path, headers: headers)]);
+      if (results.first['status'] != 401) return results.first['status'] == 200;
+      LanAuth.forget(host);
+    }
+    return false;
+  }
+
+  // Each event is a controller's /state snapshot plus the host it came from.
+  // The runner only polls the controllers while this stream has a listener.
+  static Stream<Map<String, dynamic>> get stateChanges {
+    return _events.receiveBroadcastStream().map((event) {
+      final response = Map<String, dynamic>.from(event as Map);
+      return {'host': response['host'], ...jsonDecode(response['body'] as String) as Map<String, dynamic>};
+    });
+  }
+}
@@ -1,3 +1,6 @@
+import 'dart:async';
+
+import 'package:flutter/foundation.dart' show listEquals;
 import 'package:flutter/material.dart';
 import 'package:firebase_core/firebase_core.dart';
 import 'package:firebase_auth/firebase_auth.dart';
@@ -11,6 +14,7 @@ import 'settings_page.dart';
 import 'device_settings_page.dart';
 import 'manage_rooms_page.dart';
 import 'splash_screen.dart';
+import 'lan_control.dart';
 
 
 void main() async {
@@ -137,15 +141,36 @@ class _LoginPageState extends State<LoginPage> {
 class Appliance {
   final int pin;
   final String name;
+  final String type;
   bool state;
-  Appliance({required this.pin, required this.name, required this.state});
+  // Brightness in percent while on; only dimmers use it.
+  int level;
+  // Server ms of the write that set |state|; 0 if it carried none.
+  int version;
+  Appliance({required this.pin, required this.name, required this.state, this.type = 'Light', this.level = 100,
+      this.version = 0});
   factory Appliance.fromFirebase(String key, Map<dynamic, dynamic> value) {
     return Appliance(
       pin: int.parse(key),
       name: value['name'] ?? 'Unnamed Appliance',
+      type: value['type'] ?? 'Light',
       state: value['state'] == 'ON',
+      level: value['level'] ?? 100,
+      version: value['version'] is int ? value['version'] : 0,
     );
   }
+
+  // Takes a GET /state entry from the controller itself when it is at least
+  // as new as what the cloud last said.
+  void applyLan(Map<String, dynamic> entry) {
+    final lanVersion = entry['version'] is int ? entry['version'] as int : 0;
+    if (lanVersion < version) return;
+    state = entry['state'] == 'ON';
+    if (entry['level'] is int) level = entry['level'];
+    version = lanVersion;
+  }
+
+  bool get isDimmer => type == 'Dimmer';
 }
 
 class AuraController {
@@ -154,13 +179,25 @@ class AuraController {
   final String name;
   final String version;
   final List<Appliance> appliances;
-  AuraController({required this.id, required this.ip, required this.name, required this.version, required this.appliances});
+  final bool online;
+  // Server ms of the last heartbeat or state write from this controller, and
+  // the interval it promised the next one within (firmware heartbeat.h).
+  final int? lastSeen;
+  final int? heartbeatMs;
+  AuraController({required this.id, required this.ip, required this.name, required this.version, required this.appliances,
+      this.online = false, this.lastSeen, this.heartbeatMs});
   factory AuraController.fromFirebase(String key, Map<dynamic, dynamic> value) {
     List<Appliance> parsedAppliances = [];
+    int? lastSeen;
+    final hb = value['hb'];
+    if (hb is Map && hb['at'] is int) lastSeen = hb['at'];
     if (value['appliances'] != null) {
       final appliancesMap = value['appliances'] as Map<dynamic, dynamic>;
       appliancesMap.forEach((pin, appValue) {
         parsedAppliances.add(Appliance.fromFirebase(pin, appValue));
+        // A state write by the controller itself is as good as a heartbeat.
+        final version = appValue['version'];
+        if (appValue['origin'] == key && version is int && (lastSeen == null || version > lastSeen!)) lastSeen = version;
       });
       parsedAppliances.sort((a,b) => a.pin.compareTo(b.pin));
     }
@@ -170,6 +207,48 @@ class AuraController {
       name: value['name'] ?? 'Aura Controller',
       version: value['version'] ?? '0.0',
       appliances: parsedAppliances,
+      online: value['online'] == true,
+      lastSeen: lastSeen,
+      heartbeatMs: hb is Map ? hb['next_ms'] : null,
+    );
+  }
+
+  // Firmware without a heartbeat only ever reports 'online' at boot.
+  bool isLive([int? nowMs]) {
+    if (heartbeatMs == null || lastSeen == null) return online;
+    final now = nowMs ?? DateTime.now().millisecondsSinceEpoch;
+    // Slack covers phone clock skew and a beat that is still in flight.
+    return now - lastSeen! <= heartbeatMs! + 30000;
+  }
+}
+
+// Follows the finger locally and writes once, when the drag ends.
+class _DimmerSlider extends StatefulWidget {
+  final int level;
+  final ValueChanged<int> onSet;
+  const _DimmerSlider({required this.level, required this.onSet});
+
+  @override
+  State<_DimmerSlider> createState() => _DimmerSliderState();
+}
+
+class _DimmerSliderState extends State<_DimmerSlider> {
+  double? _dragging;
+
+  @override
+  Widget build(BuildContext context) {
+    final value = _dragging ?? widget.level.clamp(1, 100).toDouble();
+    return Slider(
+      value: value,
+      min: 1,
+      max: 100,
+      divisions: 99,
+      label: "${value.round()}%",
+      onChanged: (v) => setState(() => _dragging = v),
+      onChangeEnd: (v) {
+        setState(() => _dragging = null);
+        widget.onSet(v.round());
+      },
     );
   }
 }
@@ -191,12 +270,42 @@ class _HomePageState extends State<HomePage> {
   final DatabaseReference _devicesRef = FirebaseDatabase.instance.ref('devices');
   late final CollectionReference _roomsRef;
   String? _selectedRoomId;
+  // Latest GET /state per controller address, pushed by the Linux runner
+  // while this page listens (it stops polling when nothing does).
+  StreamSubscription<Map<String, dynamic>>? _lanStates;
+  final Map<String, Map<int, Map<String, dynamic>>> _lanByHost = {};
+  List<String> _watchedHosts = const [];
 
   @override
   void initState() {
     super.initState();
     final userId = FirebaseAuth.instance.currentUser!.uid;
     _roomsRef = FirebaseFirestore.instance.collection('users').doc(userId).collection('rooms');
+    if (LanControl.isAvailable) {
+      _lanStates = LanControl.stateChanges.listen((snapshot) {
+        final appliances = <int, Map<String, dynamic>>{};
+        for (final entry in (snapshot['appliances'] as List? ?? const [])) {
+          final appliance = Map<String, dynamic>.from(entry as Map);
+          if (appliance['pin'] is int) appliances[appliance['pin']] = appliance;
+        }
+        setState(() => _lanByHost[snapshot['host'] as String] = appliances);
+      });
+    }
+  }
+
+  @override
+  void dispose() {
+    _lanStates?.cancel();
+    super.dispose();
+  }
+
+  // Rebuilds hand the same list over and over; only a changed set goes out.
+  void _watchControllers(List<AuraController> controllers) {
+    final hosts = controllers.map((c) => c.ip).where((ip) => ip != 'N/A').toList()..sort();
+    if (listEquals(hosts, _watchedHosts)) return;
+    _watchedHosts = hosts;
+    _lanByHost.removeWhere((host, _) => !hosts.contains(host));
+    LanControl.setControllers(hosts);
   }
 
   void _showApplianceControls(AuraController controller) {
@@ -231,16 +340,29 @@ class _HomePageState extends State<HomePage> {
                         child: ListView(
                           shrinkWrap: true,
                           children: updatedController.appliances.map((appliance) {
-                            return SwitchListTile(
+                            final dbRef = FirebaseDatabase.instance.ref('devices/${updatedController.id}/appliances/${appliance.pin}');
+                            final tile = SwitchListTile(
                               title: Text(appliance.name),
-                              subtitle: Text("GPIO ${appliance.pin}"),
+                              subtitle: Text(appliance.isDimmer ? "GPIO ${appliance.pin} • ${appliance.level}%" : "GPIO ${appliance.pin}"),
                               value: appliance.state,
                               onChanged: (value) {
-                                final dbRef = FirebaseDatabase.instance.ref('devices/${updatedController.id}/appliances/${appliance.pin}/state');
-                                dbRef.set(value ? "ON" : "OFF");
+                                dbRef.update({'state': value ? "ON" : "OFF", 'version': ServerValue.timestamp, 'origin': 'app'});
                               },
                               secondary: Icon(Icons.lightbulb_outline, color: appliance.state ? Colors.amber.shade700 : Colors.grey),
                             );
+                            if (!appliance.isDimmer) return tile;
+                            // One write per gesture: the controller fades there in hardware.
+                            return Column(
+                              mainAxisSize: MainAxisSize.min,
+                              children: [
+                                tile,
+                                _DimmerSlider(
+                                  level: appliance.level,
+                                  onSet: (level) => dbRef.update({'state': "ON", 'level': level, 'fade_ms': 400,
+                                      'version': ServerValue.timestamp, 'origin': 'app'}),
+                                ),
+                              ],
+                            );
                           }).toList(),
                         ),
                       ),
@@ -329,6 +451,17 @@ class _HomePageState extends State<HomePage> {
                   data.forEach((key, value) {
                     allControllers.add(AuraController.fromFirebase(key, value));
                   });
+                  if (LanControl.isAvailable) {
+                    _watchControllers(allControllers);
+                    for (final controller in allControllers) {
+                      final lan = _lanByHost[controller.ip];
+                      if (lan == null) continue;
+                      for (final appliance in controller.appliances) {
+                        final entry = lan[appliance.pin];
+                        if (entry != null) appliance.applyLan(entry);
+                      }
+                    }
+                  }
 
                   // We need to filter which controllers to show based on the selected room
                   // This requires another stream from Firestore to get the config
@@ -8,6 +8,7 @@ import 'package:package_info_plus/package_info_plus.dart';
 import 'package:url_launcher/url_launcher.dart';
 import 'package:cloud_firestore/cloud_firestore.dart';
 import 'main.dart'; // To get the AuraController model
+import 'lan_auth.dart';
 
 class SettingsPage extends StatefulWidget {
   const SettingsPage({super.key});
@@ -97,13 +98,9 @@ class _SettingsPageState extends State<SettingsPage> {
           ElevatedButton(
             onPressed: () async {
               if (ssidController.text.isEmpty) return;
-              final url = 'http://${_selectedController!.ip}/reconfigure-wifi';
               try {
-                await http.post(
-                  Uri.parse(url),
-                  headers: {'Content-Type': 'application/json'},
-                  body: jsonEncode({'ssid': ssidController.text, 'pass': passwordController.text}),
-                );
+                await LanAuth.send(_selectedController!.id, _selectedController!.ip, 'POST', '/reconfigure-wifi',
+                    body: jsonEncode({'ssid': ssidController.text, 'pass': passwordController.text}));
                 if(mounted) {
                   ScaffoldMessenger.of(context).showSnackBar(const SnackBar(content: Text("Wi-Fi details sent. Device will restart.")));
                   Navigator.of(context).popUntil((route) => route.isFirst);
@@ -198,9 +195,8 @@ class _SettingsPageState extends State<SettingsPage> {
                       Map<dynamic, dynamic> data = snapshot.data!.snapshot.value as Map<dynamic, dynamic>;
                       _onlineControllers = [];
                       data.forEach((key, value) {
-                        if (value['online'] == true) {
-                          _onlineControllers.add(AuraController.fromFirebase(key, value));
-                        }
+                        final controller = AuraController.fromFirebase(key, value);
+                        if (controller.isLive()) _onlineControllers.add(controller);
                       });
 
                       if (_onlineControllers.isEmpty) return const Text("No online devices found.");
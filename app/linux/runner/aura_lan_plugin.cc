@@ -0,0 +1,215 @@
+#include "aura_lan_plugin.h"
+
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include "lan_client_pool.h"
+
+namespace {
+
+constexpr size_t kWorkerThreads = 8;
+constexpr int kDefaultPollIntervalMs = 1000;
+constexpr char kMethodChannelName[] = "aura/lan";
+constexpr char kEventChannelName[] = "aura/lan/events";
+
+struct Plugin {
+  FlEventChannel* events = nullptr;
+  bool listening = false;
+  std::unique_ptr<LanClientPool> pool;
+  std::unique_ptr<LanStateWatcher> watcher;
+
+  ~Plugin() {
+    // The watcher's in-flight polls need the pool's workers to finish.
+    watcher.reset();
+    pool.reset();
+    if (events != nullptr) {
+      fl_event_channel_set_stream_handlers(events, nullptr, nullptr, nullptr,
+                                           nullptr);
+      g_clear_object(&events);
+    }
+  }
+};
+
+// Runs |task| on the GTK main loop; Flutter channels must only be used there.
+void RunOnMainThread(std::function<void()> task) {
+  g_idle_add_full(
+      G_PRIORITY_DEFAULT,
+      [](gpointer data) -> gboolean {
+        (*static_cast<std::function<void()>*>(data))();
+        return G_SOURCE_REMOVE;
+      },
+      new std::function<void()>(std::move(task)),
+      [](gpointer data) { delete static_cast<std::function<void()>*>(data); });
+}
+
+FlValue* ResponseToValue(const LanResponse& response) {
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "host",
+                           fl_value_new_string(response.host.c_str()));
+  fl_value_set_string_take(value, "path",
+                           fl_value_new_string(response.path.c_str()));
+  fl_value_set_string_take(value, "status", fl_value_new_int(response.status));
+  fl_value_set_string_take(value, "body",
+                           fl_value_new_string(response.body.c_str()));
+  fl_value_set_string_take(value, "latencyMs",
+                           fl_value_new_float(response.latency_ms));
+  return value;
+}
+
+const gchar* LookupString(FlValue* map, const gchar* key) {
+  FlValue* value = fl_value_lookup_string(map, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+    return nullptr;
+  }
+  return fl_value_get_string(value);
+}
+
+// setControllers({"hosts": [String], "intervalMs": int})
+void SetControllers(Plugin* plugin, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* hosts_value = fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                             ? fl_value_lookup_string(args, "hosts")
+                             : nullptr;
+  if (hosts_value == nullptr ||
+      fl_value_get_type(hosts_value) != FL_VALUE_TYPE_LIST) {
+    fl_method_call_respond_error(method_call, "bad_args", "Expected hosts",
+                                 nullptr, nullptr);
+    return;
+  }
+  std::vector<std::string> hosts;
+  for (size_t i = 0; i < fl_value_get_length(hosts_value); i++) {
+    FlValue* host = fl_value_get_list_value(hosts_value, i);
+    if (fl_value_get_type(host) == FL_VALUE_TYPE_STRING) {
+      hosts.push_back(fl_value_get_string(host));
+    }
+  }
+  int interval_ms = kDefaultPollIntervalMs;
+  FlValue* interval = fl_value_lookup_string(args, "intervalMs");
+  if (interval != nullptr && fl_value_get_type(interval) == FL_VALUE_TYPE_INT) {
+    interval_ms = static_cast<int>(fl_value_get_int(interval));
+  }
+
+  plugin->pool->Retain(hosts);
+  plugin->watcher->Watch(std::move(hosts), interval_ms);
+  fl_method_call_respond_success(method_call, nullptr, nullptr);
+}
+
+// batch([{"host": String, "path": String, "headers"?: {String: String}}])
+//   -> [response]
+void Batch(Plugin* plugin, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (fl_value_get_type(args) != FL_VALUE_TYPE_LIST) {
+    fl_method_call_respond_error(method_call, "bad_args", "Expected a list",
+                                 nullptr, nullptr);
+    return;
+  }
+  std::vector<LanRequest> requests;
+  for (size_t i = 0; i < fl_value_get_length(args); i++) {
+    FlValue* command = fl_value_get_list_value(args, i);
+    const gchar* host = fl_value_get_type(command) == FL_VALUE_TYPE_MAP
+                            ? LookupString(command, "host")
+                            : nullptr;
+    const gchar* path = host != nullptr ? LookupString(command, "path") : nullptr;
+    if (path == nullptr) {
+      fl_method_call_respond_error(method_call, "bad_args",
+                                   "Each command needs host and path",
+                                   nullptr, nullptr);
+      return;
+    }
+    std::string headers;
+    FlValue* extra = fl_value_lookup_string(command, "headers");
+    if (extra != nullptr && fl_value_get_type(extra) == FL_VALUE_TYPE_MAP) {
+      for (size_t j = 0; j < fl_value_get_length(extra); j++) {
+        FlValue* name = fl_value_get_map_key(extra, j);
+        FlValue* value = fl_value_get_map_value(extra, j);
+        if (fl_value_get_type(name) != FL_VALUE_TYPE_STRING ||
+            fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+          continue;
+        }
+        headers += std::string(fl_value_get_string(name)) + ": " +
+                   fl_value_get_string(value) + "\r\n";
+      }
+    }
+    requests.push_back(LanRequest{host, path, "", headers});
+  }
+
+  g_object_ref(method_call);
+  plugin->pool->SubmitBatch(
+      std::move(requests), [method_call](std::vector<LanResponse> responses) {
+        auto shared =
+            std::make_shared<std::vector<LanResponse>>(std::move(responses));
+        RunOnMainThread([method_call, shared]() {
+          g_autoptr(FlValue) result = fl_value_new_list();
+          for (const LanResponse& response : *shared) {
+            fl_value_append_take(result, ResponseToValue(response));
+          }
+          fl_method_call_respond_success(method_call, result, nullptr);
+          g_object_unref(method_call);
+        });
+      });
+}
+
+void MethodCallCb(FlMethodChannel* channel,
+                  FlMethodCall* method_call,
+                  gpointer user_data) {
+  Plugin* plugin = static_cast<std::shared_ptr<Plugin>*>(user_data)->get();
+  const gchar* method = fl_method_call_get_name(method_call);
+  if (strcmp(method, "setControllers") == 0) {
+    SetControllers(plugin, method_call);
+  } else if (strcmp(method, "batch") == 0) {
+    Batch(plugin, method_call);
+  } else {
+    fl_method_call_respond_not_implemented(method_call, nullptr);
+  }
+}
+
+FlMethodErrorResponse* ListenCb(FlEventChannel* channel,
+                                FlValue* args,
+                                gpointer user_data) {
+  Plugin* plugin = static_cast<Plugin*>(user_data);
+  plugin->listening = true;
+  plugin->watcher->SetActive(true);
+  return nullptr;
+}
+
+FlMethodErrorResponse* CancelCb(FlEventChannel* channel,
+                                FlValue* args,
+                                gpointer user_data) {
+  Plugin* plugin = static_cast<Plugin*>(user_data);
+  plugin->listening = false;
+  plugin->watcher->SetActive(false);
+  return nullptr;
+}
+
+}  // namespace
+
+void aura_lan_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
+  auto plugin = std::make_shared<Plugin>();
+  plugin->pool.reset(new LanClientPool(kWorkerThreads));
+
+  std::weak_ptr<Plugin> weak = plugin;
+  plugin->watcher.reset(new LanStateWatcher(
+      plugin->pool.get(), [weak](const LanResponse& response) {
+        RunOnMainThread([weak, response]() {
+          std::shared_ptr<Plugin> plugin = weak.lock();
+          if (!plugin || !plugin->listening) return;
+          g_autoptr(FlValue) event = ResponseToValue(response);
+          fl_event_channel_send(plugin->events, event, nullptr, nullptr);
+        });
+      }));
+
+  FlBinaryMessenger* messenger = fl_plugin_registrar_get_messenger(registrar);
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+
+  plugin->events = fl_event_channel_new(messenger, kEventChannelName,
+                                        FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->events, ListenCb, CancelCb,
+                                       plugin.get(), nullptr);
+
+  g_autoptr(FlMethodChannel) channel = fl_method_channel_new(
+      messenger, kMethodChannelName, FL_METHOD_CODEC(codec));
+  fl_method_channel_set_method_call_handler(
+      channel, MethodCallCb, new std::shared_ptr<Plugin>(plugin),
+      [](gpointer data) { delete static_cast<std::shared_ptr<Plugin>*>(data); });
+}
@@ -0,0 +1,16 @@
+#ifndef RUNNER_AURA_LAN_PLUGIN_H_
+#define RUNNER_AURA_LAN_PLUGIN_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+/**
+ * aura_lan_plugin_register_with_registrar:
+ * @registrar: an #FlPluginRegistrar.
+ *
+ * Registers the native LAN control plugin. It serves the "aura/lan" method
+ * channel (setControllers, batch) and pushes controller state changes on the
+ * "aura/lan/events" event channel.
+ */
+void aura_lan_plugin_register_with_registrar(FlPluginRegistrar* registrar);
+
+#endif  // RUNNER_AURA_LAN_PLUGIN_H_
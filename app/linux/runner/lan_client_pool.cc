@@ -0,0 +1,460 @@
+#include "lan_client_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <set>
+
+namespace {
+
+// Idle keep-alive connections kept per controller. The ESP32 web server
+// handles only a few sockets at once, so more would just be refused.
+constexpr size_t kMaxIdlePerHost = 2;
+
+void SplitHost(const std::string& host, std::string* name, std::string* port) {
+  size_t colon = host.rfind(':');
+  if (colon == std::string::npos) {
+    *name = host;
+    *port = "80";
+  } else {
+    *name = host.substr(0, colon);
+    *port = host.substr(colon + 1);
+  }
+}
+
+int Connect(const std::string& host, int timeout_ms) {
+  std::string name, port;
+  SplitHost(host, &name, &port);
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  if (getaddrinfo(name.c_str(), port.c_str(), &hints, &addresses) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo* a = addresses; a != nullptr && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                a->ai_protocol);
+    if (fd < 0) continue;
+    int rc = connect(fd, a->ai_addr, a->ai_addrlen);
+    if (rc < 0 && errno == EINPROGRESS) {
+      pollfd p = {fd, POLLOUT, 0};
+      int error = 0;
+      socklen_t length = sizeof(error);
+      rc = (poll(&p, 1, timeout_ms) == 1 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 &&
+            error == 0)
+               ? 0
+               : -1;
+    }
+    if (rc < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) return -1;
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+bool SendAll(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    sent += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Reads more bytes into |buffer|; false on error, timeout or EOF. |closed|
+// is set when the peer closed or reset the connection, as opposed to a
+// timeout (EAGAIN) or any other error.
+bool ReadMore(int fd, std::string* buffer, bool* closed = nullptr) {
+  char chunk[2048];
+  ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+  if (n <= 0) {
+    if (closed != nullptr) *closed = n == 0 || errno == ECONNRESET;
+    return false;
+  }
+  buffer->append(chunk, static_cast<size_t>(n));
+  return true;
+}
+
+// Paths that change nothing on the controller. Anything else (/toggle,
+// /scene, ...) may have run before the connection failed and is never sent
+// twice.
+bool Replayable(const std::string& path) {
+  for (const char* prefix : {"/state", "/peers", "/stats", "/trace"}) {
+    size_t length = strlen(prefix);
+    if (path.compare(0, length, prefix) == 0 &&
+        (path.size() == length || path[length] == '?')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HeaderIs(const std::string& line, const char* name, std::string* value) {
+  size_t length = strlen(name);
+  if (line.size() <= length || line[length] != ':' ||
+      strncasecmp(line.c_str(), name, length) != 0) {
+    return false;
+  }
+  size_t start = line.find_first_not_of(' ', length + 1);
+  *value = start == std::string::npos ? "" : line.substr(start);
+  return true;
+}
+
+// Reads one HTTP/1.1 response. Sets |keep_alive| when the connection may
+// carry another request. On failure, |closed_unanswered| is set if the
+// server closed or reset the connection before sending any byte, which on a
+// reused connection means it had closed it while idle.
+bool ReadResponse(int fd, LanResponse* response, bool* keep_alive,
+                  bool* closed_unanswered) {
+  std::string buffer;
+  size_t header_end;
+  while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    bool closed = false;
+    if (!ReadMore(fd, &buffer, &closed)) {
+      *closed_unanswered = closed && buffer.empty();
+      return false;
+    }
+  }
+
+  long content_length = -1;
+  bool chunked = false;
+  *keep_alive = true;
+  size_t line_start = 0;
+  while (line_start < header_end) {
+    size_t line_end = buffer.find("\r\n", line_start);
+    std::string line = buffer.substr(line_start, line_end - line_start);
+    std::string value;
+    if (line_start == 0) {
+      size_t space = line.find(' ');
+      if (space == std::string::npos) return false;
+      response->status = atoi(line.c_str() + space + 1);
+      *keep_alive = line.compare(0, 8, "HTTP/1.0") != 0;
+    } else if (HeaderIs(line, "Content-Length", &value)) {
+      content_length = atol(value.c_str());
+    } else if (HeaderIs(line, "Transfer-Encoding", &value)) {
+      chunked = strcasecmp(value.c_str(), "chunked") == 0;
+    } else if (HeaderIs(line, "Connection", &value)) {
+      if (strcasecmp(value.c_str(), "close") == 0) *keep_alive = false;
+      if (strcasecmp(value.c_str(), "keep-alive") == 0) *keep_alive = true;
+    } else if (HeaderIs(line, "ETag", &value)) {
+      response->etag = value;
+    }
+    line_start = line_end + 2;
+  }
+  buffer.erase(0, header_end + 4);
+
+  if (response->status == 304 || response->status == 204) {
+    return true;
+  }
+  if (chunked) {
+    std::string body;
+    for (;;) {
+      size_t size_end;
+      while ((size_end = buffer.find("\r\n")) == std::string::npos) {
+        if (!ReadMore(fd, &buffer)) return false;
+      }
+      size_t size = strtoul(buffer.c_str(), nullptr, 16);
+      while (buffer.size() < size_end + 2 + size + 2) {
+        if (!ReadMore(fd, &buffer)) return false;
+      }
+      body.append(buffer, size_end + 2, size);
+      buffer.erase(0, size_end + 2 + size + 2);
+      if (size == 0) break;
+    }
+    response->body.swap(body);
+  } else if (content_length >= 0) {
+    while (buffer.size() < static_cast<size_t>(content_length)) {
+      if (!ReadMore(fd, &buffer)) return false;
+    }
+    buffer.resize(static_cast<size_t>(content_length));
+    response->body.swap(buffer);
+  } else {
+    // No framing: the body runs until the server closes the connection.
+    while (ReadMore(fd, &buffer)) {
+    }
+    response->body.swap(buffer);
+    *keep_alive = false;
+  }
+  return true;
+}
+
+}  // namespace
+
+LanClientPool::LanClientPool(size_t workers, int timeout_ms)
+    : timeout_ms_(timeout_ms) {
+  for (size_t i = 0; i < std::max<size_t>(workers, 1); i++) {
+    workers_.emplace_back(&LanClientPool::WorkerLoop, this);
+  }
+}
+
+LanClientPool::~LanClientPool() {
+  std::deque<Job> queued;
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    stopping_ = true;
+    queued.swap(jobs_);
+  }
+  jobs_ready_.notify_all();
+  // Jobs that never ran still get their callback, as unreachable, so a
+  // batch waiting on them completes and releases what it holds.
+  for (Job& job : queued) {
+    LanResponse response;
+    response.host = job.request.host;
+    response.path = job.request.path;
+    job.done(response);
+  }
+  for (auto& worker : workers_) worker.join();
+  for (auto& entry : idle_) {
+    for (int fd : entry.second) close(fd);
+  }
+}
+
+void LanClientPool::Submit(LanRequest request, Callback done) {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    jobs_.push_back(Job{std::move(request), std::move(done)});
+  }
+  jobs_ready_.notify_one();
+}
+
+void LanClientPool::SubmitBatch(std::vector<LanRequest> requests,
+                                BatchCallback done) {
+  if (requests.empty()) {
+    done({});
+    return;
+  }
+  struct Batch {
+    std::mutex mutex;
+    std::vector<LanResponse> responses;
+    size_t remaining;
+    BatchCallback done;
+  };
+  auto batch = std::make_shared<Batch>();
+  batch->responses.resize(requests.size());
+  batch->remaining = requests.size();
+  batch->done = std::move(done);
+
+  for (size_t i = 0; i < requests.size(); i++) {
+    Submit(std::move(requests[i]), [batch, i](const LanResponse& response) {
+      bool last;
+      {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->responses[i] = response;
+        last = --batch->remaining == 0;
+      }
+      if (last) batch->done(std::move(batch->responses));
+    });
+  }
+}
+
+void LanClientPool::Retain(const std::vector<std::string>& hosts) {
+  std::set<std::string> keep(hosts.begin(), hosts.end());
+  std::lock_guard<std::mutex> lock(idle_mutex_);
+  for (auto it = idle_.begin(); it != idle_.end();) {
+    if (keep.count(it->first) != 0) {
+      ++it;
+      continue;
+    }
+    for (int fd : it->second) close(fd);
+    it = idle_.erase(it);
+  }
+}
+
+void LanClientPool::WorkerLoop() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex_);
+      jobs_ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (stopping_) return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    job.done(Execute(job.request));
+  }
+}
+
+LanResponse LanClientPool::Execute(const LanRequest& request) {
+  auto start = std::chrono::steady_clock::now();
+  LanResponse response;
+  response.host = request.host;
+  response.path = request.path;
+
+  std::string message = "GET " + request.path + " HTTP/1.1\r\nHost: " +
+                        request.host + "\r\nConnection: keep-alive\r\n";
+  if (!request.etag.empty()) {
+    message += "If-None-Match: " + request.etag + "\r\n";
+  }
+  message += request.headers;
+  message += "\r\n";
+
+  // A reused connection may have been closed by the controller while idle;
+  // that shows up as EOF or a reset before any byte arrives, and a read-only
+  // request is retried once on a fresh connection. A timeout is not retried:
+  // the controller may still be working on the request.
+  bool replayable = Replayable(request.path);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = false;
+    int fd = Acquire(request.host, &reused);
+    if (fd < 0) break;
+    bool keep_alive = false;
+    bool closed_unanswered = false;
+    response.status = 0;
+    bool sent = SendAll(fd, message);
+    if (!sent) closed_unanswered = errno == EPIPE || errno == ECONNRESET;
+    if (sent &&
+        ReadResponse(fd, &response, &keep_alive, &closed_unanswered)) {
+      Release(request.host, fd, keep_alive);
+      break;
+    }
+    close(fd);
+    response.status = 0;
+    if (!reused || !closed_unanswered || !replayable) break;
+  }
+
+  response.latency_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  return response;
+}
+
+int LanClientPool::Acquire(const std::string& host, bool* reused) {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    auto it = idle_.find(host);
+    if (it != idle_.end() && !it->second.empty()) {
+      int fd = it->second.back();
+      it->second.pop_back();
+      *reused = true;
+      return fd;
+    }
+  }
+  *reused = false;
+  return Connect(host, timeout_ms_);
+}
+
+void LanClientPool::Release(const std::string& host, int fd, bool keep_alive) {
+  if (keep_alive) {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    std::vector<int>& idle = idle_[host];
+    if (idle.size() < kMaxIdlePerHost) {
+      idle.push_back(fd);
+      return;
+    }
+  }
+  close(fd);
+}
+
+LanStateWatcher::LanStateWatcher(LanClientPool* pool,
+                                 LanClientPool::Callback changed)
+    : pool_(pool),
+      changed_(std::move(changed)),
+      thread_(&LanStateWatcher::PollLoop, this) {}
+
+LanStateWatcher::~LanStateWatcher() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  stopping_ = true;
+  wake_.notify_all();
+  // Polls already queued on the pool call back into this object.
+  wake_.wait(lock, [this] {
+    return std::none_of(in_flight_.begin(), in_flight_.end(),
+                        [](const std::pair<const std::string, bool>& entry) {
+                          return entry.second;
+                        });
+  });
+  lock.unlock();
+  thread_.join();
+}
+
+void LanStateWatcher::Watch(std::vector<std::string> hosts, int interval_ms) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interval_ms = std::max(interval_ms, 100);
+    // The same set again (e.g. from a widget rebuild) is not a new round.
+    if (hosts == hosts_ && interval_ms == interval_ms_) return;
+    hosts_ = std::move(hosts);
+    interval_ms_ = interval_ms;
+    generation_++;
+  }
+  wake_.notify_all();
+}
+
+void LanStateWatcher::SetActive(bool active) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (active_ == active) return;
+    active_ = active;
+    generation_++;
+  }
+  wake_.notify_all();
+}
+
+void LanStateWatcher::PollLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    if (!active_) {
+      wake_.wait(lock, [this] { return stopping_ || active_; });
+      continue;
+    }
+    for (const std::string& host : hosts_) {
+      // A slow controller is not polled again until it has answered.
+      if (in_flight_[host]) continue;
+      in_flight_[host] = true;
+      pool_->Submit(LanRequest{host, "/state", etags_[host], ""},
+                    [this](const LanResponse& response) {
+                      OnPolled(response);
+                    });
+    }
+    unsigned seen = generation_;
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(interval_ms_);
+    wake_.wait_until(lock, deadline,
+                     [&] { return stopping_ || generation_ != seen; });
+  }
+}
+
+void LanStateWatcher::OnPolled(const LanResponse& response) {
+  bool report;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    report = response.status == 200 && !stopping_;
+    if (report) etags_[response.host] = response.etag;
+  }
+  // Reported before the poll is marked done so the destructor, which waits
+  // for in-flight polls, cannot run while |changed_| is in use.
+  if (report) changed_(response);
+  // Notified under the lock: once the destructor sees the poll done it may
+  // destroy |wake_|.
+  std::lock_guard<std::mutex> lock(mutex_);
+  in_flight_[response.host] = false;
+  wake_.notify_all();
+}
@@ -0,0 +1,122 @@
+#ifndef RUNNER_LAN_CLIENT_POOL_H_
+#define RUNNER_LAN_CLIENT_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One request to a controller's local HTTP API.
+struct LanRequest {
+  // "address" or "address:port"; port 80 when omitted.
+  std::string host;
+  // Path and query, e.g. "/toggle?pin=4".
+  std::string path;
+  // Sent as If-None-Match when not empty.
+  std::string etag;
+  // Extra header lines, each "Name: value\r\n" (e.g. the LAN auth headers).
+  std::string headers;
+};
+
+struct LanResponse {
+  std::string host;
+  std::string path;
+  // HTTP status, or 0 when the controller could not be reached.
+  int status = 0;
+  std::string etag;
+  std::string body;
+  double latency_ms = 0;
+};
+
+// Runs requests against Aura controllers on a fixed pool of worker threads,
+// reusing keep-alive connections per controller where the server allows it.
+// A batch of commands for many controllers fans out concurrently instead of
+// paying one connection and one round trip after another.
+class LanClientPool {
+ public:
+  using Callback = std::function<void(const LanResponse&)>;
+  using BatchCallback = std::function<void(std::vector<LanResponse>)>;
+
+  // Starts |workers| threads. Each request is given |timeout_ms| to connect
+  // and again to complete.
+  explicit LanClientPool(size_t workers, int timeout_ms = 3000);
+  // Waits for running requests; queued ones complete with status 0.
+  ~LanClientPool();
+
+  LanClientPool(const LanClientPool&) = delete;
+  LanClientPool& operator=(const LanClientPool&) = delete;
+
+  // Queues |request|; |done| runs on a worker thread.
+  void Submit(LanRequest request, Callback done);
+
+  // Queues every request in |requests|; |done| runs once, on the worker that
+  // finishes last, with responses in the order of |requests|.
+  void SubmitBatch(std::vector<LanRequest> requests, BatchCallback done);
+
+  // Closes idle connections to hosts not in |hosts|.
+  void Retain(const std::vector<std::string>& hosts);
+
+ private:
+  struct Job {
+    LanRequest request;
+    Callback done;
+  };
+
+  void WorkerLoop();
+  LanResponse Execute(const LanRequest& request);
+  int Acquire(const std::string& host, bool* reused);
+  void Release(const std::string& host, int fd, bool keep_alive);
+
+  const int timeout_ms_;
+
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_ready_;
+  std::deque<Job> jobs_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+
+  std::mutex idle_mutex_;
+  std::map<std::string, std::vector<int>> idle_;
+};
+
+// Polls GET /state on every watched controller with If-None-Match, so an
+// unchanged controller costs a 304 and only real changes are reported.
+class LanStateWatcher {
+ public:
+  // |changed| runs on a worker thread with each 200 response.
+  LanStateWatcher(LanClientPool* pool, LanClientPool::Callback changed);
+  ~LanStateWatcher();
+
+  LanStateWatcher(const LanStateWatcher&) = delete;
+  LanStateWatcher& operator=(const LanStateWatcher&) = delete;
+
+  // Replaces the watched set and the polling interval.
+  void Watch(std::vector<std::string> hosts, int interval_ms);
+
+  // Polling only runs while active, i.e. while someone listens for changes.
+  void SetActive(bool active);
+
+ private:
+  void PollLoop();
+  void OnPolled(const LanResponse& response);
+
+  LanClientPool* pool_;
+  LanClientPool::Callback changed_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<std::string> hosts_;
+  std::map<std::string, std::string> etags_;
+  std::map<std::string, bool> in_flight_;
+  int interval_ms_ = 1000;
+  unsigned generation_ = 0;
+  bool active_ = false;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+#endif  // RUNNER_LAN_CLIENT_POOL_H_
@@ -0,0 +1,360 @@
+// Runs LanClientPool and LanStateWatcher against an in-process keep-alive
+// server that stands in for a fleet of controllers.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lan_client_pool.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                             \
+  do {                                                               \
+    if (!(condition)) {                                              \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+              #condition);                                           \
+      failures++;                                                    \
+    }                                                                \
+  } while (0)
+
+using Clock = std::chrono::steady_clock;
+
+double MsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// One listener per controller on 127.0.0.1. Connections stay open between
+// requests, like the ESP32 web server, until CloseIdle() drops them the way
+// its idle timeout does. GET /state answers 304 when If-None-Match carries
+// the current version; /toggle bumps it.
+class FakeFleet {
+ public:
+  FakeFleet(size_t hosts, int latency_ms) : latency_ms_(latency_ms) {
+    versions_.resize(hosts, 1);
+    for (size_t i = 0; i < hosts; i++) {
+      int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      sockaddr_in address = {};
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t length = sizeof(address);
+      if (fd < 0 ||
+          bind(fd, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+          listen(fd, 16) != 0 ||
+          getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) !=
+              0) {
+        perror("listen");
+        abort();
+      }
+      listeners_.push_back(fd);
+      hosts_.push_back("127.0.0.1:" + std::to_string(ntohs(address.sin_port)));
+    }
+    acceptor_ = std::thread(&FakeFleet::AcceptLoop, this);
+  }
+
+  ~FakeFleet() {
+    stopping_ = true;
+    acceptor_.join();
+    for (auto& connection : connections_) connection.join();
+    for (int fd : listeners_) close(fd);
+  }
+
+  const std::vector<std::string>& hosts() const { return hosts_; }
+  int accepted() const { return accepted_; }
+  int toggles() const { return toggles_; }
+  int not_modified() const { return not_modified_; }
+
+  // Closes every connection waiting for its next request and returns once
+  // they are gone.
+  void CloseIdle() {
+    close_generation_++;
+    auto deadline = Clock::now() + std::chrono::seconds(2);
+    while (open_ > 0 && Clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+ private:
+  void AcceptLoop() {
+    std::vector<pollfd> fds;
+    for (int fd : listeners_) fds.push_back(pollfd{fd, POLLIN, 0});
+    while (!stopping_) {
+      if (poll(fds.data(), fds.size(), 10) <= 0) continue;
+      for (size_t i = 0; i < fds.size(); i++) {
+        if ((fds[i].revents & POLLIN) == 0) continue;
+        int fd = accept4(fds[i].fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        accepted_++;
+        open_++;
+        connections_.emplace_back(&FakeFleet::Serve, this, fd, i);
+      }
+    }
+  }
+
+  void Serve(int fd, size_t host) {
+    unsigned seen = close_generation_;
+    std::string buffer;
+    while (!stopping_) {
+      if (buffer.empty() && close_generation_ != seen) break;
+      pollfd p = {fd, POLLIN, 0};
+      if (poll(&p, 1, 5) <= 0) continue;
+      char chunk[2048];
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) break;
+      buffer.append(chunk, static_cast<size_t>(n));
+      size_t end;
+      while ((end = buffer.find("\r\n\r\n")) != std::string::npos) {
+        std::string request = buffer.substr(0, end + 2);
+        buffer.erase(0, end + 4);
+        if (latency_ms_ > 0) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms_));
+        }
+        std::string response = Handle(host, request);
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+      }
+    }
+    close(fd);
+    open_--;
+  }
+
+  std::string Handle(size_t host, const std::string& request) {
+    size_t path_start = request.find(' ') + 1;
+    std::string path =
+        request.substr(path_start, request.find(' ', path_start) - path_start);
+    std::string if_none_match;
+    const char kHeader[] = "\r\nIf-None-Match: ";
+    size_t header = request.find(kHeader);
+    if (header != std::string::npos) {
+      size_t start = header + strlen(kHeader);
+      if_none_match = request.substr(start, request.find("\r\n", start) - start);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string etag = "\"" + std::to_string(versions_[host]) + "\"";
+    std::string status = "200 OK";
+    std::string body;
+    if (path == "/state" && if_none_match == etag) {
+      not_modified_++;
+      return "HTTP/1.1 304 Not Modified\r\nETag: " + etag +
+             "\r\nConnection: keep-alive\r\n\r\n";
+    } else if (path == "/state") {
+      body = "{\"version\":" + std::to_string(versions_[host]) + "}";
+    } else if (path.compare(0, 7, "/toggle") == 0) {
+      toggles_++;
+      etag = "\"" + std::to_string(++versions_[host]) + "\"";
+      body = "{\"ok\":true}";
+    } else {
+      status = "404 Not Found";
+    }
+    return "HTTP/1.1 " + status + "\r\nContent-Length: " +
+           std::to_string(body.size()) + "\r\nETag: " + etag +
+           "\r\nConnection: keep-alive\r\n\r\n" + body;
+  }
+
+  const int latency_ms_;
+  std::vector<int> listeners_;
+  std::vector<std::string> hosts_;
+  std::thread acceptor_;
+  // Only the acceptor adds to it; joined after the acceptor.
+  std::vector<std::thread> connections_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<unsigned> close_generation_{0};
+  std::atomic<int> accepted_{0};
+  std::atomic<int> open_{0};
+  std::atomic<int> toggles_{0};
+  std::atomic<int> not_modified_{0};
+
+  std::mutex mutex_;
+  std::vector<unsigned> versions_;
+};
+
+std::vector<LanResponse> RunBatch(LanClientPool* pool,
+                                  std::vector<LanRequest> requests) {
+  std::promise<std::vector<LanResponse>> done;
+  auto result = done.get_future();
+  pool->SubmitBatch(std::move(requests),
+                    [&done](std::vector<LanResponse> responses) {
+                      done.set_value(std::move(responses));
+                    });
+  return result.get();
+}
+
+LanResponse Run(LanClientPool* pool, LanRequest request) {
+  std::promise<LanResponse> done;
+  auto result = done.get_future();
+  pool->Submit(std::move(request),
+               [&done](const LanResponse& response) { done.set_value(response); });
+  return result.get();
+}
+
+std::vector<LanRequest> Toggles(const std::vector<std::string>& hosts) {
+  std::vector<LanRequest> requests;
+  for (const std::string& host : hosts) {
+    requests.push_back(LanRequest{host, "/toggle?pin=4", "", ""});
+  }
+  return requests;
+}
+
+// A scene across 32 controllers, each taking 20 ms to answer, fans out over
+// the workers and reuses each controller's connection the next time.
+void TestBatchFansOut() {
+  FakeFleet fleet(32, 20);
+  LanClientPool pool(8);
+
+  auto start = Clock::now();
+  std::vector<LanResponse> responses = RunBatch(&pool, Toggles(fleet.hosts()));
+  double parallel_ms = MsSince(start);
+  CHECK(responses.size() == fleet.hosts().size());
+  for (size_t i = 0; i < responses.size(); i++) {
+    CHECK(responses[i].host == fleet.hosts()[i]);
+    CHECK(responses[i].status == 200);
+  }
+  CHECK(fleet.toggles() == 32);
+  int accepted = fleet.accepted();
+  CHECK(accepted == 32);
+
+  start = Clock::now();
+  responses = RunBatch(&pool, Toggles(fleet.hosts()));
+  double reused_ms = MsSince(start);
+  CHECK(fleet.accepted() == accepted);
+  CHECK(fleet.toggles() == 64);
+
+  LanClientPool serial_pool(1);
+  start = Clock::now();
+  RunBatch(&serial_pool, Toggles(fleet.hosts()));
+  double serial_ms = MsSince(start);
+  CHECK(parallel_ms < serial_ms / 3);
+
+  printf("batch over 32 hosts at 20 ms each: %.0f ms on 8 workers, %.0f ms "
+         "again on kept-alive connections, %.0f ms on 1 worker\n",
+         parallel_ms, reused_ms, serial_ms);
+}
+
+// An unchanged controller costs a 304 and is not reported; a change is
+// reported on the next round.
+void TestWatcherPollsWithEtags() {
+  FakeFleet fleet(32, 0);
+  LanClientPool pool(8);
+
+  std::mutex mutex;
+  std::vector<std::string> reported;
+  LanStateWatcher watcher(&pool, [&](const LanResponse& response) {
+    std::lock_guard<std::mutex> lock(mutex);
+    reported.push_back(response.host);
+  });
+  auto reports = [&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    return reported.size();
+  };
+  auto wait_for = [&](size_t count) {
+    auto deadline = Clock::now() + std::chrono::seconds(2);
+    while (reports() < count && Clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  };
+
+  watcher.Watch(fleet.hosts(), 100);
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  CHECK(reports() == 0);  // Not polled until someone listens.
+
+  watcher.SetActive(true);
+  wait_for(32);
+  CHECK(reports() == 32);
+  std::this_thread::sleep_for(std::chrono::milliseconds(350));
+  CHECK(reports() == 32);
+  CHECK(fleet.not_modified() >= 64);
+
+  CHECK(Run(&pool, LanRequest{fleet.hosts()[5], "/toggle?pin=4", "", ""})
+            .status == 200);
+  wait_for(33);
+  CHECK(reports() == 33);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK(reported.back() == fleet.hosts()[5]);
+  }
+  watcher.SetActive(false);
+  printf("watcher over 32 hosts: %d polls answered 304\n",
+         fleet.not_modified());
+}
+
+// A kept-alive connection the controller closed while idle: a read-only
+// request is retried on a fresh connection, a command is not sent twice.
+void TestIdleCloseRetry() {
+  FakeFleet fleet(1, 0);
+  LanClientPool pool(1);
+  const std::string host = fleet.hosts()[0];
+
+  CHECK(Run(&pool, LanRequest{host, "/state", "", ""}).status == 200);
+  CHECK(fleet.accepted() == 1);
+
+  fleet.CloseIdle();
+  CHECK(Run(&pool, LanRequest{host, "/state", "", ""}).status == 200);
+  CHECK(fleet.accepted() == 2);
+
+  fleet.CloseIdle();
+  CHECK(Run(&pool, LanRequest{host, "/toggle?pin=4", "", ""}).status == 0);
+  CHECK(fleet.accepted() == 2);
+  CHECK(fleet.toggles() == 0);
+
+  CHECK(Run(&pool, LanRequest{host, "/toggle?pin=4", "", ""}).status == 200);
+  CHECK(fleet.toggles() == 1);
+}
+
+// Destroying the pool with a batch still queued completes the batch.
+void TestShutdownFailsQueuedJobs() {
+  FakeFleet fleet(1, 50);
+  std::unique_ptr<LanClientPool> pool(new LanClientPool(1));
+
+  std::atomic<int> calls{0};
+  std::vector<LanResponse> responses;
+  std::vector<LanRequest> requests(
+      6, LanRequest{fleet.hosts()[0], "/state", "", ""});
+  pool->SubmitBatch(std::move(requests),
+                    [&](std::vector<LanResponse> result) {
+                      responses = std::move(result);
+                      calls++;
+                    });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  pool.reset();
+
+  CHECK(calls == 1);
+  CHECK(responses.size() == 6);
+  int unreachable = 0;
+  for (const LanResponse& response : responses) {
+    if (response.status == 0) unreachable++;
+    CHECK(response.host == fleet.hosts()[0]);
+  }
+  CHECK(unreachable >= 4);
+}
+
+}  // namespace
+
+int main() {
+  TestBatchFansOut();
+  TestWatcherPollsWithEtags();
+  TestIdleCloseRetry();
+  TestShutdownFailsQueuedJobs();
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Admission layer in front of relay actuation. A command that changes a
+// relay's wanted level is let through only when
+// - the relay has rested for dwellMs since it last switched, and
+// - the global token bucket (burst tokens, refilled at ratePerSec) has a token.
+//   Scene actions draw from a bucket of their own, so a scene switching a
+//   whole panel at once is not spread over seconds by the command budget, and
+//   a command flood cannot starve scenes either.
+// Otherwise it waits as the relay's pending level; later commands for the same
+// relay overwrite it (last writer wins) and a command that restores the
+// current level cancels it. release() lets waiting commands go once allowed.
+// Not thread-safe: callers serialise access (appliancesLock in main.cpp).
+struct AdmissionStats {
+  uint32_t admitted;     // switched immediately
+  uint32_t deferred;     // held back by the relay's dwell time
+  uint32_t throttled;    // held back by the token bucket
+  uint32_t coalesced;    // replaced a command that was still waiting
+  uint32_t cancelled;    // level restored before the waiting command ran
+  uint32_t released;     // waiting commands that later switched the relay
+};
+
+enum AdmissionBudget : uint8_t {
+  ADMIT_COMMAND = 0,
+  ADMIT_SCENE = 1,
+};
+
+class Admission {
+public:
+  static const size_t kPins = 256;
+
+  Admission(uint32_t dwellMs, uint16_t burst, uint16_t ratePerSec, uint16_t sceneBurst, uint16_t sceneRatePerSec);
+
+  void configure(uint32_t dwellMs, uint16_t burst, uint16_t ratePerSec);
+  void configureScenes(uint16_t burst, uint16_t ratePerSec);
+
+  // The wanted level of pin is now `level`. True when the relay should be
+  // driven right away; false when the command is waiting or had no effect.
+  // A waiting command keeps the budget of whoever asked last.
+  bool admit(uint8_t pin, bool level, uint32_t nowMs, AdmissionBudget budget = ADMIT_COMMAND);
+
+  // Reports one waiting command that may now run and counts it as switched.
+  // Call repeatedly until it returns false.
+  bool release(uint32_t nowMs, uint8_t& pin, bool& level);
+
+  // The relay was driven outside admission (boot, config reload): record its
+  // level and drop anything waiting for it.
+  void reset(uint8_t pin, bool level);
+
+  size_t pendingCount() const { return pending; }
+  const AdmissionStats& stats() const { return counters; }
+  uint32_t dwell() const { return dwellMs; }
+  uint16_t burst(AdmissionBudget budget = ADMIT_COMMAND) const { return buckets[budget].burst; }
+  uint16_t rate(AdmissionBudget budget = ADMIT_COMMAND) const { return buckets[budget].ratePerSec; }
+
+private:
+  struct Bucket {
+    uint16_t burst;
+    uint16_t ratePerSec;
+    uint32_t milliTokens;  // tokens * 1000, so slow refill rates stay exact
+    uint32_t refilledAt;
+
+    void configure(uint16_t burst, uint16_t ratePerSec);
+    bool take(uint32_t nowMs);
+  };
+
+  bool rested(uint8_t pin, uint32_t nowMs) const;
+  void switched(uint8_t pin, bool level, uint32_t nowMs);
+
+  uint32_t dwellMs;
+  Bucket buckets[2];      // indexed by AdmissionBudget
+
+  uint32_t switchedAt[kPins];
+  uint8_t flags[kPins];   // kLevel | kPending | kWantLevel | kSwitched | kScene
+  size_t pending;
+  size_t cursor;          // round-robin start for release()
+  AdmissionStats counters;
+};
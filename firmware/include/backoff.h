@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// Jittered exponential backoff for reconnects.
+// Each call to next() returns a delay drawn from the upper half of the current
+// window (base * 2^attempt, capped), so retries still back off but a fleet that
+// lost its link at the same moment (e.g. a router reboot) spreads out instead
+// of reconnecting in lock-step.
+class Backoff {
+public:
+  Backoff(uint32_t baseMs, uint32_t capMs);
+
+  void seed(uint32_t value);
+  uint32_t next();
+  void reset();
+  uint8_t attempts() const { return attempt; }
+
+private:
+  uint32_t random();
+
+  uint32_t baseMs;
+  uint32_t capMs;
+  uint32_t rng;
+  uint8_t attempt;
+};
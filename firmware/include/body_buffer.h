@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+enum BodyStatus { BODY_NONE, BODY_PARTIAL, BODY_COMPLETE, BODY_TOO_LARGE, BODY_BAD_CHUNK };
+
+// Request body assembled in place from the (data, len, index, total) chunks an
+// AsyncWebServer body callback receives. The header and the payload share one
+// malloc() of exactly total + 1 bytes, made on the first chunk and parked in
+// the request's _tempObject, which the server free()s with the request.
+// The payload is NUL-terminated so it can be handed straight to a parser.
+struct BodyBuffer {
+  size_t total;
+  size_t received;
+  BodyStatus status;
+
+  char* data() { return reinterpret_cast<char*>(this + 1); }
+  const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+
+  // Body callback side: copies one chunk into place, allocating on index 0.
+  // Bodies over `limit` are not buffered; the status records why.
+  static void append(void*& slot, const uint8_t* chunk, size_t len, size_t index, size_t total, size_t limit);
+
+  // Request callback side: BODY_NONE when no body arrived (or it could not
+  // be allocated).
+  static BodyStatus statusOf(const void* slot);
+};
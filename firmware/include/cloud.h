@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+#include "sse_parser.h"
+
+// The controller's side of Firebase: a few RTDB REST calls, two streams and
+// the Firestore config document. Backed by Firebase-ESP-Client by default
+// (cloud_firebase.cpp) or, when built with AURA_LEAN_RTDB, by a small client
+// that speaks the REST/SSE protocol over fixed buffers (cloud_lean.cpp).
+//
+// Bodies are JSON text; {".sv": "timestamp"} server values pass through. Keys
+// containing '/' in an update body address nested children, as in the REST API.
+typedef void (*CloudEventHandler)(const RtdbEvent& event);
+typedef void (*CloudDropHandler)();
+
+enum CloudStream : uint8_t { CLOUD_STREAM_COMMAND, CLOUD_STREAM_APPLIANCES, CLOUD_STREAM_COUNT };
+
+void cloudBegin();
+bool cloudReady();
+bool cloudSet(const String& path, const String& json);
+bool cloudUpdate(const String& path, const String& json);
+bool cloudDelete(const String& path);
+// One-shot read of |path|. With |orderBy|, only children whose orderBy value
+// is >= startAt are returned.
+bool cloudGet(const String& path, String& json, const char* orderBy = nullptr, double startAt = 0);
+// |mask| lists the fields to return, comma-separated; nullptr for all.
+bool cloudGetDocument(const String& documentPath, String& json, const char* mask = nullptr);
+String cloudError();
+
+// Handlers run on the stream task. |dropped| fires when a stream times out or
+// is cancelled by the server; it is not reopened until cloudStream() again.
+bool cloudStream(CloudStream stream, const String& path, CloudEventHandler handler, CloudDropHandler dropped);
+void cloudStopStreams();
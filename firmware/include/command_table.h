@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Command type -> handler, for the RTDB command channel. A fixed,
+// open-addressed table: a lookup hashes the type once and probes at most
+// kMaxProbe slots, so dispatch does not get slower as commands are added.
+template <typename Handler>
+class CommandTable {
+public:
+  static const size_t kSlots = 32;  // power of two
+  static const size_t kMaxProbe = 4;
+
+  struct Entry {
+    const char* type;      // string literal; nullptr marks a free slot
+    uint32_t hash;
+    uint8_t maxVersion;    // newest payload version the handler understands
+    Handler handler;
+  };
+
+  CommandTable() { memset(entries, 0, sizeof(entries)); }
+
+  // False when the type is already present or its probe window is full;
+  // both are programming errors, caught at boot.
+  bool add(const char* type, uint8_t maxVersion, Handler handler) {
+    uint32_t h = hash(type);
+    for (size_t i = 0; i < kMaxProbe; i++) {
+      Entry& entry = entries[(h + i) & (kSlots - 1)];
+      if (entry.type && entry.hash == h && strcmp(entry.type, type) == 0) return false;
+      if (!entry.type) {
+        entry = { type, h, maxVersion, handler };
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const Entry* find(const char* type) const {
+    if (!type) return nullptr;
+    uint32_t h = hash(type);
+    for (size_t i = 0; i < kMaxProbe; i++) {
+      const Entry& entry = entries[(h + i) & (kSlots - 1)];
+      if (!entry.type) return nullptr;
+      if (entry.hash == h && strcmp(entry.type, type) == 0) return &entry;
+    }
+    return nullptr;
+  }
+
+  // FNV-1a.
+  static uint32_t hash(const char* text) {
+    uint32_t h = 2166136261u;
+    while (*text) h = (h ^ (uint8_t)*text++) * 16777619u;
+    return h;
+  }
+
+private:
+  Entry entries[kSlots];
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+// Compares the running appliance list against a freshly fetched one, pairing
+// entries by pin. Both lists only need .pin, .name and .type members, so the
+// same code runs against the firmware's Appliance and host-side fixtures.
+enum ConfigEdit : uint8_t {
+  CONFIG_KEPT = 0,
+  CONFIG_ADDED = 1,
+  CONFIG_REMOVED = 2,
+  CONFIG_RENAMED = 4,
+  CONFIG_RETYPED = 8,
+};
+
+struct ConfigChange {
+  static const size_t kNone = (size_t)-1;
+
+  uint8_t edits;  // ConfigEdit bits; CONFIG_KEPT when the entry is identical
+  uint8_t pin;
+  size_t from;    // index in the running list, kNone when added
+  size_t to;      // index in the new list, kNone when removed
+};
+
+template <typename List>
+std::vector<size_t> indicesByPin(const List& list) {
+  std::vector<size_t> order(list.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return list[a].pin < list[b].pin; });
+  return order;
+}
+
+// Emits one ConfigChange per distinct pin in either list. Sorting both sides
+// and merging keeps this O(n log n); a pin listed twice in the new config only
+// counts the first time.
+template <typename Running, typename Wanted>
+void diffConfig(const Running& running, const Wanted& wanted, std::vector<ConfigChange>& changes) {
+  std::vector<size_t> a = indicesByPin(running);
+  std::vector<size_t> b = indicesByPin(wanted);
+  changes.clear();
+  changes.reserve(std::max(a.size(), b.size()));
+
+  size_t i = 0, j = 0;
+  while (i < a.size() || j < b.size()) {
+    if (j > 0 && j < b.size() && wanted[b[j]].pin == wanted[b[j - 1]].pin) { j++; continue; }
+    if (j == b.size() || (i < a.size() && running[a[i]].pin < wanted[b[j]].pin)) {
+      changes.push_back({ CONFIG_REMOVED, (uint8_t)running[a[i]].pin, a[i], ConfigChange::kNone });
+      i++;
+    } else if (i == a.size() || wanted[b[j]].pin < running[a[i]].pin) {
+      changes.push_back({ CONFIG_ADDED, (uint8_t)wanted[b[j]].pin, ConfigChange::kNone, b[j] });
+      j++;
+    } else {
+      const auto& from = running[a[i]];
+      const auto& to = wanted[b[j]];
+      uint8_t edits = CONFIG_KEPT;
+      if (!(from.name == to.name)) edits |= CONFIG_RENAMED;
+      if (!(from.type == to.type)) edits |= CONFIG_RETYPED;
+      changes.push_back({ edits, (uint8_t)from.pin, a[i], b[j] });
+      i++;
+      j++;
+    }
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Brightness for "Dimmer" appliances is a perceived level in percent. The
+// LEDC duty for each level comes from a table built at compile time from the
+// CIE 1931 lightness curve, so equal level steps look like equal steps to the
+// eye and nothing is computed per write.
+#define DIMMER_DUTY_BITS 13
+#define DIMMER_DUTY_MAX ((1 << DIMMER_DUTY_BITS) - 1)
+#define DIMMER_LEVELS 101
+// A fade may stray this many levels from the curve between ramp ends.
+#define DIMMER_FADE_TOLERANCE 1
+// At the 5 kHz PWM in main.cpp, 200 ms is 1000 cycles: still within the 1023
+// cycles the fade engine allows per duty count, so even a one-count ramp
+// keeps its time.
+#define DIMMER_MAX_RAMP_MS 200
+
+namespace dimmer_curve {
+
+constexpr double cube(double x) { return x * x * x; }
+
+// Relative luminance for a lightness L* of 0..100.
+constexpr double luminance(double lightness) {
+  return lightness <= 8.0 ? lightness / 903.3 : cube((lightness + 16.0) / 116.0);
+}
+
+constexpr uint16_t duty(size_t level) {
+  return (uint16_t)(luminance((double)level) * DIMMER_DUTY_MAX + 0.5);
+}
+
+template <size_t... I> struct Indices {};
+template <size_t N, size_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <size_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+template <typename> struct Table;
+template <size_t... I> struct Table<Indices<I...> > {
+  static constexpr uint16_t duty[sizeof...(I)] = { dimmer_curve::duty(I)... };
+};
+template <size_t... I> constexpr uint16_t Table<Indices<I...> >::duty[sizeof...(I)];
+
+typedef Table<MakeIndices<DIMMER_LEVELS>::type> Levels;
+
+constexpr bool increasing(size_t level) {
+  return level + 1 >= DIMMER_LEVELS || (duty(level) < duty(level + 1) && increasing(level + 1));
+}
+
+static_assert(Levels::duty[0] == 0 && Levels::duty[DIMMER_LEVELS - 1] == DIMMER_DUTY_MAX,
+              "dimmer table must span the full duty range");
+static_assert(increasing(0), "every dimmer level must be brighter than the one below");
+
+}  // namespace dimmer_curve
+
+inline uint16_t dimmerDuty(uint8_t level) {
+  return dimmer_curve::Levels::duty[level < DIMMER_LEVELS ? level : DIMMER_LEVELS - 1];
+}
+
+// Turns "go from level A to level B in T ms" into linear duty ramps for the
+// LEDC fade engine. Over a short stretch the curve is close to a straight
+// line, so each ramp spans as many levels as it can while staying within
+// `tolerance` levels of the curve; a fade across the whole range takes a
+// handful of ramps, not one write per step. Ramps are also cut to at most
+// maxRampMs, which bounds how long a new command waits for the one running
+// to finish (the LEDC driver cannot stop a fade midway). Not thread-safe.
+class DimmerFade {
+public:
+  explicit DimmerFade(uint8_t tolerance = DIMMER_FADE_TOLERANCE, uint32_t maxRampMs = DIMMER_MAX_RAMP_MS);
+
+  // Settles at level with nothing to do, e.g. for a channel just attached.
+  void reset(uint8_t level);
+
+  // Starts a fade; the first call to next() returns its first ramp.
+  void start(uint8_t from, uint8_t to, uint32_t durationMs);
+
+  // The next ramp: fade to `duty` over `ms` (0 means set it at once). False
+  // once the fade is complete.
+  bool next(uint16_t& duty, uint32_t& ms);
+
+  // The level the last ramp returned by next() ends at.
+  uint8_t level() const;
+  uint8_t target() const { return to; }
+  bool active() const { return at != to || substep < substeps; }
+  uint32_t ramps() const { return rampCount; }
+
+private:
+  uint32_t elapsedAt(uint8_t level) const;
+  uint8_t segmentEnd() const;
+
+  uint8_t tolerance;
+  uint32_t maxRampMs;
+  uint8_t from = 0;
+  uint8_t to = 0;
+  uint32_t durationMs = 0;
+  // Current segment: levels at..end, covered in `substeps` equal ramps.
+  uint8_t at = 0;
+  uint8_t end = 0;
+  uint32_t segmentMs = 0;
+  uint32_t substep = 0;
+  uint32_t substeps = 0;
+  uint32_t rampCount = 0;
+};
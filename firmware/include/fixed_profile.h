@@ -0,0 +1,78 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include "output_driver.h"
+
+// Appliance table for AURA_FIXED_PROFILE builds. scripts/gen_profile.py turns
+// the profile named by custom_profile in platformio.ini into
+// fixed_profile_data.h; the masks and the pin lookup below are derived from it
+// at compile time, so a bad profile fails the build instead of the boot.
+struct FixedAppliance {
+  const char* name;
+  uint8_t pin;
+  const char* type;
+};
+
+struct FixedExpander {
+  const char* type;  // nullptr when the profile has no expander
+  uint8_t address;
+  uint8_t count;
+  uint8_t latch;
+  bool invert;
+};
+
+// Defines kFixedAppliances, kFixedExpander and kFixedProfileHash.
+#include "fixed_profile_data.h"
+
+constexpr size_t kFixedCount = kFixedAppliances.size();
+
+constexpr uint64_t fixedGpioMask() {
+  uint64_t mask = 0;
+  for (const auto& appliance : kFixedAppliances) {
+    if (appliance.pin < 64) mask |= 1ULL << appliance.pin;
+  }
+  return mask;
+}
+
+constexpr uint64_t fixedExpanderMask() {
+  uint64_t mask = 0;
+  for (const auto& appliance : kFixedAppliances) {
+    uint8_t channel = appliance.pin - EXPANDER_CHANNEL_BASE;
+    if (appliance.pin >= EXPANDER_CHANNEL_BASE && channel < 64) mask |= 1ULL << channel;
+  }
+  return mask;
+}
+
+// appliances[] index for every pin, -1 where nothing is wired.
+constexpr std::array<int16_t, 256> fixedIndexTable() {
+  std::array<int16_t, 256> index{};
+  for (auto& slot : index) slot = -1;
+  for (size_t i = 0; i < kFixedCount; i++) index[kFixedAppliances[i].pin] = (int16_t)i;
+  return index;
+}
+
+// GPIOs an ESP32 actually has: 0-39 less 20, 24 and 28-31, which are not
+// bonded out, and 6-11, which drive the SPI flash.
+constexpr uint64_t kEsp32GpioMask = 0xFFFFFFFFFFULL & ~0xF1000000ULL & ~0x100000ULL & ~0xFC0ULL;
+
+constexpr bool fixedPinsValid() {
+  for (size_t i = 0; i < kFixedCount; i++) {
+    uint8_t pin = kFixedAppliances[i].pin;
+    if (pin < 40 && !(kEsp32GpioMask >> pin & 1)) return false;
+    if (pin >= 40 && pin < EXPANDER_CHANNEL_BASE) return false;
+    if (pin >= EXPANDER_CHANNEL_BASE + ShadowedOutput::kMaxChannels) return false;
+    for (size_t j = 0; j < i; j++) {
+      if (kFixedAppliances[j].pin == pin) return false;
+    }
+  }
+  return true;
+}
+
+static_assert(fixedPinsValid(), "fixed profile: pins must be unique usable GPIOs (not 6-11, 20, 24, 28-31) or expander channels");
+static_assert((fixedGpioMask() & 0xF000000000ULL) == 0, "fixed profile: GPIO 34-39 are input-only");
+static_assert(fixedExpanderMask() == 0 || kFixedExpander.type != nullptr, "fixed profile: expander channels need an expander");
+
+constexpr uint64_t kFixedGpioMask = fixedGpioMask();
+constexpr uint64_t kFixedExpanderMask = fixedExpanderMask();
+constexpr std::array<int16_t, 256> kFixedIndex = fixedIndexTable();
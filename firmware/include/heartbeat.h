@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+
+// Decides when the controller owes the cloud a liveness beat. Each beat
+// announces the interval to the next one, so the app can call a controller
+// offline once that deadline has passed instead of polling it.
+//
+// Every state write the controller makes already proves it is alive (its
+// version is a server timestamp and origin names the controller), so a write
+// resets the clock and no separate beat goes out while relays are switching.
+// The status fields (uptime, RSSI, heap, last event) still go out at least
+// every maxMs.
+//
+// A quiet, healthy controller doubles its interval after every beat up to
+// maxMs. A weak signal or a dropped stream puts it back to minMs: that is the
+// controller most likely to vanish.
+class Heartbeat {
+public:
+  Heartbeat(uint32_t minMs, uint32_t maxMs, int8_t weakRssi);
+
+  bool due(uint32_t now) const { return now - lastAt >= intervalMs || now - lastStatusAt >= maxMs; }
+  // Picks the interval announced by the beat about to go out.
+  uint32_t plan(int8_t rssi);
+  void sent(uint32_t now);
+  // The write did not go through: retry after minMs, announcing minMs.
+  void failed(uint32_t now);
+  // A state write reached the cloud.
+  void piggybacked(uint32_t now);
+  void disrupted();
+
+  uint32_t interval() const { return intervalMs; }
+  uint32_t standaloneCount() const { return standaloneBeats; }
+  uint32_t piggybackedCount() const { return piggybackedBeats; }
+
+private:
+  uint32_t minMs;
+  uint32_t maxMs;
+  int8_t weakRssi;
+  uint32_t intervalMs;
+  uint32_t lastAt;
+  uint32_t lastStatusAt;
+  bool unsettled;
+  uint32_t standaloneBeats;
+  uint32_t piggybackedBeats;
+};
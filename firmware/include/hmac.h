@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <mbedtls/md.h>
+
+// HMAC-SHA256 on top of mbedtls (part of the ESP32 core), which hands the
+// compression rounds to the SHA accelerator.
+static const size_t kHmacLength = 32;
+
+bool hmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t out[kHmacLength]);
+
+// Compares without an early exit, so the time taken does not reveal how much
+// of a forged MAC was right.
+bool equalsConstantTime(const uint8_t* a, const uint8_t* b, size_t len);
+
+// A key used for many messages. The padded key blocks are hashed once in
+// set(); each message then only costs its own bytes, and nothing is allocated.
+class HmacKey {
+public:
+  HmacKey();
+  ~HmacKey();
+  HmacKey(const HmacKey&) = delete;
+  HmacKey& operator=(const HmacKey&) = delete;
+
+  bool set(const uint8_t* key, size_t keyLen);
+  void clear();
+  bool valid() const { return ready; }
+
+  void begin();
+  void update(const void* data, size_t len);
+  void finish(uint8_t out[kHmacLength]);
+
+private:
+  mbedtls_md_context_t ctx;
+  bool ready;
+};
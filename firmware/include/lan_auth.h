@@ -0,0 +1,102 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "hmac.h"
+
+// Authentication for the local HTTP API, without TLS.
+//
+// Each controller has a key from its cloud config ("lan_key"). A client opens
+// a session in two steps: it asks for a challenge, which the controller hands
+// out once and forgets after kChallengeMs, then sends a random nonce with
+//   HMAC(key, "aura-open" challenge || client nonce).
+// A challenge is spent by the first proof for it, so a captured open cannot
+// be replayed. Both sides then derive
+//   session key = HMAC(key, "aura-session" client nonce || challenge).
+// Every request then carries the session id, a counter and
+//   HMAC(session key, method "\n" target "\n" counter "\n" body)
+// where target is the path plus the query. Counters may arrive out of order
+// within a 64-wide sliding window, but each is accepted once. Sessions live in
+// RAM only, so a reboot simply asks clients to open a new one.
+enum LanAuthResult : uint8_t {
+  LAN_AUTH_OK,
+  LAN_AUTH_NO_SESSION,
+  LAN_AUTH_EXPIRED,
+  LAN_AUTH_REPLAYED,
+  LAN_AUTH_BAD_MAC,
+};
+
+const char* lanAuthReason(LanAuthResult result);
+
+// Accepts each counter once: anything newer than the highest seen, or within
+// the 64 below it and not seen yet.
+class ReplayWindow {
+public:
+  ReplayWindow() { reset(); }
+  void reset() { highest = 0; seen = 0; }
+  bool fresh(uint64_t counter) const;
+  void mark(uint64_t counter);
+
+private:
+  uint64_t highest;
+  uint64_t seen;  // bit i: highest - i was accepted
+};
+
+class LanAuth {
+public:
+  static const size_t kSessions = 8;
+  static const size_t kChallenges = 8;
+  static const size_t kNonceLength = 16;
+  static const uint32_t kChallengeMs = 10000;
+
+  LanAuth(uint32_t idleMs, uint32_t lifetimeMs);
+
+  // Replacing the key ends every session.
+  bool setKey(const uint8_t* key, size_t keyLen);
+  bool enabled() const { return deviceKey.valid(); }
+  void seed(uint32_t value) { nextId = value | 1; }
+
+  // Remembers |challenge| (random, from the caller) for one open(); the
+  // oldest outstanding one makes room.
+  void issue(const uint8_t challenge[kNonceLength], uint32_t now);
+
+  // False when |challenge| is unknown, expired or already spent, or when
+  // |clientProof| is wrong. Otherwise spends the challenge, takes the oldest
+  // slot and fills |serverProof| = HMAC(session key, "aura-ready"), letting
+  // the client check it reached the right controller.
+  bool open(const uint8_t challenge[kNonceLength], const uint8_t clientNonce[kNonceLength],
+            const uint8_t clientProof[kHmacLength], uint32_t now, uint32_t& id, uint8_t serverProof[kHmacLength]);
+
+  LanAuthResult verify(uint32_t id, uint64_t counter, const char* method, const char* target, const char* body,
+                       size_t bodyLen, const uint8_t mac[kHmacLength], uint32_t now);
+
+  size_t liveSessions(uint32_t now) const;
+
+private:
+  struct Session {
+    uint32_t id;
+    uint32_t openedAt;
+    uint32_t usedAt;
+    bool live;
+    ReplayWindow window;
+    HmacKey key;
+  };
+
+  struct Challenge {
+    uint8_t nonce[kNonceLength];
+    uint32_t issuedAt;
+    bool live;
+  };
+
+  bool expired(const Session& session, uint32_t now) const;
+
+  HmacKey deviceKey;
+  Session sessions[kSessions];
+  Challenge challenges[kChallenges];
+  uint32_t idleMs;
+  uint32_t lifetimeMs;
+  uint32_t nextId;
+};
+
+// Lower- or upper-case hex of exactly 2 * len digits.
+bool decodeHex(const char* text, uint8_t* out, size_t len);
+void encodeHex(const uint8_t* data, size_t len, char* out);  // writes 2 * len + 1 bytes
@@ -0,0 +1,118 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+
+// Appliance::pin is an output channel. Channels below EXPANDER_CHANNEL_BASE
+// are ESP32 GPIOs; EXPANDER_CHANNEL_BASE + n is output n of the expander
+// chain configured for the controller.
+#define EXPANDER_CHANNEL_BASE 100
+
+class OutputDriver {
+public:
+  virtual ~OutputDriver() {}
+
+  virtual bool begin() = 0;
+  virtual uint16_t channels() const = 0;
+  virtual void configure(uint16_t /* channel */) {}
+  // May only stage the change; flush() makes staged changes visible.
+  virtual void write(uint16_t channel, bool on) = 0;
+  virtual void flush() {}
+};
+
+// Bus seams so the expander drivers carry no Arduino dependency.
+class I2cBus {
+public:
+  virtual ~I2cBus() {}
+  virtual bool write(uint8_t address, const uint8_t* data, size_t len) = 0;
+};
+
+class ShiftBus {
+public:
+  virtual ~ShiftBus() {}
+  // Shifts bytes out in order and latches them in one go.
+  virtual void shiftOut(const uint8_t* data, size_t len) = 0;
+};
+
+// Expander backends keep a shadow of every output. write() only flips bits;
+// flush() (once per loop tick) sends everything that changed since the last
+// flush, so a burst of changes costs one bus transaction per chip or chain.
+// Channels whose transfer failed (e.g. an I2C NACK) stay dirty and are sent
+// again on the next flush.
+class ShadowedOutput : public OutputDriver {
+public:
+  static const uint16_t kMaxChannels = 64;
+
+  uint16_t channels() const override { return count; }
+  void write(uint16_t channel, bool on) override;
+  void flush() override;
+
+  uint32_t writes() const { return writeCount; }
+  uint32_t transactions() const { return transactionCount; }
+  uint32_t failures() const { return failureCount; }
+
+protected:
+  ShadowedOutput(uint16_t count, bool activeLow);
+
+  // Sends `levels` (already inverted for active-low boards); `changed` has
+  // a bit set for every channel written since the last transfer. Returns the
+  // number of bus transactions and sets `failed` to the channels of every
+  // transaction the bus rejected.
+  virtual uint32_t transfer(uint64_t levels, uint64_t changed, uint64_t& failed) = 0;
+  uint64_t levels() const;
+
+private:
+  std::mutex mutex;
+  uint64_t shadow = 0;
+  uint64_t dirty = 0;
+  uint16_t count;
+  bool activeLow;
+  uint32_t writeCount = 0;
+  uint32_t transactionCount = 0;
+  uint32_t failureCount = 0;
+};
+
+// MCP23017: 16 outputs per chip, chips at consecutive I2C addresses.
+class Mcp23017Output : public ShadowedOutput {
+public:
+  Mcp23017Output(I2cBus& bus, uint8_t address, uint8_t chips, bool activeLow);
+  bool begin() override;
+
+protected:
+  uint32_t transfer(uint64_t levels, uint64_t changed, uint64_t& failed) override;
+
+private:
+  I2cBus& bus;
+  uint8_t address;
+  uint8_t chips;
+};
+
+// PCF8574: 8 quasi-bidirectional outputs per chip. They only sink current,
+// so relay boards on this chip are normally wired active-low.
+class Pcf8574Output : public ShadowedOutput {
+public:
+  Pcf8574Output(I2cBus& bus, uint8_t address, uint8_t chips, bool activeLow);
+  bool begin() override;
+
+protected:
+  uint32_t transfer(uint64_t levels, uint64_t changed, uint64_t& failed) override;
+
+private:
+  I2cBus& bus;
+  uint8_t address;
+  uint8_t chips;
+};
+
+// 74HC595 daisy chain: the whole chain is rewritten on every transfer.
+class Shift595Output : public ShadowedOutput {
+public:
+  Shift595Output(ShiftBus& bus, uint8_t chips, bool activeLow);
+  bool begin() override;
+
+protected:
+  uint32_t transfer(uint64_t levels, uint64_t changed, uint64_t& failed) override;
+
+private:
+  ShiftBus& bus;
+  uint8_t chips;
+};
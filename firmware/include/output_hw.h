@@ -0,0 +1,86 @@
+#pragma once
+#include <Arduino.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <esp_timer.h>
+#include <mutex>
+#include "output_driver.h"
+#include "dimmer.h"
+
+// Native ESP32 GPIOs: writes go straight to the pin, nothing to flush.
+class GpioOutput : public OutputDriver {
+public:
+  bool begin() override { return true; }
+  uint16_t channels() const override { return EXPANDER_CHANNEL_BASE; }
+  void configure(uint16_t channel) override;
+  void write(uint16_t channel, bool on) override;
+  // Drives every GPIO in mask LOW and makes it an output, in one go.
+  void configureMask(uint64_t mask);
+};
+
+class WireBus : public I2cBus {
+public:
+  explicit WireBus(TwoWire& wire) : wire(wire) {}
+  bool write(uint8_t address, const uint8_t* data, size_t len) override;
+
+private:
+  TwoWire& wire;
+};
+
+// 74HC595 chain on the hardware SPI bus with a separate latch (RCLK) pin.
+class SpiShiftBus : public ShiftBus {
+public:
+  SpiShiftBus(SPIClass& spi, uint8_t latchPin) : spi(spi), latchPin(latchPin) {}
+  void begin();
+  void shiftOut(const uint8_t* data, size_t len) override;
+
+private:
+  SPIClass& spi;
+  uint8_t latchPin;
+};
+
+// "Dimmer" appliances on the LEDC peripheral, one channel per GPIO. A fade is
+// handed to the hardware fade engine a ramp at a time (see DimmerFade), and a
+// one-shot esp_timer per channel starts the next ramp, so the CPU only steps
+// in at ramp boundaries. A command that arrives mid-ramp is queued and takes
+// over from wherever the running ramp ends.
+class LedcDimmer {
+public:
+  static const uint8_t kChannels = 8;
+
+  explicit LedcDimmer(uint32_t pwmHz) : pwmHz(pwmHz) {}
+
+  // Takes a free channel for pin and starts it dark. False when none is free.
+  bool attach(uint8_t pin);
+  // Frees pin's channel; the pin is left driven low.
+  void release(uint8_t pin);
+  bool owns(uint8_t pin) const { return pin < 64 && (pins >> pin) & 1; }
+
+  void fade(uint8_t pin, uint8_t level, uint32_t ms);
+  uint32_t ramps() const { return rampCount; }
+
+private:
+  struct Channel {
+    LedcDimmer* owner;
+    uint8_t index;
+    int16_t pin;
+    DimmerFade fade;
+    esp_timer_handle_t timer;
+    bool running;      // a hardware ramp is in progress
+    bool queued;
+    uint8_t queuedLevel;
+    uint32_t queuedMs;
+  };
+
+  bool begin();
+  Channel* find(uint8_t pin);
+  void run(Channel& channel);
+  static void onRampEnd(void* arg);
+
+  std::mutex mutex;
+  Channel channels[kChannels];
+  uint64_t pins = 0;
+  uint32_t pwmHz;
+  bool started = false;
+  uint32_t rampCount = 0;
+};
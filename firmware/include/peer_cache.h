@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Other Aura controllers found on the LAN via mDNS, keyed by MAC.
+// Fixed capacity so lookups never allocate; entries expire after ttlMs and the
+// oldest entry is evicted when a new peer arrives and the cache is full.
+struct Peer {
+  char mac[18];
+  uint32_t ip;
+  uint16_t port;
+  uint32_t seenAt;
+};
+
+class PeerCache {
+public:
+  static const size_t kCapacity = 16;
+
+  explicit PeerCache(uint32_t ttlMs);
+
+  void update(const char* mac, uint32_t ip, uint16_t port, uint32_t nowMs);
+  const Peer* find(const char* mac, uint32_t nowMs) const;
+  void expire(uint32_t nowMs);
+
+  size_t size() const { return count; }
+  const Peer& at(size_t i) const { return peers[i]; }
+
+private:
+  bool expired(const Peer& peer, uint32_t nowMs) const;
+
+  Peer peers[kCapacity];
+  size_t count;
+  uint32_t ttlMs;
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// LAN scene broadcast. Controllers share one multicast group and exchange
+// signed packets of two kinds:
+// - beacons carry the sender's network time and keep clocks loosely aligned;
+// - scenes list (controller, pin, state) actions and the network time at
+//   which every controller applies its share.
+// Every packet also carries the sender's boot id, which goes up by one each
+// boot, and a sequence number that goes up with every packet it sends, so a
+// captured packet cannot be passed off as a newer one.
+// Everything here is plain C++ so a whole fleet can be simulated on a host.
+//
+// Wire format, little-endian, followed by the first kSceneMacLength bytes of
+// HMAC-SHA256 over everything before it:
+//   'A' 'S' version type  sender[6]  boot:u32  seq:u32  time_us:i64
+//   scene only: name_len:u8 name  count:u8  { mac[6] pin:u8 state:u8 } * count
+static const uint8_t kSceneVersion = 2;
+static const size_t kSceneMacLength = 16;
+static const size_t kSceneMaxActions = 32;
+static const size_t kSceneMaxName = 31;
+static const size_t kSceneMaxPacket = 26 + 1 + kSceneMaxName + 1 + kSceneMaxActions * 8 + kSceneMacLength;
+
+enum ScenePacketType : uint8_t {
+  SCENE_BEACON = 1,
+  SCENE_RUN = 2,
+};
+
+struct SceneAction {
+  uint8_t mac[6];
+  uint8_t pin;
+  uint8_t state;
+};
+
+struct ScenePacket {
+  ScenePacketType type;
+  uint8_t sender[6];
+  uint32_t bootId;
+  uint32_t seq;
+  int64_t timeUs;  // beacon: sender's network time; scene: when to run it
+  char name[kSceneMaxName + 1];
+  uint8_t count;
+  SceneAction actions[kSceneMaxActions];
+};
+
+// Returns the encoded length, or 0 if the packet does not fit in capacity.
+size_t encodeScenePacket(const ScenePacket& packet, const uint8_t* key, size_t keyLen, uint8_t* out, size_t capacity);
+// False for malformed packets and bad signatures.
+bool decodeScenePacket(const uint8_t* data, size_t len, const uint8_t* key, size_t keyLen, ScenePacket& packet);
+
+// Loose network clock. The controller with the lowest MAC heard recently is
+// the reference and everyone else follows its beacons. A beacon's one-way
+// delay only ever makes the sender's clock look behind, so the offset is the
+// largest (sender time - arrival time) over the last few beacons.
+// Network time is the reference's uptime, so it steps back when the reference
+// reboots or a controller with a lower MAC takes over; onBeacon() reports it.
+// A beacon is only taken if its (boot id, seq) is past the last one heard
+// from its sender, so a replayed beacon can neither step the clock nor bring
+// back an old reference.
+class SceneClock {
+public:
+  static const size_t kWindow = 8;
+  static const size_t kSenders = 16;
+  static const int64_t kReferenceTimeoutUs = 10000000;
+  static const int64_t kStepUs = 500000;
+
+  explicit SceneClock(const uint8_t mac[6]);
+
+  int64_t now(int64_t localUs) const { return localUs + offsetUs; }
+  int64_t toLocal(int64_t networkUs) const { return networkUs - offsetUs; }
+  int64_t offset() const { return offsetUs; }
+  const uint8_t* reference() const { return referenceMac; }
+  bool isReference(int64_t localUs) const;
+
+  // True when the beacon changed the reference or stepped network time back
+  // by more than kStepUs; scene times taken before it are in another base.
+  bool onBeacon(const ScenePacket& beacon, int64_t localUs);
+  uint32_t replays() const { return replayCount; }
+
+private:
+  struct Sender {
+    uint8_t mac[6];
+    uint32_t bootId;
+    uint32_t seq;
+  };
+  bool isFresh(const ScenePacket& beacon);
+
+  Sender senders[kSenders];
+  size_t senderCount;
+  size_t nextEvict;
+  uint32_t replayCount;
+  uint8_t self[6];
+  uint8_t referenceMac[6];
+  int64_t referenceSeenUs;
+  int64_t samples[kWindow];
+  size_t sampleCount;
+  size_t nextSample;
+  int64_t offsetUs;
+};
+
+// Drops scenes that are replayed, stale or scheduled implausibly far ahead.
+// From one sender, (boot id, seq) and scene times must both strictly increase.
+class SceneGuard {
+public:
+  static const size_t kSenders = 16;
+  static const int64_t kWindowUs = 10000000;
+
+  SceneGuard();
+  bool accept(const ScenePacket& scene, int64_t networkNowUs);
+  // Network time stepped by deltaUs: each sender's last scene time is moved
+  // into the new base, so scenes from before the step stay rejected.
+  void rebase(int64_t deltaUs);
+
+private:
+  struct Sender {
+    uint8_t mac[6];
+    uint32_t bootId;
+    uint32_t seq;
+    int64_t lastTimeUs;
+  };
+  Sender senders[kSenders];
+  size_t count;
+  size_t nextEvict;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental parser for the server-sent events the RTDB REST API streams.
+// Bytes are fed as they arrive, in chunks of any size; each complete event is
+// handed over as pointers into the caller's fixed buffer, so nothing is
+// allocated per event. An event whose data does not fit is dropped and
+// counted rather than delivered truncated.
+class SseParser {
+public:
+  // data is NUL-terminated and may be modified in place by the handler.
+  typedef void (*Handler)(void* context, const char* event, char* data, size_t length);
+
+  SseParser(char* buffer, size_t capacity, Handler handler, void* context);
+
+  void feed(const char* bytes, size_t length);
+  void reset();
+
+  uint32_t events() const { return eventCount; }
+  uint32_t overflows() const { return overflowCount; }
+
+private:
+  enum Field : uint8_t { FIELD_NAME, FIELD_EVENT, FIELD_DATA, FIELD_IGNORED };
+
+  void endLine();
+  void dispatch();
+
+  char* buffer;
+  size_t capacity;
+  Handler handler;
+  void* context;
+
+  size_t length;          // data bytes collected for the current event
+  bool hasData;
+  bool overflowed;
+  char event[24];
+  size_t eventLength;
+  char name[8];
+  size_t nameLength;
+  Field field;
+  bool skipSpace;         // a single space after "field:" is not part of the value
+  bool lastWasCr;
+  uint32_t eventCount;
+  uint32_t overflowCount;
+};
+
+// The "data" of an RTDB put/patch event, {"path": "...", "data": <value>},
+// split in place. String values are unquoted and unescaped.
+enum RtdbDataType : uint8_t { RTDB_NULL, RTDB_STRING, RTDB_JSON, RTDB_SCALAR };
+
+struct RtdbEvent {
+  const char* path;
+  const char* data;
+  size_t length;
+  RtdbDataType type;
+};
+
+bool parseRtdbEvent(char* payload, size_t length, RtdbEvent& out);
@@ -0,0 +1,63 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+// Serialized view of every appliance, served by GET /state.
+// The JSON is only rebuilt after markDirty(); in between, polls are answered
+// from a preallocated buffer, or with 304 when the client's ETag matches.
+// Two buffers alternate. A response sends from a Body it holds through
+// share(), for as long as the client takes to read it; a rebuild never writes
+// to or frees a Body that is still held, it writes a fresh one instead.
+// Buffers start at kInitialCapacity and grow to fit the appliance list (a
+// 64-relay panel needs about 7 KB); they never shrink, so steady-state
+// rebuilds with no slow readers do not allocate.
+class StateSnapshot {
+public:
+  static const size_t kInitialCapacity = 2048;
+
+  struct Body {
+    Body(char* data, size_t capacity) : data(data), capacity(capacity) {}
+    ~Body();
+    Body(const Body&) = delete;
+    Body& operator=(const Body&) = delete;
+
+    char* const data;
+    const size_t capacity;
+    size_t length = 0;
+  };
+
+  // Writes the snapshot into buffer if it fits in capacity (including the
+  // terminating NUL) and returns its length either way, like snprintf.
+  typedef size_t (*Writer)(char* buffer, size_t capacity);
+
+  StateSnapshot();
+  StateSnapshot(const StateSnapshot&) = delete;
+  StateSnapshot& operator=(const StateSnapshot&) = delete;
+
+  // The boot id goes into the ETag so tags from before a reboot never match.
+  void seed(uint32_t bootId) { this->bootId = bootId; }
+
+  void markDirty() { dirty = true; }
+  bool isDirty() const { return dirty; }
+  // False only if a larger buffer could not be allocated.
+  bool rebuild(Writer write);
+
+  const char* body() const { return bodies[current] ? bodies[current]->data : ""; }
+  size_t length() const { return bodies[current] ? bodies[current]->length : 0; }
+  size_t capacity() const { return bodies[current] ? bodies[current]->capacity : 0; }
+  // The current body, kept alive and unchanged until the last holder drops it.
+  std::shared_ptr<const Body> share() const { return bodies[current]; }
+  const char* etag() const { return tag; }
+  bool matches(const char* ifNoneMatch) const;
+
+private:
+  bool reserve(uint8_t index, size_t capacity);
+
+  std::shared_ptr<Body> bodies[2];
+  uint8_t current = 0;
+  uint32_t bootId = 0;
+  uint32_t generation = 0;
+  char tag[24] = "";
+  volatile bool dirty = true;
+};
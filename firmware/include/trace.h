@@ -0,0 +1,119 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Lightweight span tracing for the toggle pipeline (stream receive, parse,
+// lookup, actuation, cloud report). Spans go into a fixed ring per CPU core,
+// oldest overwritten first, and are exported in Chrome trace-event format
+// (chrome://tracing, Perfetto). Timestamps come from a monotonic µs clock.
+// Define AURA_NO_TRACE to compile every TraceScope out.
+struct TraceSpan {
+  const char* name;  // must be a string literal
+  int64_t startUs;
+  uint32_t durUs;
+  int16_t pin;       // -1 when the span is not tied to an appliance
+  uint8_t core;
+};
+
+int64_t traceNowUs();
+uint8_t traceCore();
+
+class TraceRing {
+public:
+  static const size_t kCapacity = 128;
+
+  void record(const TraceSpan& span);
+  // Copies the spans still in the ring, oldest first. A slot being written
+  // while it is read is skipped rather than copied torn.
+  size_t copy(TraceSpan* out, size_t max) const;
+
+  // Tickets [end() - kCapacity, end()) may still be in the ring; read() is
+  // false for a ticket overwritten or being written since.
+  uint32_t end() const { return head.load(std::memory_order_acquire); }
+  bool read(uint32_t ticket, TraceSpan& out) const;
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq{0};  // ticket + 1 once written, 0 while writing
+    TraceSpan span;
+  };
+  Slot slots[kCapacity];
+  std::atomic<uint32_t> head{0};
+};
+
+class Tracer {
+public:
+  static const size_t kCores = 2;
+  static const size_t kMaxSpans = kCores * TraceRing::kCapacity;
+
+  void record(const char* name, int64_t startUs, int16_t pin);
+  // Spans from every core, sorted by start time. out holds kMaxSpans.
+  size_t snapshot(TraceSpan* out) const;
+  const TraceRing& ring(size_t core) const { return rings[core]; }
+
+private:
+  TraceRing rings[kCores];
+};
+
+extern Tracer tracer;
+
+// One Chrome "complete" event ({"ph":"X",...}) for span, without separators.
+// Returns its length, or 0 if it does not fit in capacity.
+size_t formatChromeEvent(char* buffer, size_t capacity, const TraceSpan& span);
+
+// Produces the Chrome trace file a piece at a time, formatting each span as
+// it goes, so neither the spans nor the JSON are ever held in full (GET
+// /trace answers with it as a chunked response). Spans are read straight
+// from the rings, core by core in the order they ended; trace viewers sort
+// by timestamp themselves.
+class ChromeTraceWriter {
+public:
+  explicit ChromeTraceWriter(const Tracer& tracer) : tracer(tracer) {}
+
+  // Fills up to capacity bytes and returns how many; 0 once it is all out.
+  size_t read(uint8_t* buffer, size_t capacity);
+
+private:
+  bool nextEvent();
+
+  const Tracer& tracer;
+  uint8_t stage = 0;  // header, events, footer, done
+  size_t core = 0;
+  uint32_t ticket = 0;
+  uint32_t end = 0;
+  bool ringOpen = false;
+  bool first = true;
+  char pending[168];
+  size_t pendingLength = 0;
+  size_t pendingAt = 0;
+};
+
+#ifndef ARDUINO
+// Host builds: writes every recorded span to path as a Chrome trace file.
+bool dumpChromeTrace(const char* path);
+#endif
+
+// Records the enclosing scope as one span.
+#ifndef AURA_NO_TRACE
+class TraceScope {
+public:
+  explicit TraceScope(const char* name, int16_t pin = -1) : name(name), pin(pin), startUs(traceNowUs()) {}
+  ~TraceScope() { tracer.record(name, startUs, pin); }
+  void setPin(int16_t pin) { this->pin = pin; }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  const char* name;
+  int16_t pin;
+  int64_t startUs;
+};
+#else
+class TraceScope {
+public:
+  explicit TraceScope(const char*, int16_t = -1) {}
+  void setPin(int16_t) {}
+};
+#endif
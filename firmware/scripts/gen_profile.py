@@ -0,0 +1,78 @@
+"""Generates fixed_profile_data.h from a checked-in appliance profile.
+
+The profile uses the same shape as the Firestore device config:
+
+    {"appliances": [{"name": "Fan", "pin": 5, "type": "Fan"}],
+     "expander": {"type": "mcp23017", "address": 32, "count": 1}}
+
+Runs as a PlatformIO pre: script for builds with custom_profile set, or
+standalone:
+
+    python scripts/gen_profile.py profiles/fixed.json <out_dir>
+"""
+import json
+import os
+import sys
+import zlib
+
+HEADER = "fixed_profile_data.h"
+
+
+def c_string(value):
+    return json.dumps(str(value), ensure_ascii=True)
+
+
+def render(profile, source):
+    appliances = profile.get("appliances", [])
+    expander = profile.get("expander")
+    canonical = json.dumps(profile, sort_keys=True, separators=(",", ":"))
+
+    lines = [
+        "// Generated by scripts/gen_profile.py from %s. Do not edit." % source,
+        "#pragma once",
+        "",
+        "constexpr std::array<FixedAppliance, %d> kFixedAppliances = {{" % len(appliances),
+    ]
+    for appliance in appliances:
+        lines.append("  { %s, %d, %s }," % (c_string(appliance["name"]), int(appliance["pin"]),
+                                            c_string(appliance.get("type", "Light"))))
+    lines.append("}};")
+    lines.append("")
+    if expander:
+        lines.append("constexpr FixedExpander kFixedExpander = { %s, %d, %d, %d, %s };" % (
+            c_string(expander["type"]), int(expander.get("address", 0x20)), int(expander.get("count", 1)),
+            int(expander.get("latch", 5)), "true" if expander.get("invert") else "false"))
+    else:
+        lines.append("constexpr FixedExpander kFixedExpander = { nullptr, 0, 0, 0, false };")
+    # Changes whenever the profile does, so a runtime override recorded
+    # against an older profile is dropped when a new one is flashed.
+    lines.append("constexpr uint32_t kFixedProfileHash = 0x%08xu;" % zlib.crc32(canonical.encode()))
+    return "\n".join(lines) + "\n"
+
+
+def generate(profile_path, out_dir):
+    with open(profile_path) as f:
+        profile = json.load(f)
+    text = render(profile, os.path.basename(profile_path))
+    os.makedirs(out_dir, exist_ok=True)
+    out_path = os.path.join(out_dir, HEADER)
+    # Left untouched when unchanged so the firmware is not rebuilt needlessly.
+    if os.path.exists(out_path):
+        with open(out_path) as f:
+            if f.read() == text:
+                return out_path
+    with open(out_path, "w") as f:
+        f.write(text)
+    return out_path
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: gen_profile.py <profile.json> <out_dir>")
+    print(generate(sys.argv[1], sys.argv[2]))
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    profile = env.GetProjectOption("custom_profile")
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "generated")
+    generate(os.path.join(env.subst("$PROJECT_DIR"), profile), out_dir)
+    env.Append(CPPPATH=[out_dir])
@@ -0,0 +1,356 @@
+"""Load and soak test for a controller's local HTTP API.
+
+Drives a running controller with concurrent clients over keep-alive or fresh
+connections and a weighted mix of endpoints, while sampling GET /stats for
+heap. Reports throughput, p50/p99/p999 latency per endpoint and the heap
+high-water mark; --json writes the report for comparing firmware versions,
+and --baseline compares against an earlier one.
+
+    python scripts/load_test.py 192.168.1.40 --concurrency 16 --duration 600 \\
+        --mix state=8,toggle=1,stats=1 --pins 4,5 [--fresh] [--lan-key KEY] \\
+        [--json report.json] [--baseline previous.json]
+
+Toggles switch real outputs: point --pins at channels with nothing attached.
+Without a controller, `pio test -e native -f test_local_api_load` runs the
+same mix against the /state snapshot and body assembly on the host.
+With a LAN key configured on the controller, pass it with --lan-key so
+/toggle requests are signed (see include/lan_auth.h).
+"""
+import argparse
+import datetime
+import hashlib
+import hmac
+import http.client
+import json
+import math
+import os
+import random
+import sys
+import threading
+import time
+
+ENDPOINTS = {
+    "state": ("GET", "/state"),
+    "toggle": ("GET", "/toggle?pin={pin}"),
+    "stats": ("GET", "/stats"),
+    "peers": ("GET", "/peers"),
+}
+BUCKET_BASE = 1.02  # 2% latency resolution; a bounded histogram keeps hours-long runs flat in memory
+
+
+class Histogram:
+    def __init__(self):
+        self.buckets = {}
+        self.count = 0
+        self.max_ms = 0.0
+
+    def add(self, ms):
+        key = int(math.log(max(ms, 0.001) * 1000, BUCKET_BASE))
+        self.buckets[key] = self.buckets.get(key, 0) + 1
+        self.count += 1
+        self.max_ms = max(self.max_ms, ms)
+
+    def merge(self, other):
+        for key, n in other.buckets.items():
+            self.buckets[key] = self.buckets.get(key, 0) + n
+        self.count += other.count
+        self.max_ms = max(self.max_ms, other.max_ms)
+
+    def percentile(self, p):
+        if not self.count:
+            return None
+        rank = math.ceil(p / 100.0 * self.count)
+        seen = 0
+        for key in sorted(self.buckets):
+            seen += self.buckets[key]
+            if seen >= rank:
+                return round(min(BUCKET_BASE ** (key + 1) / 1000, self.max_ms), 3)
+        return round(self.max_ms, 3)
+
+
+class Recorder:
+    def __init__(self, names):
+        self.lock = threading.Lock()
+        self.total = {name: Histogram() for name in names}
+        self.window = Histogram()
+        self.errors = {name: {} for name in names}
+
+    def record(self, name, ms, outcome):
+        with self.lock:
+            if outcome == "ok":
+                self.total[name].add(ms)
+                self.window.add(ms)
+            else:
+                self.errors[name][outcome] = self.errors[name].get(outcome, 0) + 1
+
+    def take_window(self):
+        with self.lock:
+            window, self.window = self.window, Histogram()
+        return window
+
+
+class LanSession:
+    """One session shared by every worker; the controller's 64-wide replay
+    window absorbs the reordering that concurrent requests cause."""
+
+    def __init__(self, host, port, key):
+        self.host, self.port, self.key = host, port, key.encode()
+        self.lock = threading.Lock()
+        self.id = None
+
+    def open(self):
+        conn = http.client.HTTPConnection(self.host, self.port, timeout=5)
+        conn.request("GET", "/session")
+        response = conn.getresponse()
+        body = response.read()
+        if response.status != 200:
+            sys.exit("challenge refused: %d %s" % (response.status, body.decode(errors="replace")))
+        challenge = bytes.fromhex(json.loads(body)["challenge"])
+        nonce = os.urandom(16)
+        proof = hmac.new(self.key, b"aura-open" + challenge + nonce, hashlib.sha256).hexdigest()
+        conn.request("POST", "/session",
+                     json.dumps({"challenge": challenge.hex(), "nonce": nonce.hex(), "proof": proof}),
+                     {"Content-Type": "application/json"})
+        response = conn.getresponse()
+        body = response.read()
+        conn.close()
+        if response.status != 200:
+            sys.exit("session refused: %d %s" % (response.status, body.decode(errors="replace")))
+        reply = json.loads(body)
+        session_key = hmac.new(self.key, b"aura-session" + nonce + challenge, hashlib.sha256).digest()
+        if hmac.new(session_key, b"aura-ready", hashlib.sha256).hexdigest() != reply["proof"]:
+            sys.exit("session proof mismatch: wrong --lan-key?")
+        self.id, self.session_key, self.counter = reply["id"], session_key, 0
+
+    def headers(self, method, target, body=b""):
+        with self.lock:
+            if self.id is None:
+                self.open()
+            self.counter += 1
+            counter, session_id, key = self.counter, self.id, self.session_key
+        message = b"%s\n%s\n%d\n" % (method.encode(), target.encode(), counter) + body
+        return {"X-Aura-Session": str(session_id), "X-Aura-Counter": str(counter),
+                "X-Aura-Auth": hmac.new(key, message, hashlib.sha256).hexdigest()}
+
+    def expire(self, session_id):
+        with self.lock:
+            if self.id == session_id:
+                self.id = None
+
+
+def worker(args, mix, recorder, session, deadline, seed):
+    rng = random.Random(seed)
+    names, weights = zip(*mix.items())
+    conn = None
+    etag = None
+    while time.time() < deadline:
+        name = rng.choices(names, weights)[0]
+        method, path = ENDPOINTS[name]
+        path = path.format(pin=rng.choice(args.pins) if args.pins else 0)
+        headers = {}
+        if args.fresh:
+            headers["Connection"] = "close"
+        if name == "state" and etag:
+            headers["If-None-Match"] = etag
+        if session and name == "toggle":
+            headers.update(session.headers(method, path))
+        start = time.perf_counter()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            conn.request(method, path, headers=headers)
+            response = conn.getresponse()
+            response.read()
+            ms = (time.perf_counter() - start) * 1000
+            if name == "state" and response.getheader("ETag"):
+                etag = response.getheader("ETag")
+            if response.status == 401 and session:
+                session.expire(int(headers["X-Aura-Session"]))
+            outcome = "ok" if response.status in (200, 304) else "http_%d" % response.status
+            if args.fresh or response.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException) as error:
+            ms = (time.perf_counter() - start) * 1000
+            outcome = "timeout" if isinstance(error, TimeoutError) else type(error).__name__
+            if conn:
+                conn.close()
+            conn = None
+        recorder.record(name, ms, outcome)
+        if args.think_ms:
+            time.sleep(rng.uniform(0, 2 * args.think_ms) / 1000)
+    if conn:
+        conn.close()
+
+
+def fetch_stats(args):
+    try:
+        conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+        conn.request("GET", "/stats")
+        response = conn.getresponse()
+        body = response.read()
+        conn.close()
+        return json.loads(body) if response.status == 200 else None
+    except (OSError, http.client.HTTPException, ValueError):
+        return None
+
+
+def sample(args, recorder, started, deadline, series, done):
+    while not done.wait(args.sample_interval):
+        window = recorder.take_window()
+        stats = fetch_stats(args) or {}
+        heap = stats.get("heap", {})
+        series.append({
+            "t_s": round(time.time() - started, 1),
+            "rps": round(window.count / args.sample_interval, 1),
+            "p50_ms": window.percentile(50),
+            "p99_ms": window.percentile(99),
+            "free_heap": heap.get("free"),
+            "min_free_heap": heap.get("min_free"),
+            "largest_block": heap.get("largest_block"),
+        })
+        if not args.json_only:
+            row = series[-1]
+            print("  t=%7.0fs  %7.1f req/s  p99 %s ms  free heap %s (min %s)" % (
+                row["t_s"], row["rps"], row["p99_ms"], row["free_heap"], row["min_free_heap"]), file=sys.stderr)
+
+
+def parse_mix(text):
+    mix = {}
+    for part in text.split(","):
+        name, _, weight = part.partition("=")
+        if name not in ENDPOINTS:
+            sys.exit("unknown endpoint %r (known: %s)" % (name, ", ".join(ENDPOINTS)))
+        mix[name] = float(weight or 1)
+    return mix
+
+
+def build_report(args, mix, recorder, elapsed, before, after, series):
+    endpoints = {}
+    total_ok = total_errors = 0
+    for name in mix:
+        hist = recorder.total[name]
+        errors = recorder.errors[name]
+        total_ok += hist.count
+        total_errors += sum(errors.values())
+        endpoints[name] = {
+            "requests": hist.count + sum(errors.values()),
+            "rps": round(hist.count / elapsed, 1),
+            "p50_ms": hist.percentile(50),
+            "p99_ms": hist.percentile(99),
+            "p999_ms": hist.percentile(99.9),
+            "max_ms": round(hist.max_ms, 3),
+            "errors": errors,
+        }
+    heaps = [row["min_free_heap"] for row in series if row["min_free_heap"] is not None]
+    blocks = [row["largest_block"] for row in series if row["largest_block"] is not None]
+    return {
+        "target": "%s:%d" % (args.host, args.port),
+        "firmware": (after or before or {}).get("fw"),
+        "started": datetime.datetime.now(datetime.timezone.utc).isoformat(timespec="seconds"),
+        "duration_s": round(elapsed, 1),
+        "concurrency": args.concurrency,
+        "connections": "fresh" if args.fresh else "keep-alive",
+        "mix": mix,
+        "totals": {"requests": total_ok + total_errors, "errors": total_errors,
+                   "rps": round(total_ok / elapsed, 1)},
+        "endpoints": endpoints,
+        "heap": {
+            "free_before": (before or {}).get("heap", {}).get("free"),
+            "free_after": (after or {}).get("heap", {}).get("free"),
+            # Lowest free heap since boot: the controller's high-water mark.
+            "min_free": ((after or {}).get("heap", {}).get("min_free") or (min(heaps) if heaps else None)),
+            "min_largest_block": min(blocks) if blocks else None,
+            "rebooted": bool(before and after and after.get("uptime_ms", 0) < before.get("uptime_ms", 0)),
+        },
+        "series": series,
+    }
+
+
+def print_report(report, baseline):
+    print("%s  fw %s  %s, %d clients, %.0f s" % (report["target"], report["firmware"], report["connections"],
+                                                report["concurrency"], report["duration_s"]))
+    columns = ["rps", "p50_ms", "p99_ms", "p999_ms", "max_ms"]
+    print("%-10s" % "endpoint" + "".join("%12s" % c for c in columns) + "%10s" % "errors")
+    for name, row in report["endpoints"].items():
+        print("%-10s" % name + "".join("%12s" % ("-" if row[c] is None else row[c]) for c in columns) +
+              "%10d" % sum(row["errors"].values()))
+        old = (baseline or {}).get("endpoints", {}).get(name)
+        if old:
+            print("%-10s" % "  vs base" + "".join("%12s" % delta(row[c], old.get(c)) for c in columns))
+    heap = report["heap"]
+    print("heap: free %s -> %s, min free %s, smallest largest-block %s%s" % (
+        heap["free_before"], heap["free_after"], heap["min_free"], heap["min_largest_block"],
+        "  (controller REBOOTED during the run)" if heap["rebooted"] else ""))
+    if baseline and baseline.get("heap", {}).get("min_free") is not None:
+        print("  vs base min free: %s" % delta(heap["min_free"], baseline["heap"]["min_free"]))
+
+
+def delta(new, old):
+    if new is None or not old:
+        return "-"
+    return "%+.1f%%" % ((new - old) * 100.0 / old)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="controller address")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--concurrency", type=int, default=8, help="parallel clients")
+    parser.add_argument("--duration", type=float, default=60, help="seconds to run (hours: 3600 * n)")
+    parser.add_argument("--mix", default="state=8,stats=1,peers=1", help="endpoint=weight,...")
+    parser.add_argument("--pins", type=lambda s: [int(p) for p in s.split(",")], default=[],
+                        help="pins /toggle may switch")
+    parser.add_argument("--fresh", action="store_true", help="new connection per request instead of keep-alive")
+    parser.add_argument("--think-ms", type=float, default=0, help="mean pause between a client's requests")
+    parser.add_argument("--timeout", type=float, default=5, help="per-request timeout in seconds")
+    parser.add_argument("--sample-interval", type=float, default=10, help="seconds between /stats samples")
+    parser.add_argument("--lan-key", help="controller's lan_key, to sign /toggle")
+    parser.add_argument("--json", metavar="FILE", help="write the report as JSON ('-' for stdout)")
+    parser.add_argument("--baseline", metavar="FILE", help="earlier --json report to compare against")
+    args = parser.parse_args()
+    args.json_only = args.json == "-"
+
+    mix = parse_mix(args.mix)
+    if "toggle" in mix and not args.pins:
+        sys.exit("--mix includes toggle: give the pins it may switch with --pins")
+    session = LanSession(args.host, args.port, args.lan_key) if args.lan_key else None
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    recorder = Recorder(mix)
+    before = fetch_stats(args)
+    if before is None:
+        sys.exit("no answer from http://%s:%d/stats" % (args.host, args.port))
+    started = time.time()
+    deadline = started + args.duration
+    series = []
+    done = threading.Event()
+    sampler = threading.Thread(target=sample, args=(args, recorder, started, deadline, series, done), daemon=True)
+    sampler.start()
+    workers = [threading.Thread(target=worker, args=(args, mix, recorder, session, deadline, i), daemon=True)
+               for i in range(args.concurrency)]
+    for t in workers:
+        t.start()
+    for t in workers:
+        t.join()
+    elapsed = time.time() - started
+    done.set()
+    sampler.join()
+    after = fetch_stats(args)
+
+    report = build_report(args, mix, recorder, elapsed, before, after, series)
+    if args.json:
+        if args.json_only:
+            json.dump(report, sys.stdout, indent=2)
+            print()
+            return
+        with open(args.json, "w") as f:
+            json.dump(report, f, indent=2)
+    print_report(report, baseline)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+"""Compares the dynamic, fixed-profile and lean-cloud firmware builds.
+
+Builds each environment and reports image size and static RAM from the
+PlatformIO size summary. With --port, each image is also flashed and the
+boot log is read back for the "appliances ready" line, which gives the
+time from reset to usable relays and the free heap at that point.
+
+    python scripts/profile_report.py [--port /dev/ttyUSB0] [--json]
+"""
+import argparse
+import json
+import re
+import subprocess
+import sys
+import time
+
+ENVS = ["esp32dev", "esp32dev-fixed", "esp32dev-lean"]
+SIZE_LINE = re.compile(r"^(RAM|Flash):.*used (\d+) bytes from (\d+) bytes", re.M)
+READY_LINE = re.compile(r"(\d+) appliances ready (\d+) us after boot \(([^)]+)\), free heap (\d+)")
+
+
+def build(env):
+    out = subprocess.run(["pio", "run", "-e", env], capture_output=True, text=True)
+    if out.returncode != 0:
+        sys.exit(out.stdout + out.stderr)
+    sizes = {kind.lower(): int(used) for kind, used, _ in SIZE_LINE.findall(out.stdout)}
+    return {"flash_bytes": sizes.get("flash"), "static_ram_bytes": sizes.get("ram")}
+
+
+def boot(env, port, timeout_s):
+    import serial  # pyserial ships with PlatformIO
+
+    subprocess.run(["pio", "run", "-e", env, "-t", "upload", "--upload-port", port],
+                   check=True, capture_output=True)
+    deadline = time.time() + timeout_s
+    with serial.Serial(port, 115200, timeout=1) as link:
+        # Pulse EN through RTS so the log starts at reset.
+        link.setDTR(False)
+        link.setRTS(True)
+        time.sleep(0.1)
+        link.setRTS(False)
+        while time.time() < deadline:
+            match = READY_LINE.search(link.readline().decode(errors="replace"))
+            if match:
+                return {"appliances": int(match.group(1)), "ready_us": int(match.group(2)),
+                        "source": match.group(3), "free_heap_bytes": int(match.group(4))}
+    return {"ready_us": None}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", help="serial port of a board to measure boot on")
+    parser.add_argument("--timeout", type=float, default=30, help="seconds to wait for boot")
+    parser.add_argument("--json", action="store_true", help="print JSON instead of a table")
+    args = parser.parse_args()
+
+    report = {}
+    for env in ENVS:
+        report[env] = build(env)
+        if args.port:
+            report[env].update(boot(env, args.port, args.timeout))
+
+    if args.json:
+        print(json.dumps(report, indent=2))
+        return
+    columns = ["flash_bytes", "static_ram_bytes", "ready_us", "free_heap_bytes"]
+    print("%-16s" % "env" + "".join("%18s" % c for c in columns))
+    for env, row in report.items():
+        print("%-16s" % env + "".join("%18s" % ("-" if row.get(c) is None else row[c]) for c in columns))
+
+
+if __name__ == "__main__":
+    main()
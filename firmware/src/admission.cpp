@@ -0,0 +1,108 @@
+#include "admission.h"
+#include <string.h>
+
+namespace {
+const uint8_t kLevel = 1;      // level the relay is driven at
+const uint8_t kPending = 2;    // a command is waiting
+const uint8_t kWantLevel = 4;  // level the waiting command asks for
+const uint8_t kSwitched = 8;   // switchedAt is valid
+const uint8_t kScene = 16;     // the waiting command draws from the scene bucket
+}
+
+Admission::Admission(uint32_t dwellMs, uint16_t burst, uint16_t ratePerSec, uint16_t sceneBurst,
+                     uint16_t sceneRatePerSec)
+  : pending(0), cursor(0) {
+  memset(switchedAt, 0, sizeof(switchedAt));
+  memset(flags, 0, sizeof(flags));
+  memset(&counters, 0, sizeof(counters));
+  configure(dwellMs, burst, ratePerSec);
+  configureScenes(sceneBurst, sceneRatePerSec);
+}
+
+void Admission::configure(uint32_t dwellMs, uint16_t burst, uint16_t ratePerSec) {
+  this->dwellMs = dwellMs;
+  buckets[ADMIT_COMMAND].configure(burst, ratePerSec);
+}
+
+void Admission::configureScenes(uint16_t burst, uint16_t ratePerSec) {
+  buckets[ADMIT_SCENE].configure(burst, ratePerSec);
+}
+
+bool Admission::admit(uint8_t pin, bool level, uint32_t nowMs, AdmissionBudget budget) {
+  uint8_t& f = flags[pin];
+  if (f & kPending) {
+    if (level == (bool)(f & kLevel)) {
+      f &= ~(kPending | kWantLevel | kScene);
+      pending--;
+      counters.cancelled++;
+    } else {
+      f = (f & ~kScene) | (budget == ADMIT_SCENE ? kScene : 0);
+      counters.coalesced++;
+    }
+    return false;
+  }
+  if (level == (bool)(f & kLevel)) return false;
+
+  if (!rested(pin, nowMs)) {
+    counters.deferred++;
+  } else if (!buckets[budget].take(nowMs)) {
+    counters.throttled++;
+  } else {
+    switched(pin, level, nowMs);
+    counters.admitted++;
+    return true;
+  }
+  f |= kPending | (level ? kWantLevel : 0) | (budget == ADMIT_SCENE ? kScene : 0);
+  pending++;
+  return false;
+}
+
+bool Admission::release(uint32_t nowMs, uint8_t& pin, bool& level) {
+  if (!pending) return false;
+  for (size_t n = 0; n < kPins; n++) {
+    size_t i = (cursor + n) % kPins;
+    if (!(flags[i] & kPending) || !rested(i, nowMs)) continue;
+    if (!buckets[flags[i] & kScene ? ADMIT_SCENE : ADMIT_COMMAND].take(nowMs)) continue;
+    pin = (uint8_t)i;
+    level = flags[i] & kWantLevel;
+    flags[i] &= ~(kPending | kWantLevel | kScene);
+    pending--;
+    switched(pin, level, nowMs);
+    counters.released++;
+    cursor = (i + 1) % kPins;
+    return true;
+  }
+  return false;
+}
+
+void Admission::reset(uint8_t pin, bool level) {
+  if (flags[pin] & kPending) pending--;
+  flags[pin] = (flags[pin] & kSwitched) | (level ? kLevel : 0);
+}
+
+void Admission::Bucket::configure(uint16_t burst, uint16_t ratePerSec) {
+  this->burst = burst ? burst : 1;
+  this->ratePerSec = ratePerSec;
+  milliTokens = (uint32_t)this->burst * 1000;
+  refilledAt = 0;
+}
+
+bool Admission::Bucket::take(uint32_t nowMs) {
+  uint32_t elapsed = nowMs - refilledAt;
+  refilledAt = nowMs;
+  uint32_t cap = (uint32_t)burst * 1000;
+  uint64_t refill = (uint64_t)elapsed * ratePerSec;
+  milliTokens = refill >= cap - milliTokens ? cap : milliTokens + (uint32_t)refill;
+  if (milliTokens < 1000) return false;
+  milliTokens -= 1000;
+  return true;
+}
+
+bool Admission::rested(uint8_t pin, uint32_t nowMs) const {
+  return !(flags[pin] & kSwitched) || nowMs - switchedAt[pin] >= dwellMs;
+}
+
+void Admission::switched(uint8_t pin, bool level, uint32_t nowMs) {
+  switchedAt[pin] = nowMs;
+  flags[pin] = (flags[pin] & ~kLevel) | kSwitched | (level ? kLevel : 0);
+}
@@ -0,0 +1,31 @@
+#include "backoff.h"
+
+Backoff::Backoff(uint32_t baseMs, uint32_t capMs)
+  : baseMs(baseMs), capMs(capMs), rng(0x9E3779B9u), attempt(0) {}
+
+void Backoff::seed(uint32_t value) {
+  rng = value ? value : 0x9E3779B9u;
+}
+
+uint32_t Backoff::next() {
+  uint32_t window = capMs;
+  if (attempt < 31 && (baseMs << attempt) >> attempt == baseMs) {
+    window = baseMs << attempt;
+    if (window > capMs) window = capMs;
+  }
+  if (attempt < 255) attempt++;
+  uint32_t half = window / 2;
+  return half + (half ? random() % half : 0);
+}
+
+void Backoff::reset() {
+  attempt = 0;
+}
+
+// xorshift32: cheap, allocation-free and good enough to decorrelate devices.
+uint32_t Backoff::random() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
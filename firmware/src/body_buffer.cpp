@@ -0,0 +1,34 @@
+#include "body_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+void BodyBuffer::append(void*& slot, const uint8_t* chunk, size_t len, size_t index, size_t total, size_t limit) {
+  BodyBuffer* body = static_cast<BodyBuffer*>(slot);
+  if (index == 0 && !body) {
+    bool fits = total <= limit;
+    body = static_cast<BodyBuffer*>(malloc(sizeof(BodyBuffer) + (fits ? total + 1 : 0)));
+    if (!body) return;
+    body->total = total;
+    body->received = 0;
+    body->status = fits ? BODY_PARTIAL : BODY_TOO_LARGE;
+    slot = body;
+  }
+  if (!body || body->status != BODY_PARTIAL) return;
+
+  // Chunks arrive in order on a single connection; anything else is corrupt.
+  if (index != body->received || len > body->total - body->received) {
+    body->status = BODY_BAD_CHUNK;
+    return;
+  }
+  memcpy(body->data() + index, chunk, len);
+  body->received += len;
+  if (body->received == body->total) {
+    body->data()[body->total] = '\0';
+    body->status = BODY_COMPLETE;
+  }
+}
+
+BodyStatus BodyBuffer::statusOf(const void* slot) {
+  if (!slot) return BODY_NONE;
+  return static_cast<const BodyBuffer*>(slot)->status;
+}
@@ -0,0 +1,121 @@
+#ifndef AURA_LEAN_RTDB
+#include "cloud.h"
+#include <Firebase_ESP_Client.h>
+#include <mutex>
+#include "firebase_config.h"
+
+// --- Firebase-ESP-Client backend ---
+static FirebaseData fbdo;
+static FirebaseData streams[CLOUD_STREAM_COUNT];
+static FirebaseAuth auth;
+static FirebaseConfig config;
+// fbdo is shared by loop(), the web server and scene tasks.
+static std::mutex fbdoLock;
+static CloudEventHandler handlers[CLOUD_STREAM_COUNT];
+static CloudDropHandler dropHandlers[CLOUD_STREAM_COUNT];
+
+static void deliver(CloudStream stream, FirebaseStream& data) {
+  String path = data.dataPath();
+  RtdbEvent event;
+  event.path = path.c_str();
+  String value;
+  switch (data.dataTypeEnum()) {
+    case fb_esp_rtdb_data_type_null:
+      event.type = RTDB_NULL;
+      value = "null";
+      break;
+    case fb_esp_rtdb_data_type_string:
+      event.type = RTDB_STRING;
+      value = data.stringData();
+      break;
+    case fb_esp_rtdb_data_type_json:
+      event.type = RTDB_JSON;
+      value = data.jsonString();
+      break;
+    default:
+      event.type = RTDB_SCALAR;
+      value = data.stringData();
+      break;
+  }
+  event.data = value.c_str();
+  event.length = value.length();
+  if (handlers[stream]) handlers[stream](event);
+}
+
+static void commandCallback(FirebaseStream data) { deliver(CLOUD_STREAM_COMMAND, data); }
+static void appliancesCallback(FirebaseStream data) { deliver(CLOUD_STREAM_APPLIANCES, data); }
+
+static void timeoutCallback(bool timeout) {
+  if (!timeout) return;
+  // The library cannot say which stream timed out; both are restarted anyway.
+  for (auto handler : dropHandlers) {
+    if (handler) { handler(); return; }
+  }
+}
+
+void cloudBegin() {
+  config.api_key = API_KEY;
+  config.database_url = DATABASE_URL;
+  config.signer.test_mode = true;
+  Firebase.begin(&config, &auth);
+  Firebase.reconnectWiFi(true);
+}
+
+bool cloudReady() { return Firebase.ready(); }
+
+bool cloudSet(const String& path, const String& json) {
+  FirebaseJson body;
+  body.setJsonData(json);
+  std::lock_guard<std::mutex> lock(fbdoLock);
+  return Firebase.RTDB.setJSON(&fbdo, path.c_str(), &body);
+}
+
+bool cloudUpdate(const String& path, const String& json) {
+  FirebaseJson body;
+  body.setJsonData(json);
+  std::lock_guard<std::mutex> lock(fbdoLock);
+  return Firebase.RTDB.updateNode(&fbdo, path, &body);
+}
+
+bool cloudDelete(const String& path) {
+  std::lock_guard<std::mutex> lock(fbdoLock);
+  return Firebase.RTDB.deleteNode(&fbdo, path);
+}
+
+bool cloudGet(const String& path, String& json, const char* orderBy, double startAt) {
+  QueryFilter query;
+  if (orderBy) query.orderBy(orderBy).startAt(startAt);
+  std::lock_guard<std::mutex> lock(fbdoLock);
+  if (!(orderBy ? Firebase.RTDB.getJSON(&fbdo, path, &query) : Firebase.RTDB.getJSON(&fbdo, path))) return false;
+  json = fbdo.payload();
+  return true;
+}
+
+bool cloudGetDocument(const String& documentPath, String& json, const char* mask) {
+  std::lock_guard<std::mutex> lock(fbdoLock);
+  if (!Firebase.Firestore.getDocument(&fbdo, FIREBASE_PROJECT_ID, "", documentPath.c_str(), mask ? mask : "")) return false;
+  json = fbdo.payload();
+  return true;
+}
+
+String cloudError() {
+  std::lock_guard<std::mutex> lock(fbdoLock);
+  return fbdo.errorReason();
+}
+
+bool cloudStream(CloudStream stream, const String& path, CloudEventHandler handler, CloudDropHandler dropped) {
+  handlers[stream] = handler;
+  dropHandlers[stream] = dropped;
+  if (!Firebase.RTDB.beginStream(&streams[stream], path.c_str())) return false;
+  Firebase.RTDB.setStreamCallback(&streams[stream], stream == CLOUD_STREAM_COMMAND ? commandCallback : appliancesCallback,
+                                  timeoutCallback);
+  return true;
+}
+
+void cloudStopStreams() {
+  for (auto& stream : streams) {
+    Firebase.RTDB.removeStreamCallback(&stream);
+    Firebase.RTDB.endStream(&stream);
+  }
+}
+#endif
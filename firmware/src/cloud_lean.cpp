@@ -0,0 +1,436 @@
+#ifdef AURA_LEAN_RTDB
+#include "cloud.h"
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <ctype.h>
+#include <mutex>
+#include <string.h>
+#include "firebase_config.h"
+
+// Sized for 64 appliances with 32-character names: the Firestore config
+// document, compact and masked to the fields the controller reads, is about
+// 10.1 KB, and the appliance stream's opening snapshot about 10.3 KB. The
+// command stream only carries single commands. Anything bigger is reported
+// as an error, not cut.
+#define LEAN_REST_BUFFER 12288
+#define LEAN_APPLIANCE_STREAM_BUFFER 12288
+#define LEAN_COMMAND_STREAM_BUFFER 4096
+#define LEAN_HTTP_TIMEOUT_MS 5000
+// The server sends a keep-alive event every 30 s.
+#define LEAN_STREAM_IDLE_MS 45000
+#define LEAN_STREAM_POLL_MS 10
+#define FIRESTORE_HOST "firestore.googleapis.com"
+
+// --- Lean REST/SSE backend ---
+// Certificates are not verified, as with Firebase-ESP-Client's defaults.
+struct ResponseHead {
+  int status;
+  long contentLength;   // -1 when not given
+  bool chunked;
+  bool close;
+  char location[160];
+};
+
+enum ChunkState : uint8_t { CHUNK_SIZE, CHUNK_EXTENSION, CHUNK_DATA, CHUNK_END };
+
+struct LeanStream {
+  LeanStream(char* buffer, size_t capacity);
+
+  WiFiClientSecure client;
+  std::mutex lock;        // held by the stream task while polling, by cloudStopStreams()
+  SseParser parser;
+  char path[96];
+  CloudEventHandler handler;
+  CloudDropHandler dropped;
+  bool active;
+  bool open;
+  bool cancelled;
+  unsigned long lastByteAt;
+  bool chunked;
+  ChunkState chunkState;
+  size_t chunkLeft;
+};
+
+static void onStreamEvent(void* context, const char* event, char* data, size_t length);
+static void streamTask(void* parameter);
+
+LeanStream::LeanStream(char* buffer, size_t capacity)
+  : parser(buffer, capacity, onStreamEvent, this), handler(nullptr), dropped(nullptr),
+    active(false), open(false), cancelled(false), lastByteAt(0), chunked(false), chunkState(CHUNK_SIZE), chunkLeft(0) {
+  path[0] = '\0';
+}
+
+static char rtdbHost[96];
+static WiFiClientSecure rest;
+static const char* restHost = nullptr;
+static std::mutex restLock;
+static char restBody[LEAN_REST_BUFFER];
+static char lastError[64];
+static char commandStreamBuffer[LEAN_COMMAND_STREAM_BUFFER];
+static char applianceStreamBuffer[LEAN_APPLIANCE_STREAM_BUFFER];
+static LeanStream streams[CLOUD_STREAM_COUNT] = {
+  { commandStreamBuffer, sizeof(commandStreamBuffer) },      // CLOUD_STREAM_COMMAND
+  { applianceStreamBuffer, sizeof(applianceStreamBuffer) },  // CLOUD_STREAM_APPLIANCES
+};
+
+static int readLine(WiFiClientSecure& client, char* line, size_t capacity) {
+  size_t n = 0;
+  unsigned long startedAt = millis();
+  while (millis() - startedAt < LEAN_HTTP_TIMEOUT_MS) {
+    if (!client.available()) {
+      if (!client.connected()) return -1;
+      delay(1);
+      continue;
+    }
+    int c = client.read();
+    if (c == '\n') {
+      if (n && line[n - 1] == '\r') n--;
+      line[n] = '\0';
+      return (int)n;
+    }
+    if (n + 1 < capacity) line[n++] = (char)c;
+  }
+  return -1;
+}
+
+static bool readExactly(WiFiClientSecure& client, char* out, size_t length) {
+  unsigned long startedAt = millis();
+  while (length) {
+    int n = client.available() ? client.read((uint8_t*)out, length) : 0;
+    if (n > 0) {
+      out += n;
+      length -= n;
+      startedAt = millis();
+    } else if (!client.connected() || millis() - startedAt > LEAN_HTTP_TIMEOUT_MS) {
+      return false;
+    } else {
+      delay(1);
+    }
+  }
+  return true;
+}
+
+static bool headerIs(const char* line, const char* name, const char** value) {
+  size_t n = strlen(name);
+  if (strncasecmp(line, name, n) != 0 || line[n] != ':') return false;
+  *value = line + n + 1;
+  while (**value == ' ') (*value)++;
+  return true;
+}
+
+static bool readHead(WiFiClientSecure& client, ResponseHead& head) {
+  char line[192];
+  if (readLine(client, line, sizeof(line)) < 12 || strncmp(line, "HTTP/1.", 7) != 0) return false;
+  head.status = atoi(line + 9);
+  head.contentLength = -1;
+  head.chunked = false;
+  head.close = false;
+  head.location[0] = '\0';
+  for (;;) {
+    int n = readLine(client, line, sizeof(line));
+    if (n < 0) return false;
+    if (n == 0) return true;
+    const char* value;
+    if (headerIs(line, "Content-Length", &value)) head.contentLength = atol(value);
+    else if (headerIs(line, "Transfer-Encoding", &value)) head.chunked = strstr(value, "chunked") != nullptr;
+    else if (headerIs(line, "Connection", &value)) head.close = strncasecmp(value, "close", 5) == 0;
+    else if (headerIs(line, "Location", &value)) strlcpy(head.location, value, sizeof(head.location));
+  }
+}
+
+// Reads the body into restBody. A body that does not fit is drained and
+// |fits| cleared; false only when the connection failed.
+static bool readBody(WiFiClientSecure& client, const ResponseHead& head, size_t& length, bool& fits) {
+  length = 0;
+  fits = true;
+  char scratch[64];
+  auto take = [&](size_t n) -> bool {
+    while (n) {
+      size_t room = sizeof(restBody) - 1 - length;
+      if (fits && n <= room) {
+        if (!readExactly(client, restBody + length, n)) return false;
+        length += n;
+        return true;
+      }
+      fits = false;
+      size_t step = n < sizeof(scratch) ? n : sizeof(scratch);
+      if (!readExactly(client, scratch, step)) return false;
+      n -= step;
+    }
+    return true;
+  };
+
+  if (head.status == 204 || head.status == 304) {
+    // No body, whatever the headers say.
+  } else if (head.chunked) {
+    char line[24];
+    for (;;) {
+      if (readLine(client, line, sizeof(line)) < 0) return false;
+      size_t size = strtoul(line, nullptr, 16);
+      if (size == 0) {
+        while (readLine(client, line, sizeof(line)) > 0) {}  // trailers
+        break;
+      }
+      if (!take(size) || readLine(client, line, sizeof(line)) < 0) return false;
+    }
+  } else if (head.contentLength >= 0) {
+    if (!take((size_t)head.contentLength)) return false;
+  } else {
+    // No length: the body runs until the server closes.
+    while (client.connected() || client.available()) {
+      int n = client.available();
+      if (!n) { delay(1); continue; }
+      if (!take((size_t)n)) return false;
+    }
+  }
+  restBody[length] = '\0';
+  return true;
+}
+
+static bool connectTo(WiFiClientSecure& client, const char* host) {
+  client.setInsecure();
+  client.setTimeout(LEAN_HTTP_TIMEOUT_MS / 1000);
+  return client.connect(host, 443);
+}
+
+// One request on the shared keep-alive connection. The response body is left
+// in restBody. Caller holds restLock.
+static bool request(const char* method, const char* host, const String& target, const String* body) {
+  if (restHost != host || !rest.connected()) {
+    rest.stop();
+    restHost = nullptr;
+    if (!connectTo(rest, host)) {
+      snprintf(lastError, sizeof(lastError), "connect to %s failed", host);
+      return false;
+    }
+    restHost = host;
+  }
+
+  char head[512];  // the masked Firestore GET is the longest target
+  int n = snprintf(head, sizeof(head),
+                   "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\nContent-Type: application/json\r\n"
+                   "Content-Length: %u\r\n\r\n",
+                   method, target.c_str(), host, body ? (unsigned)body->length() : 0u);
+  if (n <= 0 || (size_t)n >= sizeof(head)) {
+    strlcpy(lastError, "request too long", sizeof(lastError));
+    return false;
+  }
+  rest.write((const uint8_t*)head, n);
+  if (body) rest.write((const uint8_t*)body->c_str(), body->length());
+
+  ResponseHead response;
+  size_t length = 0;
+  bool fits = true;
+  bool ok = readHead(rest, response) && readBody(rest, response, length, fits);
+  if (!ok || response.close) {
+    rest.stop();
+    restHost = nullptr;
+  }
+  if (!ok || !fits) {
+    strlcpy(lastError, ok ? "response too large" : "connection lost", sizeof(lastError));
+    return false;
+  }
+  if (response.status != 200 && response.status != 204) {
+    snprintf(lastError, sizeof(lastError), "HTTP %d", response.status);
+    return false;
+  }
+  return true;
+}
+
+// Writes use print=silent: the server answers 204 instead of echoing the data.
+static bool rtdbWrite(const char* method, const String& path, const String* body) {
+  String target = "/" + path + ".json?print=silent";
+  std::lock_guard<std::mutex> lock(restLock);
+  return request(method, rtdbHost, target, body);
+}
+
+void cloudBegin() {
+  const char* url = DATABASE_URL;
+  if (strncmp(url, "https://", 8) == 0) url += 8;
+  strlcpy(rtdbHost, url, sizeof(rtdbHost));
+  size_t n = strlen(rtdbHost);
+  if (n && rtdbHost[n - 1] == '/') rtdbHost[n - 1] = '\0';
+  static bool taskStarted = false;
+  if (!taskStarted) {
+    taskStarted = true;
+    xTaskCreatePinnedToCore(streamTask, "cloudStream", 6144, nullptr, 1, nullptr, 1);
+  }
+}
+
+// Test-mode database: no token to fetch, ready as soon as the network is.
+bool cloudReady() { return rtdbHost[0] && WiFi.status() == WL_CONNECTED; }
+
+bool cloudSet(const String& path, const String& json) { return rtdbWrite("PUT", path, &json); }
+
+bool cloudUpdate(const String& path, const String& json) { return rtdbWrite("PATCH", path, &json); }
+
+bool cloudDelete(const String& path) { return rtdbWrite("DELETE", path, nullptr); }
+
+bool cloudGet(const String& path, String& json, const char* orderBy, double startAt) {
+  String target = "/" + path + ".json";
+  if (orderBy) {
+    char query[64];
+    snprintf(query, sizeof(query), "?orderBy=%%22%s%%22&startAt=%.0f", orderBy, startAt);
+    target += query;
+  }
+  std::lock_guard<std::mutex> lock(restLock);
+  if (!request("GET", rtdbHost, target, nullptr)) return false;
+  json = restBody;
+  return true;
+}
+
+// Firestore pretty-prints by default, which more than doubles the body.
+bool cloudGetDocument(const String& documentPath, String& json, const char* mask) {
+  String target = String("/v1/projects/") + FIREBASE_PROJECT_ID + "/databases/(default)/documents/" + documentPath +
+                  "?key=" + API_KEY + "&prettyPrint=false";
+  for (const char* field = mask; field && *field;) {
+    const char* end = strchr(field, ',');
+    size_t length = end ? (size_t)(end - field) : strlen(field);
+    target += "&mask.fieldPaths=";
+    target += String(field).substring(0, length);
+    field += end ? length + 1 : length;
+  }
+  std::lock_guard<std::mutex> lock(restLock);
+  if (!request("GET", FIRESTORE_HOST, target, nullptr)) return false;
+  json = restBody;
+  return true;
+}
+
+String cloudError() {
+  std::lock_guard<std::mutex> lock(restLock);
+  return String(lastError);
+}
+
+static void onStreamEvent(void* context, const char* event, char* data, size_t length) {
+  LeanStream& stream = *(LeanStream*)context;
+  if (strcmp(event, "put") == 0 || strcmp(event, "patch") == 0) {
+    RtdbEvent parsed;
+    if (parseRtdbEvent(data, length, parsed) && stream.handler) stream.handler(parsed);
+  } else if (strcmp(event, "cancel") == 0 || strcmp(event, "auth_revoked") == 0) {
+    stream.cancelled = true;
+  }
+  // keep-alive carries nothing; receiving it already refreshed lastByteAt.
+}
+
+// Strips chunked transfer framing on the fly and feeds the parser.
+static void feedStream(LeanStream& stream, const char* bytes, size_t length) {
+  if (!stream.chunked) {
+    stream.parser.feed(bytes, length);
+    return;
+  }
+  size_t i = 0;
+  while (i < length) {
+    if (stream.chunkState == CHUNK_DATA) {
+      size_t run = length - i < stream.chunkLeft ? length - i : stream.chunkLeft;
+      stream.parser.feed(bytes + i, run);
+      i += run;
+      stream.chunkLeft -= run;
+      if (!stream.chunkLeft) stream.chunkState = CHUNK_END;
+      continue;
+    }
+    char c = bytes[i++];
+    if (c == '\n') {
+      if (stream.chunkState == CHUNK_END) stream.chunkState = CHUNK_SIZE;
+      else stream.chunkState = stream.chunkLeft ? CHUNK_DATA : CHUNK_SIZE;
+    } else if (stream.chunkState == CHUNK_SIZE) {
+      if (isxdigit((unsigned char)c)) stream.chunkLeft = stream.chunkLeft * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+      else if (c == ';') stream.chunkState = CHUNK_EXTENSION;
+    }
+  }
+}
+
+// Opens the SSE request, following the redirect a namespaced database may send.
+static bool openStream(LeanStream& stream) {
+  char host[96];
+  char target[192];
+  strlcpy(host, rtdbHost, sizeof(host));
+  snprintf(target, sizeof(target), "/%s.json", stream.path);
+  for (int hop = 0; hop < 2; hop++) {
+    if (!connectTo(stream.client, host)) return false;
+    char head[320];
+    int n = snprintf(head, sizeof(head), "GET %s HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n", target, host);
+    stream.client.write((const uint8_t*)head, n);
+
+    ResponseHead response;
+    if (!readHead(stream.client, response)) break;
+    if ((response.status == 307 || response.status == 302) && strncmp(response.location, "https://", 8) == 0) {
+      const char* slash = strchr(response.location + 8, '/');
+      if (!slash) break;
+      size_t hostLength = slash - (response.location + 8);
+      if (hostLength >= sizeof(host)) break;
+      memcpy(host, response.location + 8, hostLength);
+      host[hostLength] = '\0';
+      strlcpy(target, slash, sizeof(target));
+      stream.client.stop();
+      continue;
+    }
+    if (response.status != 200) break;
+    stream.chunked = response.chunked;
+    stream.chunkState = CHUNK_SIZE;
+    stream.chunkLeft = 0;
+    stream.parser.reset();
+    stream.cancelled = false;
+    stream.lastByteAt = millis();
+    return true;
+  }
+  stream.client.stop();
+  return false;
+}
+
+static void closeStream(LeanStream& stream) {
+  stream.client.stop();
+  stream.open = false;
+  stream.active = false;
+}
+
+static void pollStream(LeanStream& stream) {
+  std::lock_guard<std::mutex> lock(stream.lock);
+  if (!stream.active) return;
+  if (!stream.open) {
+    stream.open = openStream(stream);
+    if (!stream.open) {
+      closeStream(stream);
+      if (stream.dropped) stream.dropped();
+    }
+    return;
+  }
+
+  uint8_t raw[512];
+  for (int reads = 0; reads < 8 && stream.client.available(); reads++) {
+    int n = stream.client.read(raw, sizeof(raw));
+    if (n <= 0) break;
+    stream.lastByteAt = millis();
+    feedStream(stream, (const char*)raw, n);
+  }
+  if (stream.cancelled || !stream.client.connected() || millis() - stream.lastByteAt > LEAN_STREAM_IDLE_MS) {
+    closeStream(stream);
+    if (stream.dropped) stream.dropped();
+  }
+}
+
+static void streamTask(void* parameter) {
+  for (;;) {
+    for (auto& stream : streams) pollStream(stream);
+    vTaskDelay(pdMS_TO_TICKS(LEAN_STREAM_POLL_MS));
+  }
+}
+
+bool cloudStream(CloudStream id, const String& path, CloudEventHandler handler, CloudDropHandler dropped) {
+  LeanStream& stream = streams[id];
+  std::lock_guard<std::mutex> lock(stream.lock);
+  if (stream.open) stream.client.stop();
+  strlcpy(stream.path, path.c_str(), sizeof(stream.path));
+  stream.handler = handler;
+  stream.dropped = dropped;
+  stream.open = false;
+  stream.active = true;
+  return true;
+}
+
+void cloudStopStreams() {
+  for (auto& stream : streams) {
+    std::lock_guard<std::mutex> lock(stream.lock);
+    closeStream(stream);
+  }
+}
+#endif
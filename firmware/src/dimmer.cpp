@@ -0,0 +1,88 @@
+#include "dimmer.h"
+
+DimmerFade::DimmerFade(uint8_t tolerance, uint32_t maxRampMs)
+  : tolerance(tolerance), maxRampMs(maxRampMs ? maxRampMs : 1) {}
+
+void DimmerFade::reset(uint8_t level) {
+  from = to = at = end = level < DIMMER_LEVELS ? level : DIMMER_LEVELS - 1;
+  durationMs = 0;
+  segmentMs = 0;
+  substep = 0;
+  substeps = 0;
+}
+
+void DimmerFade::start(uint8_t from, uint8_t to, uint32_t durationMs) {
+  this->from = from < DIMMER_LEVELS ? from : DIMMER_LEVELS - 1;
+  this->to = to < DIMMER_LEVELS ? to : DIMMER_LEVELS - 1;
+  this->durationMs = durationMs;
+  at = this->from;
+  end = this->from;
+  segmentMs = 0;
+  substep = 0;
+  substeps = 0;
+  // Nothing to ramp: a single write of the target duty.
+  if (durationMs == 0 || this->from == this->to) {
+    at = this->from;
+    end = this->to;
+    substeps = 1;
+  }
+}
+
+bool DimmerFade::next(uint16_t& duty, uint32_t& ms) {
+  if (substep == substeps) {
+    if (at == to) return false;
+    end = segmentEnd();
+    segmentMs = elapsedAt(end) - elapsedAt(at);
+    substeps = segmentMs ? (segmentMs + maxRampMs - 1) / maxRampMs : 1;
+    substep = 0;
+  }
+  substep++;
+  int32_t a = dimmerDuty(at);
+  int32_t b = dimmerDuty(end);
+  duty = (uint16_t)(a + (b - a) * (int32_t)substep / (int32_t)substeps);
+  // Cumulative rounding, so the ramps add up to the segment exactly.
+  ms = (uint32_t)((uint64_t)segmentMs * substep / substeps - (uint64_t)segmentMs * (substep - 1) / substeps);
+  if (substep == substeps) at = end;
+  rampCount++;
+  return true;
+}
+
+uint8_t DimmerFade::level() const {
+  if (substep >= substeps) return at;
+  int32_t span = (int32_t)end - (int32_t)at;
+  int32_t done = span * (int32_t)substep;
+  int32_t half = (int32_t)substeps / 2;
+  return (uint8_t)(at + (done >= 0 ? done + half : done - half) / (int32_t)substeps);
+}
+
+uint32_t DimmerFade::elapsedAt(uint8_t level) const {
+  uint32_t span = to > from ? to - from : from - to;
+  uint32_t done = level > from ? level - from : from - level;
+  return span ? (uint32_t)((uint64_t)durationMs * done / span) : 0;
+}
+
+// Furthest level toward `to` whose straight duty line from `at` stays within
+// tolerance of the curve at every level it passes. The curve is convex, so
+// the error only grows with the span and the search stops at the first miss.
+uint8_t DimmerFade::segmentEnd() const {
+  int step = to > at ? 1 : -1;
+  uint8_t best = (uint8_t)(at + step);
+  int32_t a = dimmerDuty(at);
+  for (int b = at + 2 * step; b != to + step; b += step) {
+    int32_t span = b - at;
+    int32_t rise = (int32_t)dimmerDuty((uint8_t)b) - a;
+    bool fits = true;
+    for (int p = at + step; p != b; p += step) {
+      int32_t line = a + rise * (p - at) / span;
+      int low = p - tolerance < 0 ? 0 : p - tolerance;
+      int high = p + tolerance > DIMMER_LEVELS - 1 ? DIMMER_LEVELS - 1 : p + tolerance;
+      if (line < dimmerDuty((uint8_t)low) || line > dimmerDuty((uint8_t)high)) {
+        fits = false;
+        break;
+      }
+    }
+    if (!fits) break;
+    best = (uint8_t)b;
+  }
+  return best;
+}
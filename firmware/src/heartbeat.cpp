@@ -0,0 +1,41 @@
+#include "heartbeat.h"
+
+Heartbeat::Heartbeat(uint32_t minMs, uint32_t maxMs, int8_t weakRssi)
+  : minMs(minMs), maxMs(maxMs), weakRssi(weakRssi), intervalMs(minMs), lastAt(0), lastStatusAt(0), unsettled(true),
+    standaloneBeats(0), piggybackedBeats(0) {}
+
+uint32_t Heartbeat::plan(int8_t rssi) {
+  if (unsettled || rssi < weakRssi) {
+    intervalMs = minMs;
+  } else if (lastAt == lastStatusAt) {
+    // Only a quiet period earns a longer interval: with state writes in
+    // between, the last interval was never actually waited out.
+    intervalMs = intervalMs > maxMs / 2 ? maxMs : intervalMs * 2;
+  }
+  unsettled = false;
+  return intervalMs;
+}
+
+void Heartbeat::sent(uint32_t now) {
+  lastAt = now;
+  lastStatusAt = now;
+  standaloneBeats++;
+}
+
+void Heartbeat::failed(uint32_t now) {
+  unsettled = true;
+  intervalMs = minMs;
+  lastAt = now;
+}
+
+void Heartbeat::piggybacked(uint32_t now) {
+  lastAt = now;
+  piggybackedBeats++;
+}
+
+// The next beat is owed right away, announcing the short interval.
+void Heartbeat::disrupted() {
+  unsettled = true;
+  intervalMs = minMs;
+  lastAt -= minMs;
+}
@@ -0,0 +1,46 @@
+#include "hmac.h"
+#include <mbedtls/md.h>
+
+bool hmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t out[kHmacLength]) {
+  const mbedtls_md_info_t* info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+  return info && mbedtls_md_hmac(info, key, keyLen, data, len, out) == 0;
+}
+
+bool equalsConstantTime(const uint8_t* a, const uint8_t* b, size_t len) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++) diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+HmacKey::HmacKey() : ready(false) {
+  mbedtls_md_init(&ctx);
+}
+
+HmacKey::~HmacKey() {
+  mbedtls_md_free(&ctx);
+}
+
+bool HmacKey::set(const uint8_t* key, size_t keyLen) {
+  clear();
+  const mbedtls_md_info_t* info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+  ready = info && mbedtls_md_setup(&ctx, info, 1) == 0 && mbedtls_md_hmac_starts(&ctx, key, keyLen) == 0;
+  return ready;
+}
+
+void HmacKey::clear() {
+  mbedtls_md_free(&ctx);
+  mbedtls_md_init(&ctx);
+  ready = false;
+}
+
+void HmacKey::begin() {
+  mbedtls_md_hmac_reset(&ctx);
+}
+
+void HmacKey::update(const void* data, size_t len) {
+  mbedtls_md_hmac_update(&ctx, static_cast<const unsigned char*>(data), len);
+}
+
+void HmacKey::finish(uint8_t out[kHmacLength]) {
+  mbedtls_md_hmac_finish(&ctx, out);
+}
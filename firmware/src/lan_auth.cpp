@@ -0,0 +1,185 @@
+#include "lan_auth.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char kOpenLabel[] = "aura-open";
+static const char kSessionLabel[] = "aura-session";
+static const char kReadyLabel[] = "aura-ready";
+
+const char* lanAuthReason(LanAuthResult result) {
+  switch (result) {
+    case LAN_AUTH_OK: return "ok";
+    case LAN_AUTH_NO_SESSION: return "no_session";
+    case LAN_AUTH_EXPIRED: return "expired";
+    case LAN_AUTH_REPLAYED: return "replayed";
+    case LAN_AUTH_BAD_MAC: return "bad_mac";
+  }
+  return "?";
+}
+
+bool ReplayWindow::fresh(uint64_t counter) const {
+  if (counter == 0) return false;
+  if (counter > highest) return true;
+  uint64_t age = highest - counter;
+  return age < 64 && !(seen & (1ULL << age));
+}
+
+void ReplayWindow::mark(uint64_t counter) {
+  if (counter > highest) {
+    uint64_t shift = counter - highest;
+    seen = shift < 64 ? (seen << shift) | 1 : 1;
+    highest = counter;
+  } else {
+    seen |= 1ULL << (highest - counter);
+  }
+}
+
+LanAuth::LanAuth(uint32_t idleMs, uint32_t lifetimeMs) : idleMs(idleMs), lifetimeMs(lifetimeMs), nextId(1) {
+  for (auto& session : sessions) session.live = false;
+  for (auto& challenge : challenges) challenge.live = false;
+}
+
+bool LanAuth::setKey(const uint8_t* key, size_t keyLen) {
+  for (auto& session : sessions) {
+    session.live = false;
+    session.key.clear();
+  }
+  for (auto& challenge : challenges) challenge.live = false;
+  if (!keyLen) {
+    deviceKey.clear();
+    return true;
+  }
+  return deviceKey.set(key, keyLen);
+}
+
+bool LanAuth::expired(const Session& session, uint32_t now) const {
+  return !session.live || now - session.usedAt > idleMs || now - session.openedAt > lifetimeMs;
+}
+
+void LanAuth::issue(const uint8_t challenge[kNonceLength], uint32_t now) {
+  Challenge* slot = &challenges[0];
+  for (auto& candidate : challenges) {
+    if (!candidate.live || now - candidate.issuedAt > kChallengeMs) { slot = &candidate; break; }
+    if (now - candidate.issuedAt > now - slot->issuedAt) slot = &candidate;
+  }
+  memcpy(slot->nonce, challenge, kNonceLength);
+  slot->issuedAt = now;
+  slot->live = true;
+}
+
+bool LanAuth::open(const uint8_t challenge[kNonceLength], const uint8_t clientNonce[kNonceLength],
+                   const uint8_t clientProof[kHmacLength], uint32_t now, uint32_t& id,
+                   uint8_t serverProof[kHmacLength]) {
+  if (!enabled()) return false;
+  Challenge* issued = nullptr;
+  for (auto& candidate : challenges) {
+    if (candidate.live && memcmp(candidate.nonce, challenge, kNonceLength) == 0) { issued = &candidate; break; }
+  }
+  if (!issued || now - issued->issuedAt > kChallengeMs) return false;
+  uint8_t expected[kHmacLength];
+  deviceKey.begin();
+  deviceKey.update(kOpenLabel, sizeof(kOpenLabel) - 1);
+  deviceKey.update(challenge, kNonceLength);
+  deviceKey.update(clientNonce, kNonceLength);
+  deviceKey.finish(expected);
+  if (!equalsConstantTime(expected, clientProof, kHmacLength)) return false;
+  // Only a genuine proof spends it, so forgeries cannot lock a client out.
+  issued->live = false;
+
+  // A dead slot if there is one, else the least recently used.
+  Session* slot = &sessions[0];
+  for (auto& session : sessions) {
+    if (expired(session, now)) { slot = &session; break; }
+    if (now - session.usedAt > now - slot->usedAt) slot = &session;
+  }
+
+  uint8_t sessionKey[kHmacLength];
+  deviceKey.begin();
+  deviceKey.update(kSessionLabel, sizeof(kSessionLabel) - 1);
+  deviceKey.update(clientNonce, kNonceLength);
+  deviceKey.update(challenge, kNonceLength);
+  deviceKey.finish(sessionKey);
+  if (!slot->key.set(sessionKey, sizeof(sessionKey))) return false;
+  memset(sessionKey, 0, sizeof(sessionKey));
+
+  slot->id = nextId;
+  nextId += 2;  // odd and never 0
+  slot->openedAt = now;
+  slot->usedAt = now;
+  slot->live = true;
+  slot->window.reset();
+
+  slot->key.begin();
+  slot->key.update(kReadyLabel, sizeof(kReadyLabel) - 1);
+  slot->key.finish(serverProof);
+  id = slot->id;
+  return true;
+}
+
+LanAuthResult LanAuth::verify(uint32_t id, uint64_t counter, const char* method, const char* target,
+                              const char* body, size_t bodyLen, const uint8_t mac[kHmacLength], uint32_t now) {
+  Session* session = nullptr;
+  for (auto& candidate : sessions) {
+    if (candidate.live && candidate.id == id) { session = &candidate; break; }
+  }
+  if (!session) return LAN_AUTH_NO_SESSION;
+  if (expired(*session, now)) {
+    session->live = false;
+    return LAN_AUTH_EXPIRED;
+  }
+  if (!session->window.fresh(counter)) return LAN_AUTH_REPLAYED;
+
+  char number[24];
+  int numberLen = snprintf(number, sizeof(number), "%llu", (unsigned long long)counter);
+  uint8_t expected[kHmacLength];
+  session->key.begin();
+  session->key.update(method, strlen(method));
+  session->key.update("\n", 1);
+  session->key.update(target, strlen(target));
+  session->key.update("\n", 1);
+  session->key.update(number, numberLen);
+  session->key.update("\n", 1);
+  session->key.update(body, bodyLen);
+  session->key.finish(expected);
+  if (!equalsConstantTime(expected, mac, kHmacLength)) return LAN_AUTH_BAD_MAC;
+
+  // Only a genuine request moves the window, so forgeries cannot burn counters.
+  session->window.mark(counter);
+  session->usedAt = now;
+  return LAN_AUTH_OK;
+}
+
+size_t LanAuth::liveSessions(uint32_t now) const {
+  size_t count = 0;
+  for (const auto& session : sessions) {
+    if (!expired(session, now)) count++;
+  }
+  return count;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool decodeHex(const char* text, uint8_t* out, size_t len) {
+  if (!text || strlen(text) != 2 * len) return false;
+  for (size_t i = 0; i < len; i++) {
+    int high = hexValue(text[2 * i]);
+    int low = hexValue(text[2 * i + 1]);
+    if (high < 0 || low < 0) return false;
+    out[i] = (uint8_t)(high << 4 | low);
+  }
+  return true;
+}
+
+void encodeHex(const uint8_t* data, size_t len, char* out) {
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < len; i++) {
+    out[2 * i] = digits[data[i] >> 4];
+    out[2 * i + 1] = digits[data[i] & 15];
+  }
+  out[2 * len] = '\0';
+}
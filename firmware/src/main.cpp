@@ -2,180 +2,1442 @@
 #include <ArduinoJson.h>
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
-#include <Firebase_ESP_Client.h>
+#include <ESPmDNS.h>
+#include <AsyncUDP.h>
+#include <esp_timer.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
+#include <time.h>
 #include <Preferences.h>
-#include "firebase_config.h"
+#include <memory>
+#include <mutex>
+#include "cloud.h"
+#include "backoff.h"
+#include "peer_cache.h"
+#include "body_buffer.h"
+#include "state_snapshot.h"
+#include "output_hw.h"
+#include "config_diff.h"
+#include "trace.h"
+#include "admission.h"
+#include "scene_link.h"
+#include "command_table.h"
+#include "heartbeat.h"
+#include "lan_auth.h"
+#ifdef AURA_FIXED_PROFILE
+#include "fixed_profile.h"
+#endif
 
 #define FW_VERSION "2.0"
 #define ONBOARD_LED 2
+#define PEER_SCAN_INTERVAL_MS 300000
+#define PEER_TTL_MS 900000
+#define FAST_CONNECT_TIMEOUT_MS 3000
+#define OUTPUT_TICK_MS 10
+#define ADMISSION_DWELL_MS 250
+#define ADMISSION_BURST 10
+#define ADMISSION_RATE_PER_SEC 5
+#define ADMISSION_SCENE_BURST 32
+#define ADMISSION_SCENE_RATE_PER_SEC 8
+#define SCENE_PORT 4210
+#define SCENE_BEACON_INTERVAL_MS 2000
+#define SCENE_DEFAULT_DELAY_MS 500
+#define SCENE_MAX_DELAY_MS 5000
+#define SCENE_MAX_SCHEDULED 4
+#define HEARTBEAT_MIN_MS 30000
+#define HEARTBEAT_MAX_MS 240000
+#define HEARTBEAT_WEAK_RSSI -80
+#define LAN_SESSION_IDLE_MS 600000
+#define LAN_SESSION_LIFETIME_MS 3600000
+#define DIMMER_TYPE "Dimmer"
+#define DIMMER_PWM_HZ 5000
+#define DIMMER_DEFAULT_FADE_MS 400
 
 // --- Global Objects & Data Structures ---
-FirebaseData fbdo;
-FirebaseData command_stream;
-FirebaseData appliance_stream;
-FirebaseAuth auth;
-FirebaseConfig config;
 bool firebaseReady = false;
 AsyncWebServer server(80);
 Preferences preferences;
-struct Appliance { String name; uint8_t pin; bool state; };
+// level is a dimmer's brightness while ON, in percent (see dimmer.h).
+struct Appliance { String name; uint8_t pin; String type; bool state; uint64_t version; uint32_t pendingSeq; uint8_t level; };
 std::vector<Appliance> appliances;
+// Only loop() adds or removes appliances (config reload); the stream task and
+// the web server hold this while they read or flip an entry.
+std::mutex appliancesLock;
+unsigned long appliancesReadyUs = 0;
+
+#ifdef AURA_FIXED_PROFILE
+// True while appliances[] is the compiled-in table, in table order, so pins
+// resolve through kFixedIndex. A reload_config command from the app overrides the
+// table; the override is remembered per profile hash across reboots.
+bool fixedLayout = false;
+#endif
+String deviceId;
+StateSnapshot stateSnapshot;
+
+// --- Outputs ---
+GpioOutput gpioOutput;
+WireBus wireBus(Wire);
+SpiShiftBus* shiftBus = nullptr;
+OutputDriver* expander = nullptr;
+LedcDimmer dimmers(DIMMER_PWM_HZ);
+// Every relay switch goes through here first; overridden by the config's
+// "admission" map. Guarded by appliancesLock.
+Admission admission(ADMISSION_DWELL_MS, ADMISSION_BURST, ADMISSION_RATE_PER_SEC, ADMISSION_SCENE_BURST,
+                    ADMISSION_SCENE_RATE_PER_SEC);
+
+// A state change as it arrives from the cloud. Writes made by this controller
+// are tagged with origin = deviceId and a local sequence number so their echo
+// can be recognised without touching the relay. Dimmers may also carry a
+// level and a fade time: {state, level, fade_ms} fades in one write.
+struct StateChange { int pin; bool state; uint64_t version; bool self; uint32_t seq; int16_t level; uint32_t fadeMs; };
+uint32_t localSeq = 0;
+
+// --- Stream Resync State ---
+// Every state write carries a server-timestamp "version", so after a stream
+// drop what changed since lastSeenVersion is fetched and replayed in one read
+// before the appliance stream is reopened. resyncReplayPending stays set from
+// the first reopen attempt until a reopened stream's snapshot is replayed.
+uint64_t lastSeenVersion = 0;
+volatile bool streamDropped = false;
+bool resyncPending = false;
+volatile bool resyncReplayPending = false;
+size_t resyncApplied = 0;
+unsigned long streamDroppedAt = 0;
+unsigned long nextResyncAt = 0;
+Backoff resyncBackoff(500, 30000);
+
+// --- Local Discovery State ---
+PeerCache peers(PEER_TTL_MS);
+std::mutex peersLock;
+TaskHandle_t peerScanTask = nullptr;
+volatile bool ipChanged = false;
+
+// --- Liveness Heartbeat ---
+// devices/<mac>/hb = {at, next_ms, up_s, rssi, heap, event}. The app takes the
+// later of hb/at and this controller's own appliance versions as last seen,
+// and calls it offline once next_ms has passed since. Guarded by heartbeatLock.
+Heartbeat heartbeat(HEARTBEAT_MIN_MS, HEARTBEAT_MAX_MS, HEARTBEAT_WEAK_RSSI);
+std::mutex heartbeatLock;
+
+// --- Command Channel ---
+// Commands are pushed as devices/<mac>/command/<id> =
+// {type, v, args, sent}, queued by the stream task and run from loop(); each
+// one is answered at devices/<mac>/command_results/<id>. A plain "REBOOT" or
+// "RELOAD_CONFIG" string at devices/<mac>/command still works for older apps.
+// A handler returns nullptr on success or a short error code.
+typedef const char* (*CommandHandler)(JsonVariant args, JsonObject result);
+CommandTable<CommandHandler> commands;
+struct PendingCommand { String id; String payload; int64_t receivedUs; };
+std::mutex commandLock;
+std::vector<PendingCommand> pendingCommands;
+String recentCommandIds[8];
+size_t nextRecentCommand = 0;
+bool rebootRequested = false;
+
+// --- LAN Scenes ---
+// Scenes arrive as one signed multicast packet and run at a shared network
+// time. sceneLock covers the key, clock, guard and schedule, which the UDP
+// task, the scene timer and loop() all touch; it is taken before
+// appliancesLock, never after.
+AsyncUDP sceneUdp;
+const IPAddress sceneGroup(239, 255, 42, 42);
+uint8_t selfMac[6];
+SceneClock* sceneClock = nullptr;
+SceneGuard sceneGuard;
+// Persisted and bumped every boot; sceneSeq numbers every packet sent in it.
+uint32_t sceneBootId = 0;
+uint32_t sceneSeq = 0;
+uint8_t sceneKey[64];
+size_t sceneKeyLen = 0;
+std::mutex sceneLock;
+std::vector<ScenePacket> scheduledScenes;
+esp_timer_handle_t sceneTimer = nullptr;
+unsigned long nextBeaconAt = 0;
+// Relays switched by a scene, reported to the cloud from loop().
+struct SceneReport { uint8_t pin; bool state; uint32_t seq; };
+std::vector<SceneReport> sceneReports;
+
+// --- Local API Auth ---
+// With a "lan_key" in the config, /toggle, /scene and /reconfigure-wifi need
+// a signed request (see lan_auth.h); a session is opened with GET /session
+// for a challenge, then POST /session with the proof.
+// The key is kept in flash so a controller cut off from the cloud does not
+// fall back to an open API. Read-only endpoints stay open.
+LanAuth lanAuth(LAN_SESSION_IDLE_MS, LAN_SESSION_LIFETIME_MS);
+String lanKey;
+std::mutex lanAuthLock;
+
+// --- Wi-Fi Connect Timing ---
+// The fast path reuses the last lease as a static address. It is only used
+// while that lease is in its first half, and at the half-way point (when the
+// DHCP client would renew) the interface goes back to DHCP.
+bool wifiFastPath = false;
+unsigned long leaseRenewAt = 0;
+bool leaseSavePending = false;
+unsigned long wifiBeginAt = 0;
+volatile unsigned long wifiAssocMs = 0;
+volatile unsigned long wifiIpMs = 0;
 
 // --- Function Declarations ---
-void applianceStreamCallback(FirebaseStream data);
-void commandStreamCallback(FirebaseStream data);
-void streamTimeoutCallback(bool timeout);
-void loadConfigurationFromFirestore();
+void applianceStreamCallback(const RtdbEvent& event);
+void commandStreamCallback(const RtdbEvent& event);
+void streamDroppedCallback();
+bool loadConfigurationFromFirestore(std::vector<ConfigChange>& changes, bool layout = true);
+void applyConfiguration(std::vector<Appliance>& wanted, const std::vector<ConfigChange>& changes);
+int reloadConfiguration();
+uint32_t driveLocally(Appliance& appliance, bool state, AdmissionBudget budget = ADMIT_COMMAND);
+void registerCommands();
+void queueCommand(const String& id, const String& payload);
+void runPendingCommands();
+void runCommand(const PendingCommand& command);
+const char* commandReboot(JsonVariant args, JsonObject result);
+const char* commandReloadConfig(JsonVariant args, JsonObject result);
+const char* commandSetStates(JsonVariant args, JsonObject result);
+const char* commandDiagnostics(JsonVariant args, JsonObject result);
+Appliance* findAppliance(int pin);
+void markAppliancesReady(const char* source);
+#ifdef AURA_FIXED_PROFILE
+void loadFixedProfile();
+bool fixedProfileOverridden();
+#endif
+int firestoreInt(JsonVariant field, int fallback);
+void setupExpander(JsonVariant fields);
+void startExpander(const String& type, uint8_t address, uint8_t count, uint8_t latch, bool invert);
+void configureOutput(uint8_t pin, const String& type);
+void writeOutput(uint8_t pin, bool on);
+void actuate(const Appliance& appliance, uint32_t fadeMs, AdmissionBudget budget = ADMIT_COMMAND);
+void outputFlushTask(void* parameter);
+void releaseAdmitted();
+bool applyApplianceState(const StateChange& change);
+StateChange parseStateChange(int pin, JsonVariant value);
+void publishLocalState(uint8_t pin, bool state, uint32_t seq);
+void fillHeartbeat(JsonObject hb);
+void sendHeartbeat();
+size_t applyStateDelta(const char* json, size_t length);
+bool startStreams();
+void beginResync();
+void tryResync();
 void setupFirebase();
+void startDiscovery();
+void updateServiceTxt();
+void scanPeers();
+void peerScanLoop(void* parameter);
+void startScenes();
+void setSceneKey(const String& key);
+void onScenePacket(const uint8_t* data, size_t len);
+void rebaseScenes(int64_t deltaUs);
+void scheduleScene(ScenePacket& scene);
+void armSceneTimer();
+void sceneTimerCallback(void* arg);
+void runScene(const ScenePacket& scene, int64_t lateUs);
+const char* broadcastScene(ScenePacket& scene, uint32_t delayMs);
+void sendBeacon();
+void publishSceneReports();
+bool parseMac(const char* text, uint8_t mac[6]);
+size_t serializeState(char* buffer, size_t capacity);
+void setLanKey(const String& key, bool persist);
+bool authorize(AsyncWebServerRequest* request, const char* body, size_t length);
+void onJsonPost(const char* uri, size_t limit, std::function<void(AsyncWebServerRequest*, JsonDocument&)> handler,
+                bool open = false);
 void startWebServer();
+bool waitForWiFi(int retries);
+void saveFastConnect();
+uint32_t dhcpLeaseSeconds();
+void clearFastConnect();
 void setupWiFi();
 
 // --- Core Functions ---
-void loadConfigurationFromFirestore() {
-  if (!firebaseReady) return;
+// Fetches the device config and brings the running appliance list in line with
+// it; |changes| lists what differed. Without |layout| only the settings are
+// applied (keys, admission limits) and the wiring is left as it is, for the
+// fixed profile. False when the document could not be read.
+bool loadConfigurationFromFirestore(std::vector<ConfigChange>& changes, bool layout) {
+  if (!firebaseReady) return false;
   String documentPath = "device_configs/" + WiFi.macAddress();
   Serial.println("  [->] Fetching config from Firestore: " + documentPath);
 
-  if (Firebase.Firestore.getDocument(&fbdo, FIREBASE_PROJECT_ID, "", documentPath.c_str(), "")) {
-    JsonDocument doc;
-    deserializeJson(doc, fbdo.payload().c_str());
-    if (doc.containsKey("fields") && doc["fields"].containsKey("appliances")) {
-      JsonArray array = doc["fields"]["appliances"]["arrayValue"]["values"];
-      appliances.clear();
-      Serial.println("  [+] Found " + String(array.size()) + " appliances.");
-      for (JsonObject obj : array) {
-        Appliance appliance;
-        appliance.name = obj["mapValue"]["fields"]["name"]["stringValue"].as<String>();
-        appliance.pin = obj["mapValue"]["fields"]["pin"]["integerValue"].as<int>();
-        appliance.state = false;
-        appliances.push_back(appliance);
-        pinMode(appliance.pin, OUTPUT);
-        digitalWrite(appliance.pin, LOW);
+  // Only the fields read below; the app keeps others (roomId, ...) there too.
+  String payload;
+  const char* mask = layout ? "appliances,expander,scene_key,lan_key,admission" : "scene_key,lan_key,admission";
+  if (!cloudGetDocument(documentPath, payload, mask)) {
+    Serial.println("  [-] Firestore Get Failed: " + cloudError());
+    return false;
+  }
+  JsonDocument doc;
+  deserializeJson(doc, payload);
+  if (layout && doc.containsKey("fields") && doc["fields"].containsKey("expander")) {
+    setupExpander(doc["fields"]["expander"]["mapValue"]["fields"]);
+  }
+
+  if (doc.containsKey("fields") && doc["fields"].containsKey("scene_key")) {
+    setSceneKey(doc["fields"]["scene_key"]["stringValue"].as<String>());
+  }
+  if (doc.containsKey("fields") && doc["fields"].containsKey("lan_key")) {
+    setLanKey(doc["fields"]["lan_key"]["stringValue"].as<String>(), true);
+  }
+  if (doc.containsKey("fields") && doc["fields"].containsKey("admission")) {
+    JsonVariant limits = doc["fields"]["admission"]["mapValue"]["fields"];
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    admission.configure(firestoreInt(limits["dwell_ms"], ADMISSION_DWELL_MS),
+                        firestoreInt(limits["burst"], ADMISSION_BURST),
+                        firestoreInt(limits["rate_per_sec"], ADMISSION_RATE_PER_SEC));
+    admission.configureScenes(firestoreInt(limits["scene_burst"], ADMISSION_SCENE_BURST),
+                              firestoreInt(limits["scene_rate_per_sec"], ADMISSION_SCENE_RATE_PER_SEC));
+  }
+  if (!layout) return true;
+
+  std::vector<Appliance> wanted;
+  if (doc.containsKey("fields") && doc["fields"].containsKey("appliances")) {
+    JsonArray array = doc["fields"]["appliances"]["arrayValue"]["values"];
+    bool seen[256] = {};
+    Serial.println("  [+] Found " + String(array.size()) + " appliances.");
+    for (JsonObject obj : array) {
+      Appliance appliance;
+      appliance.name = obj["mapValue"]["fields"]["name"]["stringValue"].as<String>();
+      appliance.pin = obj["mapValue"]["fields"]["pin"]["integerValue"].as<int>();
+      appliance.type = obj["mapValue"]["fields"]["type"]["stringValue"].as<String>();
+      appliance.state = false;
+      appliance.version = 0;
+      appliance.pendingSeq = 0;
+      appliance.level = 100;
+      if (seen[appliance.pin]) {
+        Serial.printf("  [-] Pin %u listed twice, keeping the first.\n", appliance.pin);
+        continue;
       }
+      seen[appliance.pin] = true;
+      wanted.push_back(appliance);
     }
+  }
+  diffConfig(appliances, wanted, changes);
+  applyConfiguration(wanted, changes);
+  return true;
+}
+
+// Only pins whose entry changed are touched: new ones start OFF, removed ones
+// are switched off, and everything else carries its state over untouched.
+void applyConfiguration(std::vector<Appliance>& wanted, const std::vector<ConfigChange>& changes) {
+  std::lock_guard<std::mutex> lock(appliancesLock);
+#ifdef AURA_FIXED_PROFILE
+  fixedLayout = false;
+#endif
+  for (const auto& change : changes) {
+    if (change.edits & CONFIG_REMOVED) {
+      dimmers.release(change.pin);
+      writeOutput(change.pin, false);
+      admission.reset(change.pin, false);
+      continue;
+    }
+    Appliance& next = wanted[change.to];
+    if (change.edits & CONFIG_ADDED) {
+      configureOutput(next.pin, next.type);
+      if (!dimmers.owns(next.pin)) writeOutput(next.pin, false);
+      admission.reset(next.pin, false);
+      continue;
+    }
+    const Appliance& current = appliances[change.from];
+    next.state = current.state;
+    next.version = current.version;
+    next.pendingSeq = current.pendingSeq;
+    next.level = current.level;
+    if (change.edits & CONFIG_RETYPED) {
+      configureOutput(next.pin, next.type);
+      if (dimmers.owns(next.pin)) dimmers.fade(next.pin, next.state ? next.level : 0, 0);
+      else writeOutput(next.pin, next.state);
+      admission.reset(next.pin, next.state);
+    }
+  }
+  appliances.swap(wanted);
+  stateSnapshot.markDirty();
+}
+
+// Applies an edited config without a reboot, then mirrors the added, removed
+// and renamed entries into the RTDB appliance list the app reads. Returns the
+// number of entries that changed, or -1 if the config could not be fetched.
+int reloadConfiguration() {
+  Serial.println("\n--- [ CONFIG RELOAD ] ---");
+  unsigned long startedAt = millis();
+  std::vector<ConfigChange> changes;
+  if (!loadConfigurationFromFirestore(changes)) return -1;
+#ifdef AURA_FIXED_PROFILE
+  preferences.begin("profile", false);
+  preferences.putUInt("override", kFixedProfileHash);
+  preferences.end();
+#endif
+
+  String appliancesPath = "devices/" + deviceId + "/appliances";
+  // Keys are "<pin>/<field>" so a rename leaves the entry's state alone.
+  JsonDocument update;
+  bool pending = false;
+  size_t edited = 0;
+  for (const auto& change : changes) {
+    if (change.edits == CONFIG_KEPT) continue;
+    edited++;
+    String key = String(change.pin);
+    if (change.edits & CONFIG_REMOVED) {
+      cloudDelete(appliancesPath + "/" + key);
+      continue;
+    }
+    update[key + "/name"] = appliances[change.to].name;
+    if (change.edits & (CONFIG_ADDED | CONFIG_RETYPED)) update[key + "/type"] = appliances[change.to].type;
+    if (change.edits & CONFIG_ADDED) {
+      update[key + "/state"] = "OFF";
+      update[key + "/version"][".sv"] = "timestamp";
+      update[key + "/origin"] = deviceId;
+    }
+    pending = true;
+  }
+  String body;
+  serializeJson(update, body);
+  if (pending && !cloudUpdate(appliancesPath, body)) {
+    Serial.println("  [-] RTDB Update Failed: " + cloudError());
+  }
+  updateServiceTxt();
+  Serial.printf("  [+] Applied %u change(s) in %lu ms, %u appliances running.\n",
+                (unsigned)edited, millis() - startedAt, (unsigned)appliances.size());
+  return (int)edited;
+}
+
+// Switches an appliance on behalf of a local source (LAN, scene, command) and
+// returns the sequence number its cloud report must carry. Callers hold
+// appliancesLock and publish the report once they have released it.
+uint32_t driveLocally(Appliance& appliance, bool state, AdmissionBudget budget) {
+  appliance.state = state;
+  appliance.pendingSeq = ++localSeq;
+  actuate(appliance, DIMMER_DEFAULT_FADE_MS, budget);
+  stateSnapshot.markDirty();
+  return appliance.pendingSeq;
+}
+
+// Callers hold appliancesLock.
+Appliance* findAppliance(int pin) {
+#ifdef AURA_FIXED_PROFILE
+  if (fixedLayout) {
+    int index = (pin >= 0 && pin < 256) ? kFixedIndex[pin] : -1;
+    return index < 0 ? nullptr : &appliances[index];
+  }
+#endif
+  for (auto& appliance : appliances) {
+    if (appliance.pin == pin) return &appliance;
+  }
+  return nullptr;
+}
+
+void markAppliancesReady(const char* source) {
+  appliancesReadyUs = micros();
+  Serial.printf("  [+] %u appliances ready %lu us after boot (%s), free heap %u.\n",
+                (unsigned)appliances.size(), appliancesReadyUs, source, (unsigned)ESP.getFreeHeap());
+}
+
+#ifdef AURA_FIXED_PROFILE
+// Brings up the compiled-in wiring before Wi-Fi: one register write for every
+// GPIO relay and no Firestore fetch, so relays are usable offline from boot.
+void loadFixedProfile() {
+  if (kFixedExpander.type) {
+    startExpander(kFixedExpander.type, kFixedExpander.address, kFixedExpander.count,
+                  kFixedExpander.latch, kFixedExpander.invert);
+  }
+  gpioOutput.configureMask(kFixedGpioMask);
+  appliances.reserve(kFixedCount);
+  for (const auto& fixed : kFixedAppliances) {
+    appliances.push_back({ fixed.name, fixed.pin, fixed.type, false, 0, 0, 100 });
+    if (fixed.pin >= EXPANDER_CHANNEL_BASE || strcmp(fixed.type, DIMMER_TYPE) == 0) {
+      configureOutput(fixed.pin, fixed.type);
+      if (!dimmers.owns(fixed.pin)) writeOutput(fixed.pin, false);
+    }
+  }
+  fixedLayout = true;
+  stateSnapshot.markDirty();
+  markAppliancesReady("fixed profile");
+}
+
+bool fixedProfileOverridden() {
+  preferences.begin("profile", true);
+  bool overridden = preferences.getUInt("override", 0) == kFixedProfileHash;
+  preferences.end();
+  return overridden;
+}
+#endif
+
+// Firestore's REST encoding carries integers as strings in "integerValue".
+int firestoreInt(JsonVariant field, int fallback) {
+  return field.containsKey("integerValue") ? field["integerValue"].as<int>() : fallback;
+}
+
+// Builds the expander chain described by the config's "expander" map:
+// { type: "mcp23017" | "pcf8574" | "74hc595", address, count, latch, invert }.
+// The bus layout is fixed for the life of the firmware, so this runs once.
+void setupExpander(JsonVariant fields) {
+  startExpander(fields["type"]["stringValue"].as<String>(),
+                firestoreInt(fields["address"], 0x20),
+                firestoreInt(fields["count"], 1),
+                firestoreInt(fields["latch"], 5),
+                fields["invert"]["booleanValue"] | false);
+}
+
+void startExpander(const String& type, uint8_t address, uint8_t count, uint8_t latch, bool invert) {
+  if (expander) return;
+  if (type == "mcp23017") {
+    Wire.begin();
+    expander = new Mcp23017Output(wireBus, address, count, invert);
+  } else if (type == "pcf8574") {
+    Wire.begin();
+    expander = new Pcf8574Output(wireBus, address, count, invert);
+  } else if (type == "74hc595") {
+    shiftBus = new SpiShiftBus(SPI, latch);
+    shiftBus->begin();
+    expander = new Shift595Output(*shiftBus, count, invert);
   } else {
-    Serial.println("  [-] Firestore Get Failed: " + fbdo.errorReason());
+    Serial.println("  [-] Unknown expander type: " + type);
+    return;
   }
+  if (!expander->begin()) {
+    Serial.println("  [-] Expander " + type + " not responding.");
+  }
+  Serial.printf("  [+] Expander %s: %u channels from %d.\n", type.c_str(), expander->channels(), EXPANDER_CHANNEL_BASE);
+  xTaskCreate(outputFlushTask, "outputFlush", 2048, nullptr, 2, nullptr);
 }
 
-void applianceStreamCallback(FirebaseStream data) {
-    digitalWrite(ONBOARD_LED, HIGH);
-    String pinStr = data.dataPath().substring(1, data.dataPath().lastIndexOf('/'));
-    int pin = pinStr.toInt();
-    bool newState = (data.stringData() == "ON");
-    for (auto& appliance : appliances) {
-        if (appliance.pin == pin) {
-            appliance.state = newState;
-            digitalWrite(appliance.pin, newState);
-            Serial.printf("  [->] Remote Toggled GPIO %d to %s\n", pin, newState ? "ON" : "OFF");
-            break;
+// Dimmers take an LEDC channel; everything else, or a dimmer that cannot get
+// one, is switched as a relay.
+void configureOutput(uint8_t pin, const String& type) {
+  if (type == DIMMER_TYPE) {
+    if (dimmers.attach(pin)) return;
+    Serial.printf("  [-] Pin %u cannot dim (expander channel or all %u LEDC channels taken), switching it on/off.\n",
+                  pin, LedcDimmer::kChannels);
+  }
+  dimmers.release(pin);
+  if (pin < EXPANDER_CHANNEL_BASE) gpioOutput.configure(pin);
+  else if (expander) expander->configure(pin - EXPANDER_CHANNEL_BASE);
+}
+
+void writeOutput(uint8_t pin, bool on) {
+  if (pin < EXPANDER_CHANNEL_BASE) gpioOutput.write(pin, on);
+  else if (expander) expander->write(pin - EXPANDER_CHANNEL_BASE, on);
+}
+
+// Brings an appliance's output in line with its state. Dimmers fade to their
+// level in hardware and skip admission, which guards relay contacts; relays
+// switch once admission lets them. Callers hold appliancesLock.
+void actuate(const Appliance& appliance, uint32_t fadeMs, AdmissionBudget budget) {
+  if (dimmers.owns(appliance.pin)) dimmers.fade(appliance.pin, appliance.state ? appliance.level : 0, fadeMs);
+  else if (admission.admit(appliance.pin, appliance.state, millis(), budget)) writeOutput(appliance.pin, appliance.state);
+}
+
+// Expander writes are staged in shadow registers; this tick pushes whatever
+// changed since the last one in a single bus transaction per chip.
+void outputFlushTask(void* parameter) {
+  for (;;) {
+    expander->flush();
+    vTaskDelay(pdMS_TO_TICKS(OUTPUT_TICK_MS));
+  }
+}
+
+// Drives relays whose commands admission held back, once their dwell time
+// has passed and the rate limit allows. Runs every loop() pass.
+void releaseAdmitted() {
+  std::lock_guard<std::mutex> lock(appliancesLock);
+  if (!admission.pendingCount()) return;
+  uint8_t pin;
+  bool level;
+  while (admission.release(millis(), pin, level)) writeOutput(pin, level);
+}
+
+StateChange parseStateChange(int pin, JsonVariant value) {
+  StateChange change;
+  change.pin = pin;
+  change.state = (value["state"] == "ON");
+  change.version = value["version"] | (uint64_t)0;
+  change.self = (value["origin"] == deviceId.c_str());
+  change.seq = value["seq"] | (uint32_t)0;
+  change.level = value["level"].is<int>() ? (int16_t)std::max(0, std::min(value["level"].as<int>(), 100)) : -1;
+  change.fadeMs = value["fade_ms"] | (uint32_t)DIMMER_DEFAULT_FADE_MS;
+  return change;
+}
+
+// Last writer wins, where "last" is the server-assigned version:
+// - anything older than what the relay has seen is stale;
+// - our own echoes only advance the version, the relay was driven locally;
+// - while one of our writes is in flight, other writes that reach us were
+//   committed before it (the stream is ordered), so ours wins.
+// Writes from older app builds carry no version (0) and are only ordered
+// against in-flight local writes.
+// Returns true only when the relay actually changed.
+bool applyApplianceState(const StateChange& change) {
+  std::lock_guard<std::mutex> lock(appliancesLock);
+  Appliance* appliance;
+  {
+    TraceScope span("lookup", change.pin);
+    appliance = findAppliance(change.pin);
+  }
+  if (!appliance) return false;
+  if (change.version && change.version < appliance->version) return false;
+  if (change.version) {
+    appliance->version = change.version;
+    stateSnapshot.markDirty();
+  }
+  if (change.version > lastSeenVersion) lastSeenVersion = change.version;
+  if (change.self) {
+    if (change.seq == appliance->pendingSeq) appliance->pendingSeq = 0;
+    return false;
+  }
+  // A level only means something to a dimmer; on a relay it is not a change.
+  bool relevel = change.level >= 0 && dimmers.owns(appliance->pin) && change.level != appliance->level;
+  if (appliance->pendingSeq || (appliance->state == change.state && !relevel)) return false;
+  TraceScope span("actuate", change.pin);
+  appliance->state = change.state;
+  if (relevel) appliance->level = (uint8_t)change.level;
+  actuate(*appliance, change.fadeMs);
+  stateSnapshot.markDirty();
+  return true;
+}
+
+// Reports a locally made change (LAN toggle) to the cloud, tagged so that its
+// echo on the appliance stream is dropped cheaply. The caller has already set
+// the appliance's pendingSeq to |seq|.
+void publishLocalState(uint8_t pin, bool state, uint32_t seq) {
+  TraceScope span("cloud.report", pin);
+  char body[128];
+  snprintf(body, sizeof(body), "{\"state\":\"%s\",\"version\":{\".sv\":\"timestamp\"},\"origin\":\"%s\",\"seq\":%u}",
+           state ? "ON" : "OFF", deviceId.c_str(), (unsigned)seq);
+  if (!cloudUpdate("devices/" + deviceId + "/appliances/" + String(pin), body)) {
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    Appliance* appliance = findAppliance(pin);
+    if (appliance && appliance->pendingSeq == seq) appliance->pendingSeq = 0;
+    return;
+  }
+  // The write's server-stamped version tells the app this controller is alive.
+  std::lock_guard<std::mutex> lock(heartbeatLock);
+  heartbeat.piggybacked(millis());
+}
+
+void fillHeartbeat(JsonObject hb) {
+  int8_t rssi = WiFi.RSSI();
+  uint32_t next;
+  {
+    std::lock_guard<std::mutex> lock(heartbeatLock);
+    next = heartbeat.plan(rssi);
+  }
+  hb["at"][".sv"] = "timestamp";
+  hb["next_ms"] = next;
+  hb["up_s"] = millis() / 1000;
+  hb["rssi"] = rssi;
+  hb["heap"] = ESP.getFreeHeap();
+  hb["event"] = lastSeenVersion;
+}
+
+// One small write per interval: the whole status, replacing the last one.
+void sendHeartbeat() {
+  JsonDocument beat;
+  fillHeartbeat(beat.to<JsonObject>());
+  String body;
+  serializeJson(beat, body);
+  bool ok = cloudSet("devices/" + deviceId + "/hb", body);
+  std::lock_guard<std::mutex> lock(heartbeatLock);
+  if (ok) heartbeat.sent(millis());
+  else heartbeat.failed(millis());
+}
+
+// Replays a {"<pin>": {"state", "version"}} map in version order. Used for the
+// snapshot a stream sends when opened: after a reconnect, the missed delta.
+size_t applyStateDelta(const char* json, size_t length) {
+  JsonDocument doc;
+  if (deserializeJson(doc, json, length)) return 0;
+  // A replay reflects committed server state: nothing is in flight any more.
+  {
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    for (auto& appliance : appliances) appliance.pendingSeq = 0;
+  }
+  std::vector<StateChange> changes;
+  for (JsonPair entry : doc.as<JsonObject>()) {
+    StateChange change = parseStateChange(atoi(entry.key().c_str()), entry.value());
+    if (change.version == 0) continue;
+    changes.push_back(change);
+  }
+  std::sort(changes.begin(), changes.end(), [](const StateChange& a, const StateChange& b) { return a.version < b.version; });
+  size_t applied = 0;
+  for (const auto& change : changes) {
+    if (applyApplianceState(change)) applied++;
+  }
+  return applied;
+}
+
+void applianceStreamCallback(const RtdbEvent& event) {
+    TraceScope receive("stream.receive");
+    if (strcmp(event.path, "/") == 0) {
+        size_t applied = event.type == RTDB_JSON ? applyStateDelta(event.data, event.length) : 0;
+        if (resyncReplayPending) {
+            resyncReplayPending = false;
+            Serial.printf("  [+] Resynced %u change(s) in %lu ms (%u attempts).\n",
+                          (unsigned)(resyncApplied + applied), millis() - streamDroppedAt, resyncBackoff.attempts());
+            // The outage is over only now. loop() leaves the backoff alone
+            // until this stream task reports the next drop.
+            resyncBackoff.reset();
         }
+        return;
     }
+
+    // "/<pin>/state" from a plain string write, "/<pin>" from a versioned update.
+    char* rest;
+    int pin = (int)strtol(event.path + 1, &rest, 10);
+    receive.setPin(pin);
+    StateChange change = { pin, false, 0, false, 0, -1, DIMMER_DEFAULT_FADE_MS };
+    {
+        TraceScope span("parse", pin);
+        if (event.type == RTDB_JSON) {
+            JsonDocument doc;
+            deserializeJson(doc, event.data, event.length);
+            if (!doc.containsKey("state")) return;
+            change = parseStateChange(pin, doc.as<JsonVariant>());
+        } else if (event.type == RTDB_STRING && strcmp(rest, "/state") == 0) {
+            change.state = strcmp(event.data, "ON") == 0;
+        } else {
+            return;
+        }
+    }
+
+    // Echoes and stale writes end here: no relay write, blink or delay.
+    if (!applyApplianceState(change)) return;
+
+    TraceScope feedback("feedback", pin);
+    digitalWrite(ONBOARD_LED, HIGH);
+    Serial.printf("  [->] Remote Toggled GPIO %d to %s\n", pin, change.state ? "ON" : "OFF");
     delay(50);
     digitalWrite(ONBOARD_LED, LOW);
 }
 
-void commandStreamCallback(FirebaseStream data) {
-  if (data.dataTypeEnum() == fb_esp_rtdb_data_type_string && data.stringData() == "REBOOT") {
+void commandStreamCallback(const RtdbEvent& event) {
+  bool root = strcmp(event.path, "/") == 0;
+  if (root && event.type == RTDB_STRING) {
+    if (strcmp(event.data, "REBOOT") == 0) queueCommand("", "{\"type\":\"reboot\"}");
+    else if (strcmp(event.data, "RELOAD_CONFIG") == 0) queueCommand("", "{\"type\":\"reload_config\"}");
+    return;
+  }
+  if (event.type != RTDB_JSON) return;
+  if (!root) {
+    queueCommand(event.path + 1, String(event.data));
+    return;
+  }
+  // Opening the stream delivers every command still waiting, oldest push id first.
+  JsonDocument doc;
+  if (deserializeJson(doc, event.data, event.length)) return;
+  for (JsonPair entry : doc.as<JsonObject>()) {
+    String payload;
+    serializeJson(entry.value(), payload);
+    queueCommand(entry.key().c_str(), payload);
+  }
+}
+
+void streamDroppedCallback() {
+  Serial.println("[!] RTDB Stream timeout.");
+  // The resync itself runs from loop(); this callback is on the stream task.
+  if (!resyncPending) streamDropped = true;
+}
+
+// Runs on the stream task. A command still queued or just run is not queued
+// again when a reopened stream replays it.
+void queueCommand(const String& id, const String& payload) {
+  std::lock_guard<std::mutex> lock(commandLock);
+  if (id.length()) {
+    for (const auto& recent : recentCommandIds) {
+      if (recent == id) return;
+    }
+    recentCommandIds[nextRecentCommand++ % 8] = id;
+  }
+  pendingCommands.push_back({ id, payload, esp_timer_get_time() });
+}
+
+void runPendingCommands() {
+  std::vector<PendingCommand> batch;
+  {
+    std::lock_guard<std::mutex> lock(commandLock);
+    if (pendingCommands.empty()) return;
+    batch.swap(pendingCommands);
+  }
+  for (const auto& command : batch) runCommand(command);
+  if (rebootRequested) {
     Serial.println("\n<REBOOT> Command received! Restarting...");
-    Firebase.RTDB.deleteNode(&fbdo, data.streamPath());
     delay(1000);
     ESP.restart();
   }
 }
 
-void streamTimeoutCallback(bool timeout) {
-  if (timeout) Serial.println("[!] RTDB Stream timeout.");
+void runCommand(const PendingCommand& command) {
+  JsonDocument payload;
+  JsonDocument record;
+  const char* error = nullptr;
+  const char* type = nullptr;
+  uint8_t version = 1;
+  if (deserializeJson(payload, command.payload)) {
+    error = "bad_payload";
+  } else {
+    type = payload["type"];
+    version = payload["v"] | 1;
+    const CommandTable<CommandHandler>::Entry* entry = commands.find(type);
+    if (!entry) error = "unknown_type";
+    else if (version > entry->maxVersion) error = "unsupported_version";
+    else error = entry->handler(payload["args"], record["result"].to<JsonObject>());
+  }
+  int64_t completedUs = esp_timer_get_time();
+  Serial.printf("  [->] Command %s %s in %lld us.\n", type ? type : "?", error ? error : "ok",
+                (long long)(completedUs - command.receivedUs));
+
+  String commandPath = "devices/" + deviceId + "/command";
+  if (command.id.length() == 0) {
+    cloudDelete(commandPath);
+    return;
+  }
+  record["type"] = type;
+  record["v"] = version;
+  record["status"] = error ? "error" : "ok";
+  if (error) record["error"] = error;
+  // Device-monotonic µs; completed_at is the server's clock at the same
+  // moment, so the receive time is completed_at - (completed_us - received_us).
+  record["received_us"] = command.receivedUs;
+  record["completed_us"] = completedUs;
+  if (payload.containsKey("sent")) record["sent"] = payload["sent"];
+  record["completed_at"][".sv"] = "timestamp";
+  String body;
+  serializeJson(record, body);
+  if (!cloudSet("devices/" + deviceId + "/command_results/" + command.id, body)) {
+    Serial.println("  [-] Command result write failed: " + cloudError());
+  }
+  cloudDelete(commandPath + "/" + command.id);
+}
+
+void registerCommands() {
+  bool ok = commands.add("reboot", 1, commandReboot);
+  ok &= commands.add("reload_config", 1, commandReloadConfig);
+  ok &= commands.add("set_states", 1, commandSetStates);
+  ok &= commands.add("diagnostics", 1, commandDiagnostics);
+  if (!ok) Serial.println("  [!] Command table collision.");
+}
+
+// The result is written before the restart, from runPendingCommands().
+const char* commandReboot(JsonVariant args, JsonObject result) {
+  rebootRequested = true;
+  return nullptr;
+}
+
+const char* commandReloadConfig(JsonVariant args, JsonObject result) {
+  int changed = reloadConfiguration();
+  if (changed < 0) return "config_fetch_failed";
+  result["changes"] = changed;
+  result["appliances"] = appliances.size();
+  return nullptr;
+}
+
+// args: {"states": {"<pin>": "ON" | "OFF", ...}}
+const char* commandSetStates(JsonVariant args, JsonObject result) {
+  if (!args["states"].is<JsonObject>()) return "bad_args";
+  std::vector<SceneReport> reports;
+  JsonArray unknown = result["unknown"].to<JsonArray>();
+  {
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    for (JsonPair entry : args["states"].as<JsonObject>()) {
+      int pin = atoi(entry.key().c_str());
+      bool state = entry.value() == "ON";
+      Appliance* appliance = findAppliance(pin);
+      if (!appliance) {
+        unknown.add(pin);
+        continue;
+      }
+      if (appliance->state == state) continue;
+      reports.push_back({ appliance->pin, state, driveLocally(*appliance, state) });
+    }
+  }
+  for (const auto& report : reports) publishLocalState(report.pin, report.state, report.seq);
+  result["changed"] = reports.size();
+  return nullptr;
+}
+
+const char* commandDiagnostics(JsonVariant args, JsonObject result) {
+  result["fw"] = FW_VERSION;
+  result["uptime_ms"] = millis();
+  result["free_heap"] = ESP.getFreeHeap();
+  result["min_free_heap"] = ESP.getMinFreeHeap();
+  result["rssi"] = WiFi.RSSI();
+  result["ip"] = WiFi.localIP().toString();
+  result["appliances"] = appliances.size();
+  result["last_seen_version"] = lastSeenVersion;
+  {
+    std::lock_guard<std::mutex> lock(heartbeatLock);
+    result["heartbeat_ms"] = heartbeat.interval();
+    result["heartbeats"] = heartbeat.standaloneCount();
+    result["heartbeats_piggybacked"] = heartbeat.piggybackedCount();
+  }
+  {
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    result["admission_pending"] = admission.pendingCount();
+  }
+  result["dimmer_ramps"] = dimmers.ramps();
+  return nullptr;
+}
+
+// Catches up with one read filtered on version > lastSeenVersion, then opens
+// the streams. The live stream stays unfiltered: a filter would also hide
+// every later write that does not bump version, such as a legacy app setting
+// only /<pin>/state. Entries in its opening snapshot that the catch-up already
+// applied are dropped by version.
+bool startStreams() {
+    resyncApplied = 0;
+    if (lastSeenVersion) {
+        String delta;
+        if (!cloudGet("devices/" + deviceId + "/appliances", delta, "version", (double)(lastSeenVersion + 1))) {
+            return false;
+        }
+        resyncApplied = applyStateDelta(delta.c_str(), delta.length());
+    }
+    bool ok = cloudStream(CLOUD_STREAM_COMMAND, "devices/" + deviceId + "/command", commandStreamCallback,
+                          streamDroppedCallback);
+    return ok && cloudStream(CLOUD_STREAM_APPLIANCES, "devices/" + deviceId + "/appliances", applianceStreamCallback,
+                             streamDroppedCallback);
+}
+
+// Takes over reconnection from the library so retries are jittered and
+// the state missed while disconnected is replayed before resuming.
+void beginResync() {
+    cloudStopStreams();
+    {
+        std::lock_guard<std::mutex> lock(heartbeatLock);
+        heartbeat.disrupted();
+    }
+
+    resyncPending = true;
+    // A reopen that failed after cloudStream() accepted it (the lean backend
+    // only connects on the stream task) comes back here as a drop and keeps
+    // backing off; the backoff is reset once a reopened snapshot is replayed.
+    if (!resyncReplayPending) streamDroppedAt = millis();
+    nextResyncAt = millis() + resyncBackoff.next();
+}
+
+void tryResync() {
+    TraceScope span("resync");
+    if (WiFi.status() != WL_CONNECTED || !cloudReady()) {
+        nextResyncAt = millis() + resyncBackoff.next();
+        return;
+    }
+
+    // The log line is written when the reopened stream's snapshot lands.
+    resyncReplayPending = true;
+    if (!startStreams()) {
+        Serial.println("  [-] Resync failed: " + cloudError());
+        cloudStopStreams();
+        nextResyncAt = millis() + resyncBackoff.next();
+        return;
+    }
+    resyncPending = false;
 }
 
 void setupFirebase() {
     Serial.println("\n--- [ FIREBASE INIT ] ---");
-    config.api_key = API_KEY;
-    config.database_url = DATABASE_URL;
-    config.signer.test_mode = true;
-    Firebase.begin(&config, &auth);
-    Firebase.reconnectWiFi(true);
+    cloudBegin();
 
     Serial.print("  [..] Authenticating...");
     unsigned long startMillis = millis();
-    while (!Firebase.ready() && millis() - startMillis < 10000) {
+    while (!cloudReady() && millis() - startMillis < 10000) {
         digitalWrite(ONBOARD_LED, HIGH); delay(50);
         digitalWrite(ONBOARD_LED, LOW); delay(50);
         digitalWrite(ONBOARD_LED, HIGH); delay(50);
         digitalWrite(ONBOARD_LED, LOW); delay(850);
     }
 
-    if (!Firebase.ready()) { Serial.println("\n  [-] Authentication Failed."); return; }
+    if (!cloudReady()) { Serial.println("\n  [-] Authentication Failed."); return; }
     
     firebaseReady = true;
     Serial.println("\n  [+] Authentication Success.");
     
-    loadConfigurationFromFirestore();
-    
-    String commandPath = "devices/" + WiFi.macAddress() + "/command";
-    Firebase.RTDB.beginStream(&command_stream, commandPath.c_str());
-    Firebase.RTDB.setStreamCallback(&command_stream, commandStreamCallback, streamTimeoutCallback);
-    
-    String appliancesPath = "devices/" + WiFi.macAddress() + "/appliances";
-    Firebase.RTDB.beginStream(&appliance_stream, appliancesPath.c_str());
-    Firebase.RTDB.setStreamCallback(&appliance_stream, applianceStreamCallback, streamTimeoutCallback);
-    Serial.println("  [+] RTDB Stream listeners active.");
+    std::vector<ConfigChange> changes;
+    bool fetchLayout = true;
+#ifdef AURA_FIXED_PROFILE
+    // The compiled-in table is already live unless the app has overridden it;
+    // the keys and admission limits still come from the config.
+    fetchLayout = !fixedLayout;
+#endif
+    if (loadConfigurationFromFirestore(changes, fetchLayout) && fetchLayout) markAppliancesReady("firestore");
 
     String device_path = "devices/" + WiFi.macAddress();
-    FirebaseJson status_json;
-    status_json.set("ip", WiFi.localIP().toString());
-    status_json.set("online", true);
-    status_json.set("version", FW_VERSION);
-    status_json.set("name", "ZERODAY Controller");
+    ipChanged = false;
+    JsonDocument status_json;
+    status_json["ip"] = WiFi.localIP().toString();
+    status_json["online"] = true;
+    status_json["version"] = FW_VERSION;
+    status_json["name"] = "ZERODAY Controller";
+    status_json["wifi"]["fast_path"] = wifiFastPath;
+    status_json["wifi"]["assoc_ms"] = (int)wifiAssocMs;
+    status_json["wifi"]["ip_ms"] = (int)wifiIpMs;
+    status_json["boot"]["appliances_us"] = (int)appliancesReadyUs;
+    fillHeartbeat(status_json["hb"].to<JsonObject>());
 
-    FirebaseJson appliances_json;
+    JsonObject appliances_json = status_json["appliances"].to<JsonObject>();
     for(const auto& appliance : appliances) {
-      FirebaseJson appliance_data;
-      appliance_data.set("name", appliance.name);
-      appliance_data.set("state", appliance.state ? "ON" : "OFF");
-      appliances_json.set(String(appliance.pin), appliance_data);
+      JsonObject appliance_data = appliances_json[String(appliance.pin)].to<JsonObject>();
+      appliance_data["name"] = appliance.name;
+      appliance_data["type"] = appliance.type;
+      appliance_data["state"] = appliance.state ? "ON" : "OFF";
+      if (dimmers.owns(appliance.pin)) appliance_data["level"] = appliance.level;
+      appliance_data["version"][".sv"] = "timestamp";
+      appliance_data["origin"] = deviceId;
     }
-    status_json.set("appliances", appliances_json);
-    
-    if (!Firebase.RTDB.setJSON(&fbdo, device_path.c_str(), &status_json)) {
-      Serial.println("  [-] RTDB Set Failed: " + fbdo.errorReason());
+
+    // An update, not a set: it replaces only the children written here, so
+    // commands queued under command/ while the controller was offline survive.
+    String body;
+    serializeJson(status_json, body);
+    bool published = cloudUpdate(device_path, body);
+    {
+      std::lock_guard<std::mutex> lock(heartbeatLock);
+      if (published) heartbeat.sent(millis());
+      else heartbeat.failed(millis());
     }
+    if (!published) Serial.println("  [-] RTDB Update Failed: " + cloudError());
+
+    // Streams open after the boot state is published, so the snapshot they
+    // deliver already reflects it.
+    startStreams();
+    Serial.println("  [+] RTDB Stream listeners active.");
+}
+
+// Advertises the local API over mDNS/DNS-SD so the app and other controllers
+// can reach this device without the cloud, and follow it across DHCP changes.
+void startDiscovery() {
+  Serial.println("\n--- [ DISCOVERY INIT ] ---");
+  String suffix = deviceId.substring(9);
+  suffix.replace(":", "");
+  suffix.toLowerCase();
+  String hostname = "aura-" + suffix;
+  if (!MDNS.begin(hostname)) {
+    Serial.println("  [-] mDNS responder failed.");
+    return;
+  }
+  MDNS.addService("http", "tcp", 80);
+  MDNS.addService("aura", "tcp", 80);
+  updateServiceTxt();
+  Serial.println("  [+] Advertising " + hostname + ".local");
+  if (!peerScanTask) xTaskCreate(peerScanLoop, "peerScan", 4096, nullptr, 1, &peerScanTask);
+}
+
+void updateServiceTxt() {
+  for (const char* service : { "http", "aura" }) {
+    MDNS.addServiceTxt(service, "tcp", "mac", deviceId);
+    MDNS.addServiceTxt(service, "tcp", "fw", FW_VERSION);
+    MDNS.addServiceTxt(service, "tcp", "appliances", String(appliances.size()));
+  }
+}
+
+// Blocks for the mDNS query timeout (about 3 s), so it runs on its own task
+// every few minutes; lookups in between are served from the cache.
+void scanPeers() {
+  int found = MDNS.queryService("aura", "tcp");
+  unsigned long now = millis();
+  std::lock_guard<std::mutex> lock(peersLock);
+  for (int i = 0; i < found; i++) {
+    String mac = MDNS.txt(i, "mac");
+    if (mac.length() == 0 || mac == deviceId) continue;
+    peers.update(mac.c_str(), (uint32_t)MDNS.IP(i), MDNS.port(i), now);
+  }
+  peers.expire(now);
+}
+
+void peerScanLoop(void* parameter) {
+  for (;;) {
+    if (WiFi.status() == WL_CONNECTED) scanPeers();
+    vTaskDelay(pdMS_TO_TICKS(PEER_SCAN_INTERVAL_MS));
+  }
+}
+
+void startScenes() {
+  Serial.println("\n--- [ SCENES INIT ] ---");
+  WiFi.macAddress(selfMac);
+  preferences.begin("scene", false);
+  sceneBootId = preferences.getUInt("boot", 0) + 1;
+  preferences.putUInt("boot", sceneBootId);
+  preferences.end();
+  sceneClock = new SceneClock(selfMac);
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = sceneTimerCallback;
+  timerArgs.name = "scene";
+  esp_timer_create(&timerArgs, &sceneTimer);
+  if (!sceneUdp.listenMulticast(sceneGroup, SCENE_PORT)) {
+    Serial.println("  [-] Scene multicast listen failed.");
+    return;
+  }
+  sceneUdp.onPacket([](AsyncUDPPacket packet) { onScenePacket(packet.data(), packet.length()); });
+  Serial.printf("  [+] Listening for scenes on %s:%d%s\n", sceneGroup.toString().c_str(), SCENE_PORT,
+                sceneKeyLen ? "" : " (no scene_key configured, ignoring them)");
+}
+
+// Every controller of a home shares one key, set as "scene_key" in its config.
+void setSceneKey(const String& key) {
+  std::lock_guard<std::mutex> lock(sceneLock);
+  sceneKeyLen = std::min(key.length(), sizeof(sceneKey));
+  memcpy(sceneKey, key.c_str(), sceneKeyLen);
+}
+
+// Runs on the AsyncUDP task.
+void onScenePacket(const uint8_t* data, size_t len) {
+  int64_t localUs = esp_timer_get_time();
+  ScenePacket packet;
+  std::lock_guard<std::mutex> lock(sceneLock);
+  if (!sceneKeyLen || !decodeScenePacket(data, len, sceneKey, sceneKeyLen, packet)) return;
+  if (packet.type == SCENE_BEACON) {
+    int64_t offsetUs = sceneClock->offset();
+    if (sceneClock->onBeacon(packet, localUs)) rebaseScenes(sceneClock->offset() - offsetUs);
+    return;
+  }
+  if (packet.type == SCENE_RUN && sceneGuard.accept(packet, sceneClock->now(localUs))) scheduleScene(packet);
+}
+
+// Network time stepped by deltaUs (the reference rebooted or changed). Scene
+// times seen so far are in the old base: the guard's would reject every scene
+// until the new clock caught up, and scheduled scenes would run late. Both
+// are moved into the new base rather than dropped, so scenes captured before
+// the step are still refused. Callers hold sceneLock.
+void rebaseScenes(int64_t deltaUs) {
+  sceneGuard.rebase(deltaUs);
+  for (auto& scene : scheduledScenes) scene.timeUs += deltaUs;
+  armSceneTimer();
+  Serial.printf("  [!] Scene clock stepped %lld ms, scenes rebased.\n", (long long)(deltaUs / 1000));
+}
+
+// Keeps only this controller's actions. Callers hold sceneLock.
+void scheduleScene(ScenePacket& scene) {
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < scene.count; i++) {
+    if (memcmp(scene.actions[i].mac, selfMac, 6) == 0) scene.actions[kept++] = scene.actions[i];
+  }
+  scene.count = kept;
+  if (!kept) return;
+  if (scheduledScenes.size() >= SCENE_MAX_SCHEDULED) {
+    Serial.printf("  [-] Scene '%s' dropped, %d already scheduled.\n", scene.name, SCENE_MAX_SCHEDULED);
+    return;
+  }
+  scheduledScenes.push_back(scene);
+  armSceneTimer();
+}
+
+// One-shot esp_timer for the earliest scene, so execution does not wait for
+// whatever loop() is blocked on. Callers hold sceneLock.
+void armSceneTimer() {
+  esp_timer_stop(sceneTimer);
+  if (scheduledScenes.empty()) return;
+  int64_t earliest = scheduledScenes[0].timeUs;
+  for (const auto& scene : scheduledScenes) earliest = std::min(earliest, scene.timeUs);
+  int64_t delayUs = sceneClock->toLocal(earliest) - esp_timer_get_time();
+  esp_timer_start_once(sceneTimer, delayUs > 0 ? delayUs : 0);
+}
+
+void sceneTimerCallback(void* arg) {
+  std::lock_guard<std::mutex> lock(sceneLock);
+  int64_t localUs = esp_timer_get_time();
+  for (size_t i = 0; i < scheduledScenes.size();) {
+    int64_t dueUs = sceneClock->toLocal(scheduledScenes[i].timeUs);
+    if (dueUs > localUs) { i++; continue; }
+    runScene(scheduledScenes[i], localUs - dueUs);
+    scheduledScenes.erase(scheduledScenes.begin() + i);
+  }
+  armSceneTimer();
+}
+
+void runScene(const ScenePacket& scene, int64_t lateUs) {
+  {
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    for (uint8_t i = 0; i < scene.count; i++) {
+      bool state = scene.actions[i].state;
+      Appliance* appliance = findAppliance(scene.actions[i].pin);
+      if (!appliance || appliance->state == state) continue;
+      sceneReports.push_back({ appliance->pin, state, driveLocally(*appliance, state, ADMIT_SCENE) });
+    }
+  }
+  Serial.printf("  [->] Scene '%s' ran %lld us late.\n", scene.name, (long long)lateUs);
+}
+
+// Signs the scene, schedules this controller's share and multicasts it.
+// The packet goes out three times because Wi-Fi multicast is not
+// acknowledged; receivers drop the copies. Returns an error code, or nullptr
+// once sent.
+const char* broadcastScene(ScenePacket& scene, uint32_t delayMs) {
+  uint8_t buffer[kSceneMaxPacket];
+  size_t length;
+  {
+    std::lock_guard<std::mutex> lock(sceneLock);
+    if (!sceneClock || !sceneKeyLen) return "not_configured";
+    memcpy(scene.sender, selfMac, 6);
+    scene.bootId = sceneBootId;
+    scene.seq = ++sceneSeq;
+    int64_t nowUs = sceneClock->now(esp_timer_get_time());
+    scene.timeUs = nowUs + (int64_t)delayMs * 1000;
+    length = encodeScenePacket(scene, sceneKey, sceneKeyLen, buffer, sizeof(buffer));
+    if (!length) return "too_large";
+    // Receivers drop a scene timed before this controller's previous one, so
+    // it is refused here rather than run on this controller alone.
+    if (!sceneGuard.accept(scene, nowUs)) return "out_of_order";
+    ScenePacket local = scene;
+    scheduleScene(local);
+  }
+  for (int i = 0; i < 3; i++) sceneUdp.writeTo(buffer, length, sceneGroup, SCENE_PORT);
+  return nullptr;
+}
+
+void sendBeacon() {
+  uint8_t buffer[kSceneMaxPacket];
+  size_t length;
+  {
+    std::lock_guard<std::mutex> lock(sceneLock);
+    if (!sceneKeyLen) return;
+    ScenePacket beacon = {};
+    beacon.type = SCENE_BEACON;
+    memcpy(beacon.sender, selfMac, 6);
+    beacon.bootId = sceneBootId;
+    beacon.seq = ++sceneSeq;
+    beacon.timeUs = sceneClock->now(esp_timer_get_time());
+    length = encodeScenePacket(beacon, sceneKey, sceneKeyLen, buffer, sizeof(buffer));
+  }
+  if (length) sceneUdp.writeTo(buffer, length, sceneGroup, SCENE_PORT);
+}
+
+void publishSceneReports() {
+  std::vector<SceneReport> reports;
+  {
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    reports.swap(sceneReports);
+  }
+  for (const auto& report : reports) publishLocalState(report.pin, report.state, report.seq);
+}
+
+bool parseMac(const char* text, uint8_t mac[6]) {
+  unsigned int bytes[6];
+  if (!text || sscanf(text, "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) return false;
+  for (int i = 0; i < 6; i++) mac[i] = (uint8_t)bytes[i];
+  return true;
+}
+
+size_t serializeState(char* buffer, size_t capacity) {
+  JsonDocument doc;
+  doc["mac"] = deviceId;
+  JsonArray list = doc["appliances"].to<JsonArray>();
+  std::lock_guard<std::mutex> lock(appliancesLock);
+  for (const auto& appliance : appliances) {
+    JsonObject entry = list.add<JsonObject>();
+    entry["name"] = appliance.name;
+    entry["pin"] = appliance.pin;
+    entry["state"] = appliance.state ? "ON" : "OFF";
+    if (dimmers.owns(appliance.pin)) entry["level"] = appliance.level;
+    entry["version"] = appliance.version;
+  }
+  size_t length = measureJson(doc);
+  if (length < capacity) serializeJson(doc, buffer, capacity);
+  return length;
+}
+
+// A new key ends every session, so a config reload carrying the same key
+// leaves them alone.
+void setLanKey(const String& key, bool persist) {
+  {
+    std::lock_guard<std::mutex> lock(lanAuthLock);
+    if (key == lanKey) return;
+    lanAuth.setKey((const uint8_t*)key.c_str(), key.length());
+    lanKey = key;
+  }
+  if (!persist) return;
+  preferences.begin("lan-auth", false);
+  if (preferences.getString("key", "") != key) preferences.putString("key", key);
+  preferences.end();
+}
+
+// Checks the X-Aura-Session, X-Aura-Counter and X-Aura-Auth headers against
+// the request; on failure answers 401 with the reason, so a client seeing
+// no_session or expired knows to open a new session and retry.
+bool authorize(AsyncWebServerRequest* request, const char* body, size_t length) {
+  std::lock_guard<std::mutex> lock(lanAuthLock);
+  if (!lanAuth.enabled()) return true;
+  uint8_t mac[kHmacLength];
+  if (!request->hasHeader("X-Aura-Session") || !request->hasHeader("X-Aura-Counter") ||
+      !request->hasHeader("X-Aura-Auth") ||
+      !decodeHex(request->getHeader("X-Aura-Auth")->value().c_str(), mac, sizeof(mac))) {
+    request->send(401, "text/plain", "no_session");
+    return false;
+  }
+  uint32_t id = strtoul(request->getHeader("X-Aura-Session")->value().c_str(), nullptr, 10);
+  uint64_t counter = strtoull(request->getHeader("X-Aura-Counter")->value().c_str(), nullptr, 10);
+
+  // The query as the client wrote it, rebuilt from the decoded parameters.
+  String target = request->url();
+  char separator = '?';
+  for (size_t i = 0; i < request->params(); i++) {
+    AsyncWebParameter* param = request->getParam(i);
+    if (param->isPost()) continue;
+    target += separator;
+    target += param->name();
+    target += '=';
+    target += param->value();
+    separator = '&';
+  }
+  const char* method = request->method() == HTTP_POST ? "POST" : "GET";
+  LanAuthResult result = lanAuth.verify(id, counter, method, target.c_str(), body, length, mac, millis());
+  if (result == LAN_AUTH_OK) return true;
+  request->send(401, "text/plain", lanAuthReason(result));
+  return false;
+}
+
+// Registers a POST endpoint taking a JSON body. Chunks are assembled in place
+// by BodyBuffer and the handler only runs once the whole body has arrived.
+void onJsonPost(const char* uri, size_t limit, std::function<void(AsyncWebServerRequest*, JsonDocument&)> handler,
+                bool open) {
+  server.on(uri, HTTP_POST, [handler, open](AsyncWebServerRequest *request) {
+    switch (BodyBuffer::statusOf(request->_tempObject)) {
+      case BODY_COMPLETE: break;
+      case BODY_TOO_LARGE: request->send(413, "text/plain", "Body too large"); return;
+      default: request->send(400, "text/plain", "Missing or incomplete body"); return;
+    }
+    BodyBuffer* body = static_cast<BodyBuffer*>(request->_tempObject);
+    if (!open && !authorize(request, body->data(), body->total)) return;
+    JsonDocument doc;
+    if (deserializeJson(doc, body->data(), body->total)) {
+      request->send(400, "text/plain", "Invalid JSON");
+      return;
+    }
+    handler(request, doc);
+  }, NULL, [limit](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    BodyBuffer::append(request->_tempObject, data, len, index, total, limit);
+  });
 }
 
 void startWebServer() {
   Serial.println("\n--- [ LOCAL API INIT ] ---");
   server.on("/toggle", HTTP_GET, [] (AsyncWebServerRequest *request) {
+    TraceScope receive("http.toggle");
+    if (!authorize(request, "", 0)) return;
     if (request->hasParam("pin")) {
       digitalWrite(ONBOARD_LED, HIGH);
       int pin = request->getParam("pin")->value().toInt();
-      for (auto& appliance : appliances) {
-        if (appliance.pin == pin) {
-          appliance.state = !appliance.state;
-          digitalWrite(appliance.pin, appliance.state);
-          Firebase.RTDB.setString(&fbdo, "devices/" + WiFi.macAddress() + "/appliances/" + String(pin) + "/state", appliance.state ? "ON" : "OFF");
-          request->send(200, "text/plain", appliance.state ? "ON" : "OFF");
-          delay(50);
-          digitalWrite(ONBOARD_LED, LOW);
-          return;
+      receive.setPin(pin);
+      bool state = false;
+      uint32_t seq = 0;
+      {
+        std::lock_guard<std::mutex> lock(appliancesLock);
+        Appliance* appliance;
+        {
+          TraceScope span("lookup", pin);
+          appliance = findAppliance(pin);
+        }
+        if (appliance) {
+          TraceScope span("actuate", pin);
+          state = !appliance->state;
+          seq = driveLocally(*appliance, state);
         }
       }
+      if (seq) {
+        publishLocalState(pin, state, seq);
+        request->send(200, "text/plain", state ? "ON" : "OFF");
+        delay(50);
+        digitalWrite(ONBOARD_LED, LOW);
+        return;
+      }
+      digitalWrite(ONBOARD_LED, LOW);
     }
     request->send(400, "text/plain", "Missing or invalid pin parameter");
   });
 
-  server.on("/reconfigure-wifi", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, [](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String body = "";
-    for (size_t i = 0; i < len; i++) { body += (char)data[i]; }
-    
-    JsonDocument doc;
-    deserializeJson(doc, body);
+  // {"name", "delay_ms", "actions": [{"mac", "pin", "state": "ON"|"OFF"}]}:
+  // every controller named runs its actions at the same moment.
+  onJsonPost("/scene", 1024, [](AsyncWebServerRequest *request, JsonDocument& doc) {
+    ScenePacket scene = {};
+    scene.type = SCENE_RUN;
+    strlcpy(scene.name, doc["name"] | "scene", sizeof(scene.name));
+    for (JsonObject action : doc["actions"].as<JsonArray>()) {
+      if (scene.count == kSceneMaxActions) break;
+      SceneAction& entry = scene.actions[scene.count];
+      if (!parseMac(action["mac"], entry.mac)) continue;
+      entry.pin = action["pin"] | 0;
+      entry.state = action["state"] == "ON";
+      scene.count++;
+    }
+    if (!scene.count) {
+      request->send(400, "text/plain", "No valid actions");
+      return;
+    }
+    long delayMs = doc["delay_ms"] | SCENE_DEFAULT_DELAY_MS;
+    delayMs = std::max(0L, std::min(delayMs, (long)SCENE_MAX_DELAY_MS));
+    const char* error = broadcastScene(scene, (uint32_t)delayMs);
+    if (error) {
+      request->send(strcmp(error, "not_configured") == 0 ? 503 : 409, "text/plain", error);
+      return;
+    }
+    request->send(202, "application/json", "{\"at\":" + String((double)scene.timeUs, 0) + "}");
+  });
+
+  // GET /session -> {"challenge": 32 hex, "expires_s"}, spent by one open.
+  server.on("/session", HTTP_GET, [](AsyncWebServerRequest *request) {
+    uint8_t challenge[LanAuth::kNonceLength];
+    esp_fill_random(challenge, sizeof(challenge));
+    {
+      std::lock_guard<std::mutex> lock(lanAuthLock);
+      if (!lanAuth.enabled()) {
+        request->send(503, "text/plain", "LAN auth not configured");
+        return;
+      }
+      lanAuth.issue(challenge, millis());
+    }
+    char hex[2 * LanAuth::kNonceLength + 1];
+    encodeHex(challenge, sizeof(challenge), hex);
+    JsonDocument reply;
+    reply["challenge"] = hex;
+    reply["expires_s"] = LanAuth::kChallengeMs / 1000;
+    String body;
+    serializeJson(reply, body);
+    request->send(200, "application/json", body);
+  });
+
+  // {"challenge": 32 hex, "nonce": 32 hex, "proof": 64 hex} -> {"id", "proof", "idle_s", "lifetime_s"}
+  onJsonPost("/session", 256, [](AsyncWebServerRequest *request, JsonDocument& doc) {
+    uint8_t challenge[LanAuth::kNonceLength];
+    uint8_t clientNonce[LanAuth::kNonceLength];
+    uint8_t clientProof[kHmacLength];
+    if (!decodeHex(doc["challenge"], challenge, sizeof(challenge)) ||
+        !decodeHex(doc["nonce"], clientNonce, sizeof(clientNonce)) ||
+        !decodeHex(doc["proof"], clientProof, sizeof(clientProof))) {
+      request->send(400, "text/plain", "Missing challenge, nonce or proof");
+      return;
+    }
+    uint8_t serverProof[kHmacLength];
+    uint32_t id;
+    {
+      std::lock_guard<std::mutex> lock(lanAuthLock);
+      if (!lanAuth.enabled()) {
+        request->send(503, "text/plain", "LAN auth not configured");
+        return;
+      }
+      if (!lanAuth.open(challenge, clientNonce, clientProof, millis(), id, serverProof)) {
+        request->send(401, "text/plain", "bad_proof");
+        return;
+      }
+    }
+    char hex[2 * kHmacLength + 1];
+    JsonDocument reply;
+    reply["id"] = id;
+    encodeHex(serverProof, sizeof(serverProof), hex);
+    reply["proof"] = hex;
+    reply["idle_s"] = LAN_SESSION_IDLE_MS / 1000;
+    reply["lifetime_s"] = LAN_SESSION_LIFETIME_MS / 1000;
+    String body;
+    serializeJson(reply, body);
+    request->send(200, "application/json", body);
+  }, true);
+
+  onJsonPost("/reconfigure-wifi", 256, [](AsyncWebServerRequest *request, JsonDocument& doc) {
     const char* ssid = doc["ssid"];
-    const char* pass = doc["pass"];
+    const char* pass = doc["pass"] | "";
+    if (!ssid || !*ssid) {
+      request->send(400, "text/plain", "Missing ssid");
+      return;
+    }
 
     preferences.begin("wifi-creds", false);
     preferences.putString("ssid", ssid);
     preferences.putString("password", pass);
     preferences.end();
+    clearFastConnect();
     
     request->send(200, "application/json", "{\"status\":\"ok\",\"message\":\"Credentials saved. Restarting.\"}");
     Serial.println("[Server] New Wi-Fi credentials received. Restarting...");
@@ -183,40 +1445,223 @@ void startWebServer() {
     ESP.restart();
   });
 
+  server.on("/state", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (stateSnapshot.isDirty() && !stateSnapshot.rebuild(serializeState)) {
+      request->send(503, "text/plain", "Out of memory");
+      return;
+    }
+    if (request->hasHeader("If-None-Match") &&
+        stateSnapshot.matches(request->getHeader("If-None-Match")->value().c_str())) {
+      AsyncWebServerResponse *response = request->beginResponse(304);
+      response->addHeader("ETag", stateSnapshot.etag());
+      request->send(response);
+      return;
+    }
+    // The response holds the body until the client has read all of it, which
+    // can outlast several rebuilds when the client is slow.
+    std::shared_ptr<const StateSnapshot::Body> body = stateSnapshot.share();
+    AsyncWebServerResponse *response = request->beginResponse("application/json", body->length,
+        [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+          size_t length = std::min(maxLen, body->length - index);
+          memcpy(buffer, body->data + index, length);
+          return length;
+        });
+    response->addHeader("ETag", stateSnapshot.etag());
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+  });
+
+  server.on("/peers", HTTP_GET, [](AsyncWebServerRequest *request) {
+    JsonDocument doc;
+    JsonArray list = doc.to<JsonArray>();
+    std::lock_guard<std::mutex> lock(peersLock);
+    for (size_t i = 0; i < peers.size(); i++) {
+      const Peer& peer = peers.at(i);
+      JsonObject entry = list.add<JsonObject>();
+      entry["mac"] = peer.mac;
+      entry["ip"] = IPAddress(peer.ip).toString();
+      entry["port"] = peer.port;
+    }
+    String body;
+    serializeJson(doc, body);
+    request->send(200, "application/json", body);
+  });
+
+  // Counters for soak runs (scripts/load_test.py samples this while it runs).
+  server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    JsonDocument doc;
+    doc["fw"] = FW_VERSION;
+    doc["uptime_ms"] = millis();
+    JsonObject heap = doc["heap"].to<JsonObject>();
+    heap["free"] = ESP.getFreeHeap();
+    heap["min_free"] = ESP.getMinFreeHeap();
+    heap["largest_block"] = ESP.getMaxAllocHeap();
+    {
+      std::lock_guard<std::mutex> lock(lanAuthLock);
+      doc["lan_sessions"] = lanAuth.liveSessions(millis());
+    }
+    {
+      std::lock_guard<std::mutex> lock(appliancesLock);
+      const AdmissionStats& stats = admission.stats();
+      JsonObject counters = doc["admission"].to<JsonObject>();
+      counters["dwell_ms"] = admission.dwell();
+      counters["burst"] = admission.burst();
+      counters["rate_per_sec"] = admission.rate();
+      counters["scene_burst"] = admission.burst(ADMIT_SCENE);
+      counters["scene_rate_per_sec"] = admission.rate(ADMIT_SCENE);
+      counters["pending"] = admission.pendingCount();
+      counters["admitted"] = stats.admitted;
+      counters["deferred"] = stats.deferred;
+      counters["throttled"] = stats.throttled;
+      counters["coalesced"] = stats.coalesced;
+      counters["cancelled"] = stats.cancelled;
+      counters["released"] = stats.released;
+    }
+    if (sceneClock) {
+      std::lock_guard<std::mutex> lock(sceneLock);
+      const uint8_t* reference = sceneClock->reference();
+      char mac[18];
+      snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X",
+               reference[0], reference[1], reference[2], reference[3], reference[4], reference[5]);
+      JsonObject clock = doc["scene_clock"].to<JsonObject>();
+      clock["reference"] = mac;
+      clock["is_reference"] = sceneClock->isReference(esp_timer_get_time());
+      clock["offset_us"] = sceneClock->offset();
+      clock["scheduled"] = scheduledScenes.size();
+      clock["replayed_beacons"] = sceneClock->replays();
+    }
+    String body;
+    serializeJson(doc, body);
+    request->send(200, "application/json", body);
+  });
+
+  // The most recent spans per core as a Chrome trace: open the download in
+  // chrome://tracing or ui.perfetto.dev.
+  // Spans are formatted as the TCP window opens, a chunk at a time.
+  server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+    std::shared_ptr<ChromeTraceWriter> writer(new ChromeTraceWriter(tracer));
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+        [writer](uint8_t *buffer, size_t maxLen, size_t /*index*/) -> size_t { return writer->read(buffer, maxLen); });
+    response->addHeader("Content-Disposition", "attachment; filename=\"aura-trace.json\"");
+    request->send(response);
+  });
+
   server.begin();
   Serial.println("  [+] Web server running.");
 }
 
+bool waitForWiFi(int retries) {
+    while (WiFi.status() != WL_CONNECTED && retries-- > 0) {
+        digitalWrite(ONBOARD_LED, HIGH); delay(75);
+        digitalWrite(ONBOARD_LED, LOW); delay(75);
+        Serial.print(".");
+    }
+    Serial.println();
+    return WiFi.status() == WL_CONNECTED;
+}
+
+// Remembers the AP, channel and lease of the last full association so the
+// next boot can skip the channel scan and the DHCP exchange. The lease start
+// is system time, which survives a software reset but not a power cut.
+void saveFastConnect() {
+    uint32_t leaseS = dhcpLeaseSeconds();
+    preferences.begin("wifi-creds", false);
+    preferences.putUInt("lease_at", (uint32_t)time(nullptr));
+    preferences.putUInt("lease_s", leaseS);
+    preferences.putBytes("bssid", WiFi.BSSID(), 6);
+    preferences.putUChar("channel", WiFi.channel());
+    preferences.putUInt("ip", (uint32_t)WiFi.localIP());
+    preferences.putUInt("gateway", (uint32_t)WiFi.gatewayIP());
+    preferences.putUInt("subnet", (uint32_t)WiFi.subnetMask());
+    preferences.putUInt("dns", (uint32_t)WiFi.dnsIP());
+    preferences.end();
+}
+
+void clearFastConnect() {
+    preferences.begin("wifi-creds", false);
+    preferences.remove("bssid");
+    preferences.remove("channel");
+    preferences.remove("ip");
+    preferences.remove("lease_s");
+    preferences.end();
+}
+
+// Seconds the DHCP server granted for the current lease, 0 if not bound.
+uint32_t dhcpLeaseSeconds() {
+    esp_netif_t* sta = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    struct netif* netif = sta ? (struct netif*)esp_netif_get_netif_impl(sta) : nullptr;
+    struct dhcp* dhcp = netif ? netif_dhcp_data(netif) : nullptr;
+    return dhcp && dhcp->state == DHCP_STATE_BOUND ? dhcp->offered_t0_lease : 0;
+}
+
 void setupWiFi() {
     Serial.println("\n--- [ WIFI SETUP ] ---");
     preferences.begin("wifi-creds", true);
     String saved_ssid = preferences.getString("ssid", "");
     String saved_pass = preferences.getString("password", "");
+    uint8_t bssid[6];
+    bool haveBssid = preferences.getBytes("bssid", bssid, sizeof(bssid)) == sizeof(bssid);
+    uint8_t channel = preferences.getUChar("channel", 0);
+    uint32_t ip = preferences.getUInt("ip", 0);
+    uint32_t gateway = preferences.getUInt("gateway", 0);
+    uint32_t subnet = preferences.getUInt("subnet", 0);
+    uint32_t dns = preferences.getUInt("dns", 0);
+    uint32_t leaseAt = preferences.getUInt("lease_at", 0);
+    uint32_t leaseS = preferences.getUInt("lease_s", 0);
     preferences.end();
+
+    // After a power cut system time restarts, so the lease's age is unknown.
+    esp_reset_reason_t reset = esp_reset_reason();
+    bool clockKept = reset != ESP_RST_POWERON && reset != ESP_RST_BROWNOUT && reset != ESP_RST_EXT;
+    uint32_t leaseAge = (uint32_t)time(nullptr) - leaseAt;
+    bool leaseFresh = clockKept && leaseS && leaseAge < leaseS / 2;
     
     if (saved_ssid.length() == 0) {
       Serial.println("  [!] No credentials found. Halting.");
       return;
     }
 
-    WiFi.begin(saved_ssid.c_str(), saved_pass.c_str());
-    Serial.print("  [..] Attempting connection to " + saved_ssid);
-    
-    int retries = 0;
-    while (WiFi.status() != WL_CONNECTED && retries < 40) {
-        digitalWrite(ONBOARD_LED, HIGH); delay(75);
-        digitalWrite(ONBOARD_LED, LOW); delay(75);
-        Serial.print(".");
-        retries++;
+    WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+        if (!wifiAssocMs) wifiAssocMs = millis() - wifiBeginAt;
+    }, ARDUINO_EVENT_WIFI_STA_CONNECTED);
+    WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+        if (!wifiIpMs) wifiIpMs = millis() - wifiBeginAt;
+        ipChanged = true;
+    }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+
+    bool connected = false;
+    wifiBeginAt = millis();
+    if (haveBssid && channel && ip && leaseFresh) {
+        Serial.print("  [..] Fast reconnect to " + saved_ssid);
+        WiFi.config(IPAddress(ip), IPAddress(gateway), IPAddress(subnet), IPAddress(dns));
+        WiFi.begin(saved_ssid.c_str(), saved_pass.c_str(), channel, bssid);
+        connected = wifiFastPath = waitForWiFi(FAST_CONNECT_TIMEOUT_MS / 150);
+        if (connected) leaseRenewAt = millis() + std::min<uint32_t>(leaseS / 2 - leaseAge, 7 * 86400UL) * 1000UL;
+        if (!connected) {
+            Serial.println("  [!] Fast path failed, falling back to full scan.");
+            WiFi.disconnect();
+            WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+            wifiAssocMs = wifiIpMs = 0;
+            wifiBeginAt = millis();
+        }
+    }
+
+    if (!connected) {
+        WiFi.begin(saved_ssid.c_str(), saved_pass.c_str());
+        Serial.print("  [..] Attempting connection to " + saved_ssid);
+        connected = waitForWiFi(40);
+        if (connected) saveFastConnect();
     }
-    Serial.println();
     
-    if (WiFi.status() == WL_CONNECTED) {
+    if (connected) {
         digitalWrite(ONBOARD_LED, LOW);
         Serial.println("  [+] Connection Established!");
         Serial.print("      IP Address: "); Serial.println(WiFi.localIP().toString());
+        Serial.printf("      Connect: %s, assoc %lu ms, IP %lu ms\n", wifiFastPath ? "fast" : "full", wifiAssocMs, wifiIpMs);
         setupFirebase(); 
         startWebServer(); 
+        startDiscovery();
+        startScenes();
     } else {
         Serial.println("  [-] Connection Failed!");
         for (int i=0; i<3; i++) {
@@ -230,6 +1675,15 @@ void setup() {
     Serial.begin(115200);
     pinMode(ONBOARD_LED, OUTPUT);
     digitalWrite(ONBOARD_LED, LOW); 
+    resyncBackoff.seed(esp_random());
+    deviceId = WiFi.macAddress();
+    stateSnapshot.seed(esp_random());
+    registerCommands();
+    lanAuth.seed(esp_random());
+    preferences.begin("lan-auth", true);
+    String storedKey = preferences.getString("key", "");
+    preferences.end();
+    if (storedKey.length()) setLanKey(storedKey, false);
 
     Serial.println("\n\n");
 Serial.println("███████╗███████╗██████╗  ██████╗  █████╗ ██╗   ██╗");
@@ -241,9 +1695,50 @@ Serial.println("╚══════╝╚══════╝╚═╝  ╚
 Serial.printf("\n- - - ZERODAY CONTROLLER INITIALIZING | v%s - - -\n", FW_VERSION);
 Serial.printf("      MAC: %s\n\n", WiFi.macAddress().c_str());
 
-    
+
+#ifdef AURA_FIXED_PROFILE
+    if (!fixedProfileOverridden()) loadFixedProfile();
+#endif
     setupWiFi();
     Serial.println("\n--- [ SYSTEM ONLINE ] ---");
 }
 
-void loop() {}
\ No newline at end of file
+void loop() {
+    releaseAdmitted();
+    publishSceneReports();
+    if (sceneClock && (long)(millis() - nextBeaconAt) >= 0) {
+        sendBeacon();
+        nextBeaconAt = millis() + SCENE_BEACON_INTERVAL_MS;
+    }
+    if (streamDropped) {
+        streamDropped = false;
+        beginResync();
+    }
+    if (resyncPending && (long)(millis() - nextResyncAt) >= 0) tryResync();
+    if (firebaseReady) runPendingCommands();
+    if (firebaseReady && !resyncPending) {
+        bool beat;
+        {
+            std::lock_guard<std::mutex> lock(heartbeatLock);
+            beat = heartbeat.due(millis());
+        }
+        if (beat) sendHeartbeat();
+    }
+
+    // A new DHCP lease: mDNS follows it on its own, the cloud copy needs a write.
+    // The cached lease is due for renewal: hand the address back to DHCP.
+    if (wifiFastPath && (long)(millis() - leaseRenewAt) >= 0) {
+        wifiFastPath = false;
+        leaseSavePending = true;
+        Serial.println("  [..] Cached lease half-way through, switching to DHCP.");
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+    if (leaseSavePending && WiFi.status() == WL_CONNECTED && dhcpLeaseSeconds()) {
+        leaseSavePending = false;
+        saveFastConnect();
+    }
+    if (ipChanged && firebaseReady) {
+        ipChanged = false;
+        cloudSet("devices/" + deviceId + "/ip", "\"" + WiFi.localIP().toString() + "\"");
+    }
+}
\ No newline at end of file
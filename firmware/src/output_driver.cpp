@@ -0,0 +1,112 @@
+#include "output_driver.h"
+
+// MCP23017 registers (IOCON.BANK = 0, sequential addressing).
+#define MCP23017_IODIRA 0x00
+#define MCP23017_OLATA 0x14
+
+ShadowedOutput::ShadowedOutput(uint16_t count, bool activeLow)
+  : count(count > kMaxChannels ? kMaxChannels : count), activeLow(activeLow) {}
+
+void ShadowedOutput::write(uint16_t channel, bool on) {
+  if (channel >= count) return;
+  uint64_t bit = 1ULL << channel;
+  std::lock_guard<std::mutex> lock(mutex);
+  shadow = on ? (shadow | bit) : (shadow & ~bit);
+  dirty |= bit;
+  writeCount++;
+}
+
+void ShadowedOutput::flush() {
+  uint64_t levels, changed;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!dirty) return;
+    levels = activeLow ? ~shadow : shadow;
+    changed = dirty;
+    dirty = 0;
+  }
+  // The bus transfer runs unlocked so writers are never held up by it.
+  uint64_t failed = 0;
+  uint32_t sent = transfer(levels, changed, failed);
+  std::lock_guard<std::mutex> lock(mutex);
+  transactionCount += sent;
+  if (failed) {
+    dirty |= failed & changed;
+    failureCount++;
+  }
+}
+
+uint64_t ShadowedOutput::levels() const {
+  return activeLow ? ~shadow : shadow;
+}
+
+Mcp23017Output::Mcp23017Output(I2cBus& bus, uint8_t address, uint8_t chips, bool activeLow)
+  : ShadowedOutput(chips * 16, activeLow), bus(bus), address(address), chips(chips > 4 ? 4 : chips) {}
+
+bool Mcp23017Output::begin() {
+  uint64_t initial = levels();
+  for (uint8_t chip = 0; chip < chips; chip++) {
+    // Latch the idle levels before switching the pins to outputs.
+    uint8_t latch[] = { MCP23017_OLATA, (uint8_t)(initial >> (chip * 16)), (uint8_t)(initial >> (chip * 16 + 8)) };
+    uint8_t direction[] = { MCP23017_IODIRA, 0x00, 0x00 };
+    if (!bus.write(address + chip, latch, sizeof(latch))) return false;
+    if (!bus.write(address + chip, direction, sizeof(direction))) return false;
+  }
+  return true;
+}
+
+uint32_t Mcp23017Output::transfer(uint64_t levels, uint64_t changed, uint64_t& failed) {
+  uint32_t sent = 0;
+  for (uint8_t chip = 0; chip < chips; chip++) {
+    if (!((changed >> (chip * 16)) & 0xFFFF)) continue;
+    // OLATA then OLATB through the auto-incrementing address pointer.
+    uint8_t frame[] = { MCP23017_OLATA, (uint8_t)(levels >> (chip * 16)), (uint8_t)(levels >> (chip * 16 + 8)) };
+    if (!bus.write(address + chip, frame, sizeof(frame))) failed |= 0xFFFFULL << (chip * 16);
+    sent++;
+  }
+  return sent;
+}
+
+Pcf8574Output::Pcf8574Output(I2cBus& bus, uint8_t address, uint8_t chips, bool activeLow)
+  : ShadowedOutput(chips * 8, activeLow), bus(bus), address(address), chips(chips > 8 ? 8 : chips) {}
+
+bool Pcf8574Output::begin() {
+  uint64_t initial = levels();
+  for (uint8_t chip = 0; chip < chips; chip++) {
+    uint8_t frame = (uint8_t)(initial >> (chip * 8));
+    if (!bus.write(address + chip, &frame, 1)) return false;
+  }
+  return true;
+}
+
+uint32_t Pcf8574Output::transfer(uint64_t levels, uint64_t changed, uint64_t& failed) {
+  uint32_t sent = 0;
+  for (uint8_t chip = 0; chip < chips; chip++) {
+    if (!((changed >> (chip * 8)) & 0xFF)) continue;
+    uint8_t frame = (uint8_t)(levels >> (chip * 8));
+    if (!bus.write(address + chip, &frame, 1)) failed |= 0xFFULL << (chip * 8);
+    sent++;
+  }
+  return sent;
+}
+
+Shift595Output::Shift595Output(ShiftBus& bus, uint8_t chips, bool activeLow)
+  : ShadowedOutput(chips * 8, activeLow), bus(bus), chips(chips > 8 ? 8 : chips) {}
+
+bool Shift595Output::begin() {
+  uint64_t failed = 0;
+  transfer(levels(), ~0ULL, failed);
+  return true;
+}
+
+// SPI has no acknowledge, so a chain write cannot be seen to fail; every
+// transfer rewrites the whole chain whatever changed.
+uint32_t Shift595Output::transfer(uint64_t levels, uint64_t /* changed */, uint64_t& /* failed */) {
+  // The first byte shifted out ends up in the last chip of the chain.
+  uint8_t frame[8];
+  for (uint8_t i = 0; i < chips; i++) {
+    frame[i] = (uint8_t)(levels >> ((chips - 1 - i) * 8));
+  }
+  bus.shiftOut(frame, chips);
+  return 1;
+}
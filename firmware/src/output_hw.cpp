@@ -0,0 +1,166 @@
+#include "output_hw.h"
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <soc/gpio_struct.h>
+
+void GpioOutput::configure(uint16_t channel) {
+  pinMode(channel, OUTPUT);
+}
+
+void GpioOutput::write(uint16_t channel, bool on) {
+  digitalWrite(channel, on ? HIGH : LOW);
+}
+
+void GpioOutput::configureMask(uint64_t mask) {
+  if (!mask) return;
+  // Levels are cleared before the drivers are enabled so no relay glitches on.
+  GPIO.out_w1tc = (uint32_t)mask;
+  GPIO.out1_w1tc.val = (uint32_t)(mask >> 32);
+  gpio_config_t io = {};
+  io.pin_bit_mask = mask;
+  io.mode = GPIO_MODE_OUTPUT;
+  gpio_config(&io);
+}
+
+bool WireBus::write(uint8_t address, const uint8_t* data, size_t len) {
+  wire.beginTransmission(address);
+  wire.write(data, len);
+  return wire.endTransmission() == 0;
+}
+
+void SpiShiftBus::begin() {
+  pinMode(latchPin, OUTPUT);
+  digitalWrite(latchPin, HIGH);
+  spi.begin();
+}
+
+void SpiShiftBus::shiftOut(const uint8_t* data, size_t len) {
+  spi.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+  digitalWrite(latchPin, LOW);
+  for (size_t i = 0; i < len; i++) spi.transfer(data[i]);
+  digitalWrite(latchPin, HIGH);
+  spi.endTransaction();
+}
+
+#define DIMMER_SPEED_MODE LEDC_LOW_SPEED_MODE
+#define DIMMER_TIMER LEDC_TIMER_0
+
+bool LedcDimmer::begin() {
+  if (started) return true;
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = DIMMER_SPEED_MODE;
+  timer.duty_resolution = (ledc_timer_bit_t)DIMMER_DUTY_BITS;
+  timer.timer_num = DIMMER_TIMER;
+  timer.freq_hz = pwmHz;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  if (ledc_timer_config(&timer) != ESP_OK || ledc_fade_func_install(0) != ESP_OK) return false;
+  for (uint8_t i = 0; i < kChannels; i++) {
+    Channel& channel = channels[i];
+    channel.owner = this;
+    channel.index = i;
+    channel.pin = -1;
+    channel.running = false;
+    channel.queued = false;
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onRampEnd;
+    timerArgs.arg = &channel;
+    timerArgs.name = "dimmer";
+    esp_timer_create(&timerArgs, &channel.timer);
+  }
+  started = true;
+  return true;
+}
+
+bool LedcDimmer::attach(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (pin >= 64 || !begin()) return false;
+  if (owns(pin)) return true;
+  for (auto& channel : channels) {
+    if (channel.pin >= 0) continue;
+    ledc_channel_config_t config = {};
+    config.gpio_num = pin;
+    config.speed_mode = DIMMER_SPEED_MODE;
+    config.channel = (ledc_channel_t)channel.index;
+    config.intr_type = LEDC_INTR_DISABLE;
+    config.timer_sel = DIMMER_TIMER;
+    config.duty = 0;
+    if (ledc_channel_config(&config) != ESP_OK) return false;
+    channel.pin = pin;
+    channel.fade.reset(0);
+    pins |= 1ULL << pin;
+    return true;
+  }
+  return false;
+}
+
+void LedcDimmer::release(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Channel* channel = find(pin);
+  if (!channel) return;
+  esp_timer_stop(channel->timer);
+  ledc_stop(DIMMER_SPEED_MODE, (ledc_channel_t)channel->index, 0);
+  channel->pin = -1;
+  channel->running = false;
+  channel->queued = false;
+  pins &= ~(1ULL << pin);
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+}
+
+void LedcDimmer::fade(uint8_t pin, uint8_t level, uint32_t ms) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Channel* channel = find(pin);
+  if (!channel) return;
+  if (channel->running) {
+    // Last writer wins; onRampEnd() starts it where the running ramp stops.
+    channel->queued = true;
+    channel->queuedLevel = level;
+    channel->queuedMs = ms;
+    return;
+  }
+  channel->fade.start(channel->fade.level(), level, ms);
+  run(*channel);
+}
+
+LedcDimmer::Channel* LedcDimmer::find(uint8_t pin) {
+  if (!owns(pin)) return nullptr;
+  for (auto& channel : channels) {
+    if (channel.pin == pin) return &channel;
+  }
+  return nullptr;
+}
+
+// Hands the next ramp to the hardware and arms the timer for its end.
+// Callers hold mutex.
+void LedcDimmer::run(Channel& channel) {
+  ledc_channel_t index = (ledc_channel_t)channel.index;
+  uint16_t duty;
+  uint32_t ms;
+  while (channel.fade.next(duty, ms)) {
+    rampCount++;
+    if (ms == 0) {
+      ledc_set_duty_and_update(DIMMER_SPEED_MODE, index, duty, 0);
+      continue;
+    }
+    // Waits out the tail of the previous ramp if the hardware is a step behind the timer.
+    ledc_set_fade_with_time(DIMMER_SPEED_MODE, index, duty, ms);
+    ledc_fade_start(DIMMER_SPEED_MODE, index, LEDC_FADE_NO_WAIT);
+    esp_timer_start_once(channel.timer, (uint64_t)ms * 1000);
+    channel.running = true;
+    return;
+  }
+  channel.running = false;
+}
+
+// Runs on the esp_timer task.
+void LedcDimmer::onRampEnd(void* arg) {
+  Channel& channel = *static_cast<Channel*>(arg);
+  std::lock_guard<std::mutex> lock(channel.owner->mutex);
+  if (channel.pin < 0) return;
+  channel.running = false;
+  if (channel.queued) {
+    channel.queued = false;
+    channel.fade.start(channel.fade.level(), channel.queuedLevel, channel.queuedMs);
+  }
+  channel.owner->run(channel);
+}
@@ -0,0 +1,42 @@
+#include "peer_cache.h"
+#include <string.h>
+
+PeerCache::PeerCache(uint32_t ttlMs) : count(0), ttlMs(ttlMs) {}
+
+void PeerCache::update(const char* mac, uint32_t ip, uint16_t port, uint32_t nowMs) {
+  Peer* slot = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(peers[i].mac, mac) == 0) { slot = &peers[i]; break; }
+  }
+  if (!slot && count < kCapacity) slot = &peers[count++];
+  if (!slot) {
+    slot = &peers[0];
+    for (size_t i = 1; i < count; i++) {
+      if ((int32_t)(peers[i].seenAt - slot->seenAt) < 0) slot = &peers[i];
+    }
+  }
+  strncpy(slot->mac, mac, sizeof(slot->mac) - 1);
+  slot->mac[sizeof(slot->mac) - 1] = '\0';
+  slot->ip = ip;
+  slot->port = port;
+  slot->seenAt = nowMs;
+}
+
+const Peer* PeerCache::find(const char* mac, uint32_t nowMs) const {
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(peers[i].mac, mac) == 0) return expired(peers[i], nowMs) ? nullptr : &peers[i];
+  }
+  return nullptr;
+}
+
+void PeerCache::expire(uint32_t nowMs) {
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (!expired(peers[i], nowMs)) peers[kept++] = peers[i];
+  }
+  count = kept;
+}
+
+bool PeerCache::expired(const Peer& peer, uint32_t nowMs) const {
+  return nowMs - peer.seenAt > ttlMs;
+}
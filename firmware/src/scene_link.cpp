@@ -0,0 +1,188 @@
+#include "scene_link.h"
+#include <string.h>
+#include "hmac.h"
+
+namespace {
+
+const size_t kHeaderLength = 26;
+
+void putU32(uint8_t* out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+uint32_t getU32(const uint8_t* in) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) value |= (uint32_t)in[i] << (8 * i);
+  return value;
+}
+
+void putI64(uint8_t* out, int64_t value) {
+  for (int i = 0; i < 8; i++) out[i] = (uint8_t)((uint64_t)value >> (8 * i));
+}
+
+int64_t getI64(const uint8_t* in) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) value |= (uint64_t)in[i] << (8 * i);
+  return (int64_t)value;
+}
+
+bool sign(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t* mac) {
+  uint8_t full[kHmacLength];
+  if (!hmacSha256(key, keyLen, data, len, full)) return false;
+  memcpy(mac, full, kSceneMacLength);
+  return true;
+}
+
+}  // namespace
+
+size_t encodeScenePacket(const ScenePacket& packet, const uint8_t* key, size_t keyLen, uint8_t* out, size_t capacity) {
+  size_t nameLen = strnlen(packet.name, kSceneMaxName);
+  size_t count = packet.type == SCENE_RUN ? packet.count : 0;
+  size_t length = kHeaderLength + (packet.type == SCENE_RUN ? 2 + nameLen + count * 8 : 0);
+  if (count > kSceneMaxActions || length + kSceneMacLength > capacity) return 0;
+
+  out[0] = 'A';
+  out[1] = 'S';
+  out[2] = kSceneVersion;
+  out[3] = packet.type;
+  memcpy(out + 4, packet.sender, 6);
+  putU32(out + 10, packet.bootId);
+  putU32(out + 14, packet.seq);
+  putI64(out + 18, packet.timeUs);
+  if (packet.type == SCENE_RUN) {
+    uint8_t* p = out + kHeaderLength;
+    *p++ = (uint8_t)nameLen;
+    memcpy(p, packet.name, nameLen);
+    p += nameLen;
+    *p++ = (uint8_t)count;
+    for (size_t i = 0; i < count; i++) {
+      memcpy(p, packet.actions[i].mac, 6);
+      p[6] = packet.actions[i].pin;
+      p[7] = packet.actions[i].state;
+      p += 8;
+    }
+  }
+  if (!sign(key, keyLen, out, length, out + length)) return 0;
+  return length + kSceneMacLength;
+}
+
+bool decodeScenePacket(const uint8_t* data, size_t len, const uint8_t* key, size_t keyLen, ScenePacket& packet) {
+  if (len < kHeaderLength + kSceneMacLength || data[0] != 'A' || data[1] != 'S' || data[2] != kSceneVersion) return false;
+  size_t body = len - kSceneMacLength;
+  uint8_t expected[kSceneMacLength];
+  if (!sign(key, keyLen, data, body, expected) || !equalsConstantTime(expected, data + body, kSceneMacLength)) return false;
+
+  packet.type = (ScenePacketType)data[3];
+  memcpy(packet.sender, data + 4, 6);
+  packet.bootId = getU32(data + 10);
+  packet.seq = getU32(data + 14);
+  packet.timeUs = getI64(data + 18);
+  packet.name[0] = '\0';
+  packet.count = 0;
+  if (packet.type == SCENE_BEACON) return body == kHeaderLength;
+  if (packet.type != SCENE_RUN || body < kHeaderLength + 2) return false;
+
+  const uint8_t* p = data + kHeaderLength;
+  const uint8_t* end = data + body;
+  size_t nameLen = *p++;
+  if (nameLen > kSceneMaxName || (size_t)(end - p) < nameLen + 1) return false;
+  memcpy(packet.name, p, nameLen);
+  packet.name[nameLen] = '\0';
+  p += nameLen;
+  size_t count = *p++;
+  if (count > kSceneMaxActions || (size_t)(end - p) != count * 8) return false;
+  for (size_t i = 0; i < count; i++, p += 8) {
+    memcpy(packet.actions[i].mac, p, 6);
+    packet.actions[i].pin = p[6];
+    packet.actions[i].state = p[7];
+  }
+  packet.count = (uint8_t)count;
+  return true;
+}
+
+SceneClock::SceneClock(const uint8_t mac[6])
+  : senderCount(0), nextEvict(0), replayCount(0), referenceSeenUs(0), sampleCount(0), nextSample(0), offsetUs(0) {
+  memcpy(self, mac, 6);
+  memcpy(referenceMac, mac, 6);
+}
+
+bool SceneClock::isReference(int64_t localUs) const {
+  return memcmp(referenceMac, self, 6) == 0 || localUs - referenceSeenUs > kReferenceTimeoutUs;
+}
+
+// A sender first heard since this boot is taken on trust: there is nothing
+// to compare it against yet.
+bool SceneClock::isFresh(const ScenePacket& beacon) {
+  Sender* slot = nullptr;
+  for (size_t i = 0; i < senderCount; i++) {
+    if (memcmp(senders[i].mac, beacon.sender, 6) == 0) { slot = &senders[i]; break; }
+  }
+  if (slot) {
+    if (beacon.bootId < slot->bootId || (beacon.bootId == slot->bootId && beacon.seq <= slot->seq)) {
+      replayCount++;
+      return false;
+    }
+  } else {
+    slot = senderCount < kSenders ? &senders[senderCount++] : &senders[nextEvict++ % kSenders];
+    memcpy(slot->mac, beacon.sender, 6);
+  }
+  slot->bootId = beacon.bootId;
+  slot->seq = beacon.seq;
+  return true;
+}
+
+bool SceneClock::onBeacon(const ScenePacket& beacon, int64_t localUs) {
+  const uint8_t* mac = beacon.sender;
+  if (memcmp(mac, self, 6) >= 0 || !isFresh(beacon)) return false;
+  int64_t sample = beacon.timeUs - localUs;
+  bool stepped = false;
+  if (memcmp(mac, referenceMac, 6) != 0) {
+    // A lower MAC always wins; otherwise only take over from a silent reference.
+    if (memcmp(mac, referenceMac, 6) > 0 && !isReference(localUs)) return false;
+    memcpy(referenceMac, mac, 6);
+    sampleCount = 0;
+    nextSample = 0;
+    stepped = true;
+  } else if (sampleCount && sample < offsetUs - kStepUs) {
+    // The reference restarted: the older samples would hold the offset up
+    // for a whole window.
+    sampleCount = 0;
+    nextSample = 0;
+    stepped = true;
+  }
+  referenceSeenUs = localUs;
+  samples[nextSample] = sample;
+  nextSample = (nextSample + 1) % kWindow;
+  if (sampleCount < kWindow) sampleCount++;
+  int64_t best = samples[0];
+  for (size_t i = 1; i < sampleCount; i++) {
+    if (samples[i] > best) best = samples[i];
+  }
+  offsetUs = best;
+  return stepped;
+}
+
+SceneGuard::SceneGuard() : count(0), nextEvict(0) {}
+
+bool SceneGuard::accept(const ScenePacket& scene, int64_t networkNowUs) {
+  if (scene.timeUs < networkNowUs - kWindowUs || scene.timeUs > networkNowUs + kWindowUs) return false;
+  Sender* slot = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    if (memcmp(senders[i].mac, scene.sender, 6) == 0) { slot = &senders[i]; break; }
+  }
+  if (slot) {
+    if (scene.bootId < slot->bootId || (scene.bootId == slot->bootId && scene.seq <= slot->seq)) return false;
+    if (scene.timeUs <= slot->lastTimeUs) return false;
+  } else {
+    slot = count < kSenders ? &senders[count++] : &senders[nextEvict++ % kSenders];
+    memcpy(slot->mac, scene.sender, 6);
+  }
+  slot->bootId = scene.bootId;
+  slot->seq = scene.seq;
+  slot->lastTimeUs = scene.timeUs;
+  return true;
+}
+
+void SceneGuard::rebase(int64_t deltaUs) {
+  for (size_t i = 0; i < count; i++) senders[i].lastTimeUs += deltaUs;
+}
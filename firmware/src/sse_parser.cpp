@@ -0,0 +1,183 @@
+#include "sse_parser.h"
+#include <string.h>
+
+SseParser::SseParser(char* buffer, size_t capacity, Handler handler, void* context)
+  : buffer(buffer), capacity(capacity), handler(handler), context(context), eventCount(0), overflowCount(0) {
+  reset();
+}
+
+void SseParser::reset() {
+  length = 0;
+  hasData = false;
+  overflowed = false;
+  event[0] = '\0';
+  eventLength = 0;
+  nameLength = 0;
+  field = FIELD_NAME;
+  skipSpace = false;
+  lastWasCr = false;
+}
+
+void SseParser::feed(const char* bytes, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    char c = bytes[i];
+    if (c == '\n' && lastWasCr) {
+      lastWasCr = false;
+      continue;
+    }
+    lastWasCr = (c == '\r');
+    if (c == '\r' || c == '\n') {
+      endLine();
+      continue;
+    }
+
+    switch (field) {
+      case FIELD_NAME:
+        if (c == ':') {
+          name[nameLength] = '\0';
+          if (strcmp(name, "data") == 0) {
+            field = FIELD_DATA;
+            // Multi-line data is joined with '\n'.
+            if (hasData) {
+              if (length + 1 < capacity) buffer[length++] = '\n';
+              else overflowed = true;
+            }
+            hasData = true;
+          } else if (strcmp(name, "event") == 0) {
+            field = FIELD_EVENT;
+            eventLength = 0;
+          } else {
+            field = FIELD_IGNORED;
+          }
+          skipSpace = true;
+        } else if (nameLength + 1 < sizeof(name)) {
+          name[nameLength++] = c;
+        } else {
+          field = FIELD_IGNORED;
+        }
+        break;
+      case FIELD_DATA:
+        if (skipSpace && c == ' ') { skipSpace = false; break; }
+        skipSpace = false;
+        if (length + 1 < capacity) buffer[length++] = c;
+        else overflowed = true;
+        break;
+      case FIELD_EVENT:
+        if (skipSpace && c == ' ') { skipSpace = false; break; }
+        skipSpace = false;
+        if (eventLength + 1 < sizeof(event)) event[eventLength++] = c;
+        break;
+      case FIELD_IGNORED:
+        break;
+    }
+  }
+}
+
+void SseParser::endLine() {
+  if (field == FIELD_EVENT) event[eventLength] = '\0';
+  // An empty line ends the event; a line without a colon is a field with no value.
+  bool empty = (field == FIELD_NAME && nameLength == 0);
+  field = FIELD_NAME;
+  nameLength = 0;
+  if (empty) dispatch();
+}
+
+void SseParser::dispatch() {
+  if (hasData || eventLength) {
+    if (overflowed) {
+      overflowCount++;
+    } else {
+      buffer[length] = '\0';
+      eventCount++;
+      handler(context, event, buffer, length);
+    }
+  }
+  length = 0;
+  hasData = false;
+  overflowed = false;
+  event[0] = '\0';
+  eventLength = 0;
+}
+
+namespace {
+
+const char* skipWhitespace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+  return p;
+}
+
+// Unescapes the JSON string starting after its opening quote, in place.
+// Returns the end of the unescaped text, or nullptr if unterminated; *quote
+// is left on the closing quote.
+char* unescapeString(char* p, char* end, char** quote) {
+  char* out = p;
+  while (p < end && *p != '"') {
+    if (*p != '\\') { *out++ = *p++; continue; }
+    if (++p >= end) return nullptr;
+    switch (*p) {
+      case 'n': *out++ = '\n'; break;
+      case 't': *out++ = '\t'; break;
+      case 'r': *out++ = '\r'; break;
+      case 'b': *out++ = '\b'; break;
+      case 'f': *out++ = '\f'; break;
+      case 'u': {
+        // Paths and states are ASCII; anything wider is kept as '?'.
+        if (end - p < 5) return nullptr;
+        unsigned code = 0;
+        for (int i = 1; i <= 4; i++) {
+          char h = p[i];
+          code = code * 16 + (h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+        }
+        *out++ = code < 0x80 ? (char)code : '?';
+        p += 4;
+        break;
+      }
+      default: *out++ = *p; break;
+    }
+    p++;
+  }
+  if (p >= end) return nullptr;
+  *quote = p;
+  *out = '\0';
+  return out;
+}
+
+}  // namespace
+
+bool parseRtdbEvent(char* payload, size_t length, RtdbEvent& out) {
+  static const char kPath[] = "{\"path\":\"";
+  static const char kData[] = "\"data\":";
+  char* end = payload + length;
+  if (length < sizeof(kPath) || strncmp(payload, kPath, sizeof(kPath) - 1) != 0) return false;
+
+  // Keys are written path first, then data; the value runs to the final '}'.
+  char* path = payload + sizeof(kPath) - 1;
+  char* quote;
+  if (!unescapeString(path, end, &quote)) return false;
+  // Escapes shrink the path, so the rest is read from its closing quote.
+  char* p = const_cast<char*>(skipWhitespace(quote + 1, end));
+  if (p < end && *p == ',') p++;
+  p = const_cast<char*>(skipWhitespace(p, end));
+  if (end - p < (long)(sizeof(kData) - 1) || strncmp(p, kData, sizeof(kData) - 1) != 0) return false;
+  p = const_cast<char*>(skipWhitespace(p + sizeof(kData) - 1, end));
+
+  char* last = end - 1;
+  while (last > p && (*last == ' ' || *last == '\n' || *last == '\r')) last--;
+  if (*last != '}') return false;
+  *last = '\0';
+  while (last > p && (last[-1] == ' ' || last[-1] == '\n' || last[-1] == '\r')) *--last = '\0';
+
+  out.path = path;
+  if (*p == '"') {
+    char* stringEnd = unescapeString(p + 1, last, &quote);
+    if (!stringEnd) return false;
+    out.type = RTDB_STRING;
+    out.data = p + 1;
+    out.length = stringEnd - (p + 1);
+  } else {
+    out.type = (*p == '{' || *p == '[') ? RTDB_JSON : strncmp(p, "null", 4) == 0 ? RTDB_NULL : RTDB_SCALAR;
+    out.data = p;
+    out.length = last - p;
+  }
+  return true;
+}
@@ -0,0 +1,71 @@
+#include "state_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+StateSnapshot::Body::~Body() {
+  free(data);
+}
+
+StateSnapshot::StateSnapshot() {
+  reserve(0, kInitialCapacity);
+  reserve(1, kInitialCapacity);
+  if (bodies[0]) bodies[0]->data[0] = '\0';
+}
+
+bool StateSnapshot::rebuild(Writer write) {
+  // Cleared first: a change that lands mid-rebuild marks it dirty again.
+  dirty = false;
+  uint8_t spare = current ^ 1;
+  // Still being sent: leave it to the response and write a fresh buffer.
+  // share() only hands out the current body, so once the count is down to
+  // ours nothing can take the spare again.
+  if (bodies[spare] && bodies[spare].use_count() > 1) {
+    size_t capacity = bodies[spare]->capacity;
+    bodies[spare].reset();
+    if (!reserve(spare, capacity)) {
+      dirty = true;
+      return false;
+    }
+  }
+  Body* body = bodies[spare].get();
+  size_t length = body ? write(body->data, body->capacity) : 0;
+  // Too small: grow with headroom for a few more appliances and write again.
+  if (!body || length >= body->capacity) {
+    if (!reserve(spare, length + length / 4 + 1)) {
+      dirty = true;
+      return false;
+    }
+    body = bodies[spare].get();
+    length = write(body->data, body->capacity);
+  }
+  if (length == 0 || length >= body->capacity) {
+    dirty = true;
+    return false;
+  }
+  body->length = length;
+  current = spare;
+  generation++;
+  snprintf(tag, sizeof(tag), "\"%08x-%x\"", (unsigned)bootId, (unsigned)generation);
+  return true;
+}
+
+// Only called on a body no response holds.
+bool StateSnapshot::reserve(uint8_t index, size_t capacity) {
+  if (bodies[index] && bodies[index]->capacity >= capacity) return true;
+  if (capacity < kInitialCapacity) capacity = kInitialCapacity;
+  char* data = (char*)malloc(capacity);
+  if (!data) return false;
+  Body* body = new (std::nothrow) Body(data, capacity);
+  if (!body) {
+    free(data);
+    return false;
+  }
+  bodies[index].reset(body);
+  return true;
+}
+
+bool StateSnapshot::matches(const char* ifNoneMatch) const {
+  return generation != 0 && ifNoneMatch && strcmp(ifNoneMatch, tag) == 0;
+}
@@ -0,0 +1,145 @@
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+
+int64_t traceNowUs() { return esp_timer_get_time(); }
+uint8_t traceCore() { return (uint8_t)xPortGetCoreID(); }
+#else
+#include <chrono>
+
+int64_t traceNowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+uint8_t traceCore() { return 0; }
+#endif
+
+Tracer tracer;
+
+void TraceRing::record(const TraceSpan& span) {
+  uint32_t ticket = head.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = slots[ticket % kCapacity];
+  slot.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.span = span;
+  slot.seq.store(ticket + 1, std::memory_order_release);
+}
+
+size_t TraceRing::copy(TraceSpan* out, size_t max) const {
+  uint32_t last = end();
+  uint32_t begin = last > kCapacity ? last - kCapacity : 0;
+  size_t copied = 0;
+  for (uint32_t ticket = begin; ticket != last && copied < max; ticket++) {
+    if (read(ticket, out[copied])) copied++;
+  }
+  return copied;
+}
+
+bool TraceRing::read(uint32_t ticket, TraceSpan& out) const {
+  const Slot& slot = slots[ticket % kCapacity];
+  if (slot.seq.load(std::memory_order_acquire) != ticket + 1) return false;
+  TraceSpan span = slot.span;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.seq.load(std::memory_order_relaxed) != ticket + 1) return false;
+  out = span;
+  return true;
+}
+
+void Tracer::record(const char* name, int64_t startUs, int16_t pin) {
+  TraceSpan span;
+  span.name = name;
+  span.startUs = startUs;
+  span.durUs = (uint32_t)(traceNowUs() - startUs);
+  span.pin = pin;
+  span.core = traceCore();
+  rings[span.core % kCores].record(span);
+}
+
+size_t Tracer::snapshot(TraceSpan* out) const {
+  size_t count = 0;
+  for (const auto& ring : rings) count += ring.copy(out + count, TraceRing::kCapacity);
+  std::sort(out, out + count, [](const TraceSpan& a, const TraceSpan& b) { return a.startUs < b.startUs; });
+  return count;
+}
+
+size_t formatChromeEvent(char* buffer, size_t capacity, const TraceSpan& span) {
+  int length;
+  if (span.pin >= 0) {
+    length = snprintf(buffer, capacity,
+                      "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%u,\"pid\":1,\"tid\":%u,\"args\":{\"pin\":%d}}",
+                      span.name, (long long)span.startUs, (unsigned)span.durUs, (unsigned)span.core, span.pin);
+  } else {
+    length = snprintf(buffer, capacity,
+                      "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%u,\"pid\":1,\"tid\":%u}",
+                      span.name, (long long)span.startUs, (unsigned)span.durUs, (unsigned)span.core);
+  }
+  return length > 0 && (size_t)length < capacity ? (size_t)length : 0;
+}
+
+size_t ChromeTraceWriter::read(uint8_t* buffer, size_t capacity) {
+  size_t written = 0;
+  while (written < capacity) {
+    if (pendingAt == pendingLength) {
+      pendingAt = pendingLength = 0;
+      if (stage == 0) {
+        pendingLength = (size_t)snprintf(pending, sizeof(pending), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        stage = 1;
+      } else if (stage == 1) {
+        if (!nextEvent()) stage = 2;
+      } else if (stage == 2) {
+        pendingLength = (size_t)snprintf(pending, sizeof(pending), "]}\n");
+        stage = 3;
+      } else {
+        break;
+      }
+      continue;
+    }
+    size_t take = std::min(capacity - written, pendingLength - pendingAt);
+    memcpy(buffer + written, pending + pendingAt, take);
+    pendingAt += take;
+    written += take;
+  }
+  return written;
+}
+
+// Formats the next span still in a ring into pending, with its separator.
+bool ChromeTraceWriter::nextEvent() {
+  while (core < Tracer::kCores) {
+    const TraceRing& ring = tracer.ring(core);
+    if (!ringOpen) {
+      end = ring.end();
+      ticket = end > TraceRing::kCapacity ? end - TraceRing::kCapacity : 0;
+      ringOpen = true;
+    }
+    while (ticket != end) {
+      TraceSpan span;
+      if (!ring.read(ticket++, span)) continue;
+      size_t separator = first ? 0 : 1;
+      size_t length = formatChromeEvent(pending + separator, sizeof(pending) - separator, span);
+      if (!length) continue;
+      if (separator) pending[0] = ',';
+      pendingLength = separator + length;
+      first = false;
+      return true;
+    }
+    core++;
+    ringOpen = false;
+  }
+  return false;
+}
+
+#ifndef ARDUINO
+bool dumpChromeTrace(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) return false;
+  ChromeTraceWriter writer(tracer);
+  uint8_t chunk[512];
+  size_t length;
+  while ((length = writer.read(chunk, sizeof(chunk))) > 0) fwrite(chunk, 1, length, file);
+  return fclose(file) == 0;
+}
+#endif
@@ -0,0 +1,207 @@
+#include <unity.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "admission.h"
+
+// A flood of toggle commands (a misbehaving app, a replayed stream) against
+// the admission layer with main.cpp's defaults: no relay switches faster than
+// its dwell time, the panel never switches faster than the token bucket, and
+// once the flood stops every relay ends at the level last asked for.
+
+#define DWELL_MS 250
+#define BURST 10
+#define RATE_PER_SEC 5
+#define SCENE_BURST 32
+#define SCENE_RATE_PER_SEC 8
+#define PINS 64
+
+static std::mt19937 rng(0xAD1);
+
+struct Switch {
+  uint8_t pin;
+  bool level;
+  uint32_t atMs;
+};
+
+// Relay contacts as the hardware sees them, checked on every switch.
+struct Panel {
+  std::vector<bool> level = std::vector<bool>(Admission::kPins);
+  std::vector<int64_t> lastAt = std::vector<int64_t>(Admission::kPins, -1000000);
+  std::deque<uint32_t> window;  // switch times in the last second
+  uint32_t switches = 0;
+  uint32_t fastest = UINT32_MAX;
+
+  void drive(const Switch& s) {
+    TEST_ASSERT_TRUE(level[s.pin] != s.level);
+    uint32_t gap = (uint32_t)(s.atMs - lastAt[s.pin]);
+    if (gap < fastest) fastest = gap;
+    TEST_ASSERT_GREATER_OR_EQUAL(DWELL_MS, gap);
+    level[s.pin] = s.level;
+    lastAt[s.pin] = s.atMs;
+    window.push_back(s.atMs);
+    while (s.atMs - window.front() >= 1000) window.pop_front();
+    TEST_ASSERT_LESS_OR_EQUAL(BURST + RATE_PER_SEC, window.size());
+    switches++;
+  }
+};
+
+static void releaseAll(Admission& admission, Panel& panel, uint32_t nowMs) {
+  uint8_t pin;
+  bool level;
+  while (admission.release(nowMs, pin, level)) panel.drive({ pin, level, nowMs });
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_waiting_commands_coalesce_and_cancel(void) {
+  Admission admission(DWELL_MS, BURST, RATE_PER_SEC, SCENE_BURST, SCENE_RATE_PER_SEC);
+  TEST_ASSERT_TRUE(admission.admit(4, true, 1000));
+  TEST_ASSERT_FALSE(admission.admit(4, false, 1010));
+  TEST_ASSERT_FALSE(admission.admit(4, true, 1020));  // back to the driven level
+  TEST_ASSERT_EQUAL(0, admission.pendingCount());
+  TEST_ASSERT_FALSE(admission.admit(4, false, 1030));
+  TEST_ASSERT_FALSE(admission.admit(4, false, 1040));
+  TEST_ASSERT_FALSE(admission.admit(4, true, 1045));
+  TEST_ASSERT_FALSE(admission.admit(4, false, 1050));
+  TEST_ASSERT_EQUAL(1, admission.pendingCount());
+  uint8_t pin;
+  bool level;
+  TEST_ASSERT_FALSE(admission.release(1000 + DWELL_MS - 1, pin, level));
+  TEST_ASSERT_TRUE(admission.release(1000 + DWELL_MS, pin, level));
+  TEST_ASSERT_EQUAL(4, pin);
+  TEST_ASSERT_FALSE(level);
+  TEST_ASSERT_EQUAL(2, admission.stats().cancelled);
+  TEST_ASSERT_EQUAL(1, admission.stats().coalesced);
+}
+
+// Fifty commands a millisecond for ten seconds on a simulated clock, with
+// release() on every loop() pass as main.cpp runs it.
+void test_flood_respects_dwell_and_rate(void) {
+  Admission admission(DWELL_MS, BURST, RATE_PER_SEC, SCENE_BURST, SCENE_RATE_PER_SEC);
+  Panel panel;
+  std::vector<bool> wanted(PINS);
+  uint32_t commands = 0;
+  uint32_t now = 1;
+  for (; now < 10000; now++) {
+    for (int c = 0; c < 50; c++) {
+      uint8_t pin = rng() % PINS;
+      bool level = rng() & 1;
+      wanted[pin] = level;
+      commands++;
+      if (admission.admit(pin, level, now)) panel.drive({ pin, level, now });
+    }
+    releaseAll(admission, panel, now);
+  }
+  // The flood stops; what is still waiting drains at the refill rate.
+  uint32_t stoppedAt = now;
+  while (admission.pendingCount()) releaseAll(admission, panel, ++now);
+  for (int pin = 0; pin < PINS; pin++) TEST_ASSERT_EQUAL(wanted[pin], panel.level[pin]);
+
+  const AdmissionStats& stats = admission.stats();
+  char line[200];
+  snprintf(line, sizeof(line),
+           "%u commands -> %u switches (admitted %u, released %u), coalesced %u, cancelled %u; "
+           "closest switches %u ms; drained %u ms after the flood",
+           (unsigned)commands, (unsigned)panel.switches, (unsigned)stats.admitted, (unsigned)stats.released,
+           (unsigned)stats.coalesced, (unsigned)stats.cancelled, (unsigned)panel.fastest, (unsigned)(now - stoppedAt));
+  TEST_MESSAGE(line);
+  // The bucket bounds the whole run, flood and drain.
+  TEST_ASSERT_LESS_OR_EQUAL(BURST + RATE_PER_SEC * now / 1000 + 1, panel.switches);
+  // At most one command per relay is ever waiting.
+  TEST_ASSERT_LESS_OR_EQUAL(PINS * 1000 / RATE_PER_SEC + DWELL_MS, now - stoppedAt);
+}
+
+// A 32-relay scene lands while a command flood has the command bucket empty:
+// it switches at once from its own budget, and the flood does not get more.
+void test_scene_has_its_own_budget(void) {
+  Admission admission(DWELL_MS, BURST, RATE_PER_SEC, SCENE_BURST, SCENE_RATE_PER_SEC);
+  uint32_t now = 1000;
+  int commands = 0;
+  for (int pin = 100; pin < 164; pin++) commands += admission.admit((uint8_t)pin, true, now);
+  TEST_ASSERT_EQUAL(BURST, commands);
+  int scene = 0;
+  for (int pin = 0; pin < 32; pin++) scene += admission.admit((uint8_t)pin, true, now, ADMIT_SCENE);
+  TEST_ASSERT_EQUAL(SCENE_BURST, scene);
+  TEST_ASSERT_FALSE(admission.admit(40, true, now, ADMIT_SCENE));
+
+  // Waiting scene actions are released from the scene bucket, commands from
+  // theirs, each at its own rate.
+  uint8_t pin;
+  bool level;
+  int released[2] = { 0, 0 };
+  for (now = 1001; now <= 2000; now++) {
+    while (admission.release(now, pin, level)) released[pin == 40 ? 1 : 0]++;
+  }
+  TEST_ASSERT_EQUAL(1, released[1]);
+  TEST_ASSERT_LESS_OR_EQUAL(RATE_PER_SEC, released[0]);
+  TEST_ASSERT_EQUAL(SCENE_BURST, admission.burst(ADMIT_SCENE));
+  TEST_ASSERT_EQUAL(RATE_PER_SEC, admission.rate());
+}
+
+// The same flood from several threads under one lock, the way the stream,
+// LAN and scene handlers share appliancesLock, with a loop() thread releasing.
+void test_concurrent_flood_converges(void) {
+  Admission admission(DWELL_MS, BURST, RATE_PER_SEC, SCENE_BURST, SCENE_RATE_PER_SEC);
+  Panel panel;
+  std::mutex lock;
+  std::vector<bool> wanted(PINS);
+  auto start = std::chrono::steady_clock::now();
+  auto millis = [&] {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() + 1;
+  };
+
+  std::atomic<bool> flooding(true);
+  std::thread loop([&] {
+    while (flooding) {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if (admission.pendingCount()) releaseAll(admission, panel, millis());
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  std::vector<std::thread> senders;
+  std::atomic<uint32_t> commands(0);
+  for (int t = 0; t < 4; t++) {
+    senders.emplace_back([&, t] {
+      std::mt19937 local(t);
+      for (int i = 0; i < 20000; i++) {
+        // Each sender owns 16 relays, so the last level asked for is known.
+        uint8_t pin = (uint8_t)(t * 16 + local() % 16);
+        bool level = local() & 1;
+        std::lock_guard<std::mutex> guard(lock);
+        wanted[pin] = level;
+        uint32_t now = millis();
+        if (admission.admit(pin, level, now)) panel.drive({ pin, level, now });
+        commands++;
+      }
+    });
+  }
+  for (auto& sender : senders) sender.join();
+  flooding = false;
+  loop.join();
+
+  uint32_t now = millis();
+  while (admission.pendingCount()) releaseAll(admission, panel, ++now);
+  for (int pin = 0; pin < PINS; pin++) TEST_ASSERT_EQUAL(wanted[pin], panel.level[pin]);
+  char line[120];
+  snprintf(line, sizeof(line), "%u commands from 4 threads -> %u switches", (unsigned)commands.load(),
+           (unsigned)panel.switches);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_waiting_commands_coalesce_and_cancel);
+  RUN_TEST(test_flood_respects_dwell_and_rate);
+  RUN_TEST(test_scene_has_its_own_budget);
+  RUN_TEST(test_concurrent_flood_converges);
+  return UNITY_END();
+}
@@ -0,0 +1,108 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "body_buffer.h"
+
+// Bodies split the way lwIP and AsyncWebServer split them: any chunk size,
+// including empty chunks, must assemble to the same bytes.
+
+static std::mt19937 rng(0xA17A);
+
+static std::vector<uint8_t> randomBody(size_t length) {
+  std::vector<uint8_t> body(length);
+  for (auto& byte : body) byte = (uint8_t)(1 + rng() % 255);
+  return body;
+}
+
+// Splits body into random chunk sizes between 0 and maxChunk.
+static std::vector<size_t> randomCuts(size_t length, size_t maxChunk) {
+  std::vector<size_t> cuts;
+  size_t at = 0;
+  while (at < length) {
+    size_t len = std::min(length - at, (size_t)(rng() % (maxChunk + 1)));
+    cuts.push_back(len);
+    at += len;
+  }
+  return cuts;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_fragmented_bodies_assemble(void) {
+  for (int round = 0; round < 5000; round++) {
+    size_t length = 1 + rng() % 2048;
+    std::vector<uint8_t> body = randomBody(length);
+    std::vector<size_t> cuts = randomCuts(length, 1 + rng() % 600);
+    void* slot = nullptr;
+    size_t at = 0;
+    for (size_t len : cuts) {
+      TEST_ASSERT_TRUE(BodyBuffer::statusOf(slot) == BODY_NONE || BodyBuffer::statusOf(slot) == BODY_PARTIAL);
+      BodyBuffer::append(slot, body.data() + at, len, at, length, 4096);
+      at += len;
+    }
+    TEST_ASSERT_EQUAL(BODY_COMPLETE, BodyBuffer::statusOf(slot));
+    BodyBuffer* buffer = static_cast<BodyBuffer*>(slot);
+    TEST_ASSERT_EQUAL(length, buffer->received);
+    TEST_ASSERT_EQUAL_MEMORY(body.data(), buffer->data(), length);
+    TEST_ASSERT_EQUAL(0, buffer->data()[length]);
+    free(slot);
+  }
+}
+
+void test_out_of_order_or_overlong_chunks_are_rejected(void) {
+  for (int round = 0; round < 5000; round++) {
+    size_t length = 8 + rng() % 1024;
+    std::vector<uint8_t> body = randomBody(length);
+    void* slot = nullptr;
+    size_t first = 1 + rng() % (length / 2);
+    BodyBuffer::append(slot, body.data(), first, 0, length, 4096);
+    switch (rng() % 3) {
+      case 0:  // a chunk skipped
+        BodyBuffer::append(slot, body.data() + first + 1, 1, first + 1, length, 4096);
+        break;
+      case 1:  // a chunk repeated
+        BodyBuffer::append(slot, body.data(), first, 0, length, 4096);
+        break;
+      default:  // more bytes than the declared total
+        BodyBuffer::append(slot, body.data() + first, length - first + 1, first, length, 4096);
+        break;
+    }
+    TEST_ASSERT_EQUAL(BODY_BAD_CHUNK, BodyBuffer::statusOf(slot));
+    // Nothing after a bad chunk revives the body.
+    BodyBuffer::append(slot, body.data() + first, length - first, first, length, 4096);
+    TEST_ASSERT_EQUAL(BODY_BAD_CHUNK, BodyBuffer::statusOf(slot));
+    free(slot);
+  }
+}
+
+void test_bodies_over_the_limit_are_not_buffered(void) {
+  std::vector<uint8_t> body = randomBody(300);
+  void* slot = nullptr;
+  for (size_t at = 0; at < body.size(); at += 100) {
+    BodyBuffer::append(slot, body.data() + at, 100, at, body.size(), 256);
+  }
+  TEST_ASSERT_EQUAL(BODY_TOO_LARGE, BodyBuffer::statusOf(slot));
+  TEST_ASSERT_EQUAL(0, static_cast<BodyBuffer*>(slot)->received);
+  free(slot);
+}
+
+void test_no_body_and_exact_limit(void) {
+  TEST_ASSERT_EQUAL(BODY_NONE, BodyBuffer::statusOf(nullptr));
+  std::vector<uint8_t> body = randomBody(256);
+  void* slot = nullptr;
+  BodyBuffer::append(slot, body.data(), body.size(), 0, body.size(), 256);
+  TEST_ASSERT_EQUAL(BODY_COMPLETE, BodyBuffer::statusOf(slot));
+  free(slot);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fragmented_bodies_assemble);
+  RUN_TEST(test_out_of_order_or_overlong_chunks_are_rejected);
+  RUN_TEST(test_bodies_over_the_limit_are_not_buffered);
+  RUN_TEST(test_no_body_and_exact_limit);
+  return UNITY_END();
+}
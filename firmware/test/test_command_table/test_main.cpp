@@ -0,0 +1,107 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "command_table.h"
+
+// CommandTable dispatch against the strcmp chain it replaced, with the
+// commands main.cpp registers and with tables as full as the probe window
+// allows. The table's cost stays flat as commands are added; the chain's
+// grows with them. At main.cpp's four commands the two cost about the same
+// (hashing the whole type against a few strcmp calls that mostly stop at
+// the first byte), so the table only pays off as the command set grows.
+
+typedef int (*Handler)(int);
+
+static int handlerA(int x) { return x + 1; }
+static int handlerB(int x) { return x + 2; }
+static int handlerC(int x) { return x + 3; }
+static int handlerD(int x) { return x + 4; }
+
+static const char* kRegistered[] = { "reboot", "reload_config", "set_states", "diagnostics" };
+
+// Payload types as they arrive: parsed out of the JSON into their own buffer.
+static std::vector<std::string> arrivals(const std::vector<std::string>& types, size_t count) {
+  std::vector<std::string> out;
+  for (size_t i = 0; i < count; i++) out.push_back(types[(i * 7) % types.size()]);
+  return out;
+}
+
+static const char* chainDispatch(const std::vector<std::string>& types, const char* type) {
+  for (const auto& candidate : types) {
+    if (strcmp(candidate.c_str(), type) == 0) return candidate.c_str();
+  }
+  return nullptr;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_registered_commands(void) {
+  CommandTable<Handler> table;
+  TEST_ASSERT_TRUE(table.add("reboot", 1, handlerA));
+  TEST_ASSERT_TRUE(table.add("reload_config", 1, handlerB));
+  TEST_ASSERT_TRUE(table.add("set_states", 2, handlerC));
+  TEST_ASSERT_TRUE(table.add("diagnostics", 1, handlerD));
+  TEST_ASSERT_FALSE(table.add("reboot", 1, handlerD));
+
+  std::string type = "set_states";  // not the literal it was added with
+  const CommandTable<Handler>::Entry* entry = table.find(type.c_str());
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(2, entry->maxVersion);
+  TEST_ASSERT_EQUAL(13, entry->handler(10));
+  TEST_ASSERT_NULL(table.find("set_state"));
+  TEST_ASSERT_NULL(table.find(""));
+  TEST_ASSERT_NULL(table.find(nullptr));
+}
+
+void test_benchmark_dispatch(void) {
+  const size_t sizes[] = { 4, 16, 24 };
+  double tableNs[3], chainNs[3];
+  for (int s = 0; s < 3; s++) {
+    // Fill with main.cpp's commands, then generated ones up to the size.
+    CommandTable<Handler> table;
+    std::vector<std::string> types(kRegistered, kRegistered + 4);
+    for (int n = 0; types.size() < sizes[s]; n++) types.push_back("command_" + std::to_string(n));
+    std::vector<std::string> added;
+    for (const auto& type : types) {
+      if (table.add(type.c_str(), 1, handlerA)) added.push_back(type);
+    }
+    // The table keeps pointers into `types`; lookups use separate copies.
+    std::vector<std::string> incoming = arrivals(added, 4096);
+
+    const int rounds = 100;
+    volatile size_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      for (const auto& type : incoming) hits = hits + (table.find(type.c_str()) != nullptr);
+    }
+    tableNs[s] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                 (rounds * incoming.size());
+    TEST_ASSERT_EQUAL(rounds * incoming.size(), hits);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      for (const auto& type : incoming) hits = hits + (chainDispatch(added, type.c_str()) != nullptr);
+    }
+    chainNs[s] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                     (rounds * incoming.size());
+    char line[120];
+    snprintf(line, sizeof(line), "%2u commands (%2u fit): table %5.1f ns, strcmp chain %6.1f ns per dispatch",
+             (unsigned)types.size(), (unsigned)added.size(), tableNs[s], chainNs[s]);
+    TEST_MESSAGE(line);
+  }
+  // Six times the commands, about the same lookup cost.
+  TEST_ASSERT_LESS_THAN(tableNs[0] * 4 + 20, tableNs[2]);
+  // No win is claimed at 4 commands; with a full table the chain falls behind.
+  TEST_ASSERT_LESS_THAN(chainNs[2], tableNs[2]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_registered_commands);
+  RUN_TEST(test_benchmark_dispatch);
+  return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "config_diff.h"
+
+// diffConfig() against a map-based reference on random configs, then timed on
+// configs far larger than a controller carries to show it stays O(n log n).
+
+struct Entry {
+  int pin;
+  std::string name;
+  std::string type;
+};
+
+static std::mt19937 rng(0xC0F16);
+static const char* kTypes[] = { "Light", "Fan", "Socket", "Dimmer" };
+
+// The running list never repeats a pin: reloads only keep the first entry.
+static std::vector<Entry> randomConfig(size_t count, int pins) {
+  std::vector<int> pool(pins);
+  for (int pin = 0; pin < pins; pin++) pool[pin] = pin;
+  std::shuffle(pool.begin(), pool.end(), rng);
+  std::vector<Entry> list;
+  for (size_t i = 0; i < count && i < pool.size(); i++) {
+    list.push_back({ pool[i], "Appliance " + std::to_string(rng() % 8), kTypes[rng() % 4] });
+  }
+  return list;
+}
+
+// A reload as the app makes it: some entries renamed, retyped, dropped, added.
+static std::vector<Entry> edit(const std::vector<Entry>& running, int pins) {
+  std::vector<Entry> wanted;
+  for (const auto& entry : running) {
+    uint32_t roll = rng() % 100;
+    if (roll < 5) continue;
+    Entry copy = entry;
+    if (roll < 10) copy.name += " (moved)";
+    else if (roll < 13) copy.type = kTypes[rng() % 4];
+    wanted.push_back(copy);
+  }
+  for (size_t i = 0; i < running.size() / 20 + 1; i++) wanted.push_back({ (int)(rng() % pins), "New", "Light" });
+  std::shuffle(wanted.begin(), wanted.end(), rng);
+  return wanted;
+}
+
+// First entry per pin, which is what diffConfig() pairs on.
+static std::map<int, size_t> firstByPin(const std::vector<Entry>& list) {
+  std::map<int, size_t> first;
+  for (size_t i = 0; i < list.size(); i++) first.insert({ list[i].pin, i });
+  return first;
+}
+
+static void checkAgainstReference(const std::vector<Entry>& running, const std::vector<Entry>& wanted,
+                                  const std::vector<ConfigChange>& changes) {
+  std::map<int, size_t> from = firstByPin(running);
+  std::map<int, size_t> to = firstByPin(wanted);
+  std::map<int, bool> seen;
+  for (const auto& change : changes) {
+    int pin = change.from != ConfigChange::kNone ? running[change.from].pin : wanted[change.to].pin;
+    TEST_ASSERT_FALSE(seen[pin]);
+    seen[pin] = true;
+    bool wasThere = from.count(pin) != 0;
+    bool isThere = to.count(pin) != 0;
+    if (!isThere) {
+      TEST_ASSERT_EQUAL(CONFIG_REMOVED, change.edits);
+      TEST_ASSERT_EQUAL(ConfigChange::kNone, change.to);
+    } else if (!wasThere) {
+      TEST_ASSERT_EQUAL(CONFIG_ADDED, change.edits);
+      TEST_ASSERT_EQUAL(to[pin], change.to);
+    } else {
+      TEST_ASSERT_EQUAL(to[pin], change.to);
+      const Entry& a = running[change.from];
+      const Entry& b = wanted[change.to];
+      uint8_t edits = (a.name != b.name ? CONFIG_RENAMED : 0) | (a.type != b.type ? CONFIG_RETYPED : 0);
+      TEST_ASSERT_EQUAL(edits, change.edits);
+    }
+  }
+  std::map<int, bool> all;
+  for (const auto& entry : from) all[entry.first] = true;
+  for (const auto& entry : to) all[entry.first] = true;
+  TEST_ASSERT_EQUAL(all.size(), changes.size());
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_matches_reference_on_random_reloads(void) {
+  std::vector<ConfigChange> changes;
+  for (int round = 0; round < 2000; round++) {
+    std::vector<Entry> running = randomConfig(rng() % 40, 48);
+    std::vector<Entry> wanted = edit(running, 48);
+    diffConfig(running, wanted, changes);
+    checkAgainstReference(running, wanted, changes);
+  }
+}
+
+void test_identical_config_is_all_kept(void) {
+  std::vector<Entry> running = randomConfig(64, 1000);
+  std::vector<ConfigChange> changes;
+  diffConfig(running, running, changes);
+  for (const auto& change : changes) TEST_ASSERT_EQUAL(CONFIG_KEPT, change.edits);
+}
+
+void test_benchmark_large_configs(void) {
+  std::vector<ConfigChange> changes;
+  double perEntry[3] = { 0, 0, 0 };
+  const size_t sizes[] = { 64, 4096, 65536 };
+  for (int s = 0; s < 3; s++) {
+    size_t n = sizes[s];
+    std::vector<Entry> running = randomConfig(n, (int)(n * 4));
+    std::vector<Entry> wanted = edit(running, (int)(n * 4));
+    int rounds = (int)(262144 / n);
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) diffConfig(running, wanted, changes);
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+    perEntry[s] = us * 1000 / n;
+    char line[120];
+    snprintf(line, sizeof(line), "%6u appliances: %9.1f us per diff, %5.0f ns per entry", (unsigned)n, us, perEntry[s]);
+    TEST_MESSAGE(line);
+  }
+  // 1000x the entries may cost a few times more per entry (log n), not 1000x.
+  TEST_ASSERT_LESS_THAN(perEntry[0] * 20 + 200, perEntry[2]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_reference_on_random_reloads);
+  RUN_TEST(test_identical_config_is_all_kept);
+  RUN_TEST(test_benchmark_large_configs);
+  return UNITY_END();
+}
@@ -0,0 +1,124 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include "dimmer.h"
+
+// The compile-time CIE 1931 duty table and the ramps DimmerFade hands the
+// LEDC fade engine: every fade ends on the target duty after exactly its
+// duration, no ramp runs longer than the cap, and the light never strays more
+// than the tolerance from the curve at any ramp end.
+
+static std::mt19937 rng(0xD1A);
+
+// L* -> relative luminance, computed at run time to check the table against.
+static double referenceLuminance(double lightness) {
+  return lightness <= 8.0 ? lightness / 903.3 : pow((lightness + 16.0) / 116.0, 3);
+}
+
+struct FadeRun {
+  uint32_t ramps = 0;
+  uint32_t totalMs = 0;
+  uint16_t lastDuty = 0;
+};
+
+static FadeRun runFade(DimmerFade& fade, uint8_t from, uint8_t to, uint32_t durationMs) {
+  FadeRun run;
+  fade.start(from, to, durationMs);
+  uint16_t duty;
+  uint32_t ms;
+  while (fade.next(duty, ms)) {
+    TEST_ASSERT_LESS_OR_EQUAL(DIMMER_MAX_RAMP_MS, ms);
+    run.totalMs += ms;
+    run.ramps++;
+    run.lastDuty = duty;
+    // On the curve, give or take the tolerance, at the level reached (which
+    // level() rounds to the nearest whole one)...
+    int reached = fade.level();
+    int below = reached - DIMMER_FADE_TOLERANCE - 1;
+    int above = reached + DIMMER_FADE_TOLERANCE + 1;
+    TEST_ASSERT_GREATER_OR_EQUAL(dimmerDuty((uint8_t)(below < 0 ? 0 : below)), duty);
+    TEST_ASSERT_LESS_OR_EQUAL(dimmerDuty((uint8_t)(above > 100 ? 100 : above)), duty);
+    // ...and that level is where the fade should be by now, once ramps are
+    // long enough that whole-millisecond timing does not blur it.
+    uint32_t span = from > to ? from - to : to - from;
+    if (durationMs < 4 * span) continue;
+    double expected = from + ((double)to - from) * run.totalMs / durationMs;
+    int low = (int)floor(expected) - DIMMER_FADE_TOLERANCE;
+    int high = (int)ceil(expected) + DIMMER_FADE_TOLERANCE;
+    TEST_ASSERT_GREATER_OR_EQUAL(dimmerDuty((uint8_t)(low < 0 ? 0 : low)), duty);
+    TEST_ASSERT_LESS_OR_EQUAL(dimmerDuty((uint8_t)(high > 100 ? 100 : high)), duty);
+  }
+  TEST_ASSERT_FALSE(fade.active());
+  TEST_ASSERT_EQUAL(to, fade.level());
+  return run;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_table_follows_cie_lightness(void) {
+  TEST_ASSERT_EQUAL(0, dimmerDuty(0));
+  TEST_ASSERT_EQUAL(DIMMER_DUTY_MAX, dimmerDuty(100));
+  TEST_ASSERT_EQUAL(DIMMER_DUTY_MAX, dimmerDuty(250));  // clamped
+  for (int level = 0; level < DIMMER_LEVELS; level++) {
+    uint16_t expected = (uint16_t)(referenceLuminance(level) * DIMMER_DUTY_MAX + 0.5);
+    TEST_ASSERT_EQUAL(expected, dimmerDuty((uint8_t)level));
+    if (level) TEST_ASSERT_GREATER_THAN(dimmerDuty((uint8_t)(level - 1)), dimmerDuty((uint8_t)level));
+  }
+  // Half lightness is under a fifth of the power.
+  TEST_ASSERT_LESS_THAN(DIMMER_DUTY_MAX / 5, dimmerDuty(50));
+}
+
+void test_full_range_fade_takes_a_handful_of_ramps(void) {
+  DimmerFade fade;
+  fade.reset(0);
+  FadeRun up = runFade(fade, 0, 100, 1000);
+  TEST_ASSERT_EQUAL(1000, up.totalMs);
+  TEST_ASSERT_EQUAL(DIMMER_DUTY_MAX, up.lastDuty);
+  FadeRun down = runFade(fade, 100, 0, 1000);
+  TEST_ASSERT_EQUAL(1000, down.totalMs);
+  TEST_ASSERT_EQUAL(0, down.lastDuty);
+  char line[96];
+  snprintf(line, sizeof(line), "0->100 in 1 s: %u ramps; 100->0: %u ramps (one write per level: 100)",
+           (unsigned)up.ramps, (unsigned)down.ramps);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN(40, up.ramps);
+}
+
+void test_instant_and_empty_fades(void) {
+  DimmerFade fade;
+  FadeRun instant = runFade(fade, 20, 80, 0);
+  TEST_ASSERT_EQUAL(1, instant.ramps);
+  TEST_ASSERT_EQUAL(0, instant.totalMs);
+  TEST_ASSERT_EQUAL(dimmerDuty(80), instant.lastDuty);
+  FadeRun same = runFade(fade, 40, 40, 500);
+  TEST_ASSERT_EQUAL(1, same.ramps);
+  TEST_ASSERT_EQUAL(dimmerDuty(40), same.lastDuty);
+}
+
+void test_random_fades(void) {
+  DimmerFade fade;
+  uint32_t ramps = 0;
+  for (int round = 0; round < 2000; round++) {
+    uint8_t from = rng() % DIMMER_LEVELS;
+    uint8_t to = rng() % DIMMER_LEVELS;
+    uint32_t duration = rng() % 3000;
+    FadeRun run = runFade(fade, from, to, duration);
+    TEST_ASSERT_EQUAL(from == to ? 0 : duration, run.totalMs);
+    TEST_ASSERT_EQUAL(dimmerDuty(to), run.lastDuty);
+    ramps += run.ramps;
+  }
+  char line[64];
+  snprintf(line, sizeof(line), "%.1f ramps per random fade", ramps / 2000.0);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_table_follows_cie_lightness);
+  RUN_TEST(test_full_range_fade_takes_a_handful_of_ramps);
+  RUN_TEST(test_instant_and_empty_fades);
+  RUN_TEST(test_random_fades);
+  return UNITY_END();
+}
@@ -0,0 +1,225 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "heartbeat.h"
+
+// Heartbeat as main.cpp drives it: loop() sends a beat whenever due() and
+// no resync is pending, state writes piggyback, and a stream drop calls
+// disrupted(). The app calls a controller offline once the interval its
+// last beat announced, plus 30 s of slack, has passed since the last beat
+// or state write.
+
+#define MIN_MS 30000
+#define MAX_MS 240000
+#define WEAK_RSSI -80
+#define APP_SLACK_MS 30000
+#define DAY_MS 86400000u
+#define TICK_MS 100
+
+static Heartbeat fresh() { return Heartbeat(MIN_MS, MAX_MS, WEAK_RSSI); }
+
+// Sends the beat due at or after |from|; returns when it went out.
+static uint32_t beatWhenDue(Heartbeat& hb, uint32_t from, int8_t rssi = -55) {
+  uint32_t now = from;
+  while (!hb.due(now)) now += TICK_MS;
+  hb.plan(rssi);
+  hb.sent(now);
+  return now;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_interval_grows_while_quiet(void) {
+  Heartbeat hb = fresh();
+  // The boot status write carries the first beat, at the short interval.
+  TEST_ASSERT_EQUAL(MIN_MS, hb.plan(-55));
+  hb.sent(1000);
+  uint32_t now = 1000;
+  const uint32_t expected[] = { 60000, 120000, 240000, 240000, 240000 };
+  for (uint32_t next : expected) {
+    uint32_t previous = now;
+    uint32_t announced = hb.interval();
+    TEST_ASSERT_FALSE(hb.due(previous + announced - 1));
+    now = beatWhenDue(hb, previous);
+    TEST_ASSERT_EQUAL(previous + announced, now);
+    TEST_ASSERT_EQUAL(next, hb.interval());
+  }
+  TEST_ASSERT_EQUAL(6, hb.standaloneCount());
+}
+
+void test_state_writes_stand_in_for_beats(void) {
+  Heartbeat hb = fresh();
+  hb.plan(-55);
+  hb.sent(0);
+  uint32_t now = beatWhenDue(hb, 0);
+  TEST_ASSERT_EQUAL(60000, hb.interval());
+
+  // A write every 20 s keeps resetting the clock: no beat until the status
+  // is MAX_MS old, and that beat does not grow the interval.
+  for (now += 20000; !hb.due(now); now += 20000) hb.piggybacked(now);
+  TEST_ASSERT_EQUAL(30000 + MAX_MS, now);
+  TEST_ASSERT_EQUAL(60000, hb.plan(-55));
+  hb.sent(now);
+  TEST_ASSERT_EQUAL(11, hb.piggybackedCount());
+  TEST_ASSERT_EQUAL(3, hb.standaloneCount());
+
+  // Quiet again, it resumes doubling.
+  beatWhenDue(hb, now);
+  TEST_ASSERT_EQUAL(120000, hb.interval());
+}
+
+void test_disrupted_snaps_back(void) {
+  Heartbeat hb = fresh();
+  hb.plan(-55);
+  hb.sent(0);
+  uint32_t now = 0;
+  while (hb.interval() < MAX_MS) now = beatWhenDue(hb, now);
+  now += 5000;
+  TEST_ASSERT_FALSE(hb.due(now));
+
+  hb.disrupted();
+  // Owed right away, and announcing the short interval.
+  TEST_ASSERT_TRUE(hb.due(now));
+  TEST_ASSERT_EQUAL(MIN_MS, hb.plan(-55));
+  hb.sent(now);
+  TEST_ASSERT_FALSE(hb.due(now + MIN_MS - 1));
+  TEST_ASSERT_TRUE(hb.due(now + MIN_MS));
+  // The next quiet beat doubles again.
+  beatWhenDue(hb, now);
+  TEST_ASSERT_EQUAL(2 * MIN_MS, hb.interval());
+}
+
+void test_weak_signal_and_failed_writes_keep_it_short(void) {
+  Heartbeat hb = fresh();
+  hb.plan(-55);
+  hb.sent(0);
+  uint32_t now = beatWhenDue(hb, 0);
+  TEST_ASSERT_EQUAL(60000, hb.interval());
+  for (int i = 0; i < 5; i++) now = beatWhenDue(hb, now, -85);
+  TEST_ASSERT_EQUAL(MIN_MS, hb.interval());
+
+  now = beatWhenDue(hb, now);
+  TEST_ASSERT_EQUAL(60000, hb.interval());
+  while (!hb.due(now)) now += TICK_MS;
+  hb.plan(-55);
+  hb.failed(now);
+  // Retried after MIN_MS, announcing MIN_MS.
+  TEST_ASSERT_FALSE(hb.due(now + MIN_MS - 1));
+  TEST_ASSERT_TRUE(hb.due(now + MIN_MS));
+  TEST_ASSERT_EQUAL(MIN_MS, hb.plan(-55));
+}
+
+struct Profile {
+  const char* name;
+  uint32_t meanWriteGapMs;   // 0: never writes state
+  bool weakHalfTheTime;
+};
+
+struct Day {
+  uint32_t beats = 0;
+  uint32_t writes = 0;
+  uint32_t drops = 0;
+  uint32_t lateProofs = 0;   // past the announced interval, within the slack
+  uint32_t maxOvershootMs = 0;
+};
+
+// One controller over a day in TICK_MS steps. A stream drop about every
+// 8 h leaves beats off for the 2-10 s the resync takes.
+static Day simulateDay(const Profile& profile, std::mt19937& rng) {
+  Heartbeat hb = fresh();
+  Day day;
+  uint32_t lastProof = 0;
+  uint32_t announced = hb.plan(-55);
+  hb.sent(0);
+  day.beats++;
+  uint32_t resyncUntil = 0;
+  const uint32_t dropEvery = 8 * 3600000 / TICK_MS;
+  const uint32_t writeEvery = profile.meanWriteGapMs / TICK_MS;
+
+  auto proof = [&](uint32_t now) {
+    uint32_t gap = now - lastProof;
+    if (gap > announced) {
+      day.lateProofs++;
+      day.maxOvershootMs = std::max(day.maxOvershootMs, gap - announced);
+    }
+    lastProof = now;
+  };
+
+  for (uint32_t now = TICK_MS; now < DAY_MS; now += TICK_MS) {
+    int8_t rssi = profile.weakHalfTheTime && (now / 3600000) % 2 ? -85 : -55;
+    if (rng() % dropEvery == 0) {
+      hb.disrupted();
+      day.drops++;
+      resyncUntil = now + 2000 + rng() % 8000;
+    }
+    bool resyncing = (int32_t)(resyncUntil - now) > 0;
+    if (writeEvery && !resyncing && rng() % writeEvery == 0) {
+      proof(now);
+      hb.piggybacked(now);
+      day.writes++;
+    }
+    if (!resyncing && hb.due(now)) {
+      proof(now);
+      announced = hb.plan(rssi);
+      hb.sent(now);
+      day.beats++;
+    }
+  }
+  TEST_ASSERT_EQUAL(day.beats, hb.standaloneCount());
+  return day;
+}
+
+void test_writes_per_day_are_bounded(void) {
+  const Profile profiles[] = {
+    { "idle", 0, false },
+    { "light", 1800000, false },
+    { "busy", 20000, false },
+    { "idle, weak half the day", 0, true },
+  };
+  // Quiet and healthy: one beat per MAX_MS, plus at most 4 for the climb
+  // back from MIN_MS after boot and after each drop. A weak hour beats every
+  // MIN_MS and every healthy hour after it climbs again. A busy controller
+  // only climbs through quiet intervals, so after a drop it keeps MIN_MS and
+  // beats in each quiet MIN_MS gap between writes; it is held to the hard
+  // bound of one beat per MIN_MS.
+  const uint32_t healthyBeats = DAY_MS / MAX_MS;
+  const uint32_t weakBeats = DAY_MS / 2 / MIN_MS + DAY_MS / 2 / MAX_MS + 4 * 12;
+  std::mt19937 rng(0x4EA7);
+  for (const Profile& profile : profiles) {
+    const int controllers = 20;
+    double total = 0;
+    uint32_t most = 0, writes = 0, late = 0, maxOvershootMs = 0;
+    for (int i = 0; i < controllers; i++) {
+      Day day = simulateDay(profile, rng);
+      uint32_t bound = profile.meanWriteGapMs && profile.meanWriteGapMs < MAX_MS ? DAY_MS / MIN_MS
+                       : (profile.weakHalfTheTime ? weakBeats : healthyBeats) + 4 * (day.drops + 1);
+      TEST_ASSERT_LESS_OR_EQUAL(bound, day.beats);
+      // Only a resync can hold a beat past its deadline, never past the slack.
+      TEST_ASSERT_LESS_THAN(APP_SLACK_MS, day.maxOvershootMs);
+      total += day.beats;
+      most = std::max(most, day.beats);
+      writes = std::max(writes, day.writes);
+      late += day.lateProofs;
+      maxOvershootMs = std::max(maxOvershootMs, day.maxOvershootMs);
+    }
+    char line[200];
+    snprintf(line, sizeof(line),
+             "%s: %.0f beats/day on average, %u at most, up to %u state writes; %u proofs late, by %u ms at most",
+             profile.name, total / controllers, most, writes, late, maxOvershootMs);
+    TEST_MESSAGE(line);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_interval_grows_while_quiet);
+  RUN_TEST(test_state_writes_stand_in_for_beats);
+  RUN_TEST(test_disrupted_snaps_back);
+  RUN_TEST(test_weak_signal_and_failed_writes_keep_it_short);
+  RUN_TEST(test_writes_per_day_are_bounded);
+  return UNITY_END();
+}
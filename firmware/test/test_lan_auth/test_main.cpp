@@ -0,0 +1,291 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "lan_auth.h"
+
+// Session opening, request signing and the replay window as a client (the
+// app, load_test.py) drives them, with main.cpp's session limits, and the
+// cost per signed request on the host.
+
+#define IDLE_MS 600000
+#define LIFETIME_MS 3600000
+
+static const char kKey[] = "0123456789abcdef0123456789abcdef";
+
+static void fill(uint8_t* out, size_t len, uint8_t seed) {
+  for (size_t i = 0; i < len; i++) out[i] = (uint8_t)(seed * 31 + i * 7);
+}
+
+// What a client sends and expects back, computed with the one-shot HMAC.
+struct Client {
+  uint8_t challenge[LanAuth::kNonceLength];
+  uint8_t nonce[LanAuth::kNonceLength];
+  uint8_t proof[kHmacLength];
+  uint8_t sessionKey[kHmacLength];
+  uint32_t id = 0;
+  uint64_t counter = 0;
+
+  explicit Client(uint8_t seed) {
+    fill(challenge, sizeof(challenge), seed);
+    fill(nonce, sizeof(nonce), (uint8_t)(seed + 100));
+    std::string open = "aura-open";
+    open.append((const char*)challenge, sizeof(challenge));
+    open.append((const char*)nonce, sizeof(nonce));
+    hmacSha256((const uint8_t*)kKey, sizeof(kKey) - 1, (const uint8_t*)open.data(), open.size(), proof);
+    std::string session = "aura-session";
+    session.append((const char*)nonce, sizeof(nonce));
+    session.append((const char*)challenge, sizeof(challenge));
+    hmacSha256((const uint8_t*)kKey, sizeof(kKey) - 1, (const uint8_t*)session.data(), session.size(), sessionKey);
+  }
+
+  bool open(LanAuth& auth, uint32_t now) {
+    uint8_t serverProof[kHmacLength];
+    if (!auth.open(challenge, nonce, proof, now, id, serverProof)) return false;
+    uint8_t expected[kHmacLength];
+    hmacSha256(sessionKey, sizeof(sessionKey), (const uint8_t*)"aura-ready", 10, expected);
+    TEST_ASSERT_EQUAL_MEMORY(expected, serverProof, kHmacLength);
+    return true;
+  }
+
+  void sign(const char* method, const char* target, const std::string& body, uint64_t n, uint8_t mac[kHmacLength]) {
+    char head[160];
+    snprintf(head, sizeof(head), "%s\n%s\n%llu\n", method, target, (unsigned long long)n);
+    std::string message = head + body;
+    hmacSha256(sessionKey, sizeof(sessionKey), (const uint8_t*)message.data(), message.size(), mac);
+  }
+
+  LanAuthResult request(LanAuth& auth, const char* method, const char* target, const std::string& body,
+                        uint32_t now) {
+    uint8_t mac[kHmacLength];
+    sign(method, target, body, ++counter, mac);
+    return auth.verify(id, counter, method, target, body.data(), body.size(), mac, now);
+  }
+};
+
+static LanAuth* auth;
+
+void setUp(void) {
+  auth = new LanAuth(IDLE_MS, LIFETIME_MS);
+  auth->seed(0x1234);
+  TEST_ASSERT_TRUE(auth->setKey((const uint8_t*)kKey, sizeof(kKey) - 1));
+}
+
+void tearDown(void) {
+  delete auth;
+}
+
+void test_open_needs_a_fresh_challenge(void) {
+  Client client(1);
+  // Never issued.
+  TEST_ASSERT_FALSE(client.open(*auth, 1000));
+  auth->issue(client.challenge, 1000);
+
+  // A wrong proof is refused and does not spend the challenge.
+  Client forged(1);
+  forged.proof[5] ^= 0x20;
+  TEST_ASSERT_FALSE(forged.open(*auth, 1001));
+  TEST_ASSERT_TRUE(client.open(*auth, 1002));
+  TEST_ASSERT_EQUAL(LAN_AUTH_OK, client.request(*auth, "GET", "/toggle?pin=4", "", 1003));
+
+  // The same open again, as captured off the network.
+  TEST_ASSERT_FALSE(client.open(*auth, 1004));
+  TEST_ASSERT_EQUAL(1, auth->liveSessions(1004));
+
+  // Challenges last kChallengeMs.
+  Client late(2);
+  auth->issue(late.challenge, 2000);
+  TEST_ASSERT_FALSE(late.open(*auth, 2000 + LanAuth::kChallengeMs + 1));
+  Client onTime(3);
+  auth->issue(onTime.challenge, 2000);
+  TEST_ASSERT_TRUE(onTime.open(*auth, 2000 + LanAuth::kChallengeMs));
+
+  // The oldest outstanding challenge makes room for a new one.
+  std::vector<Client> waiting;
+  for (int i = 0; i <= (int)LanAuth::kChallenges; i++) {
+    waiting.emplace_back((uint8_t)(10 + i));
+    auth->issue(waiting.back().challenge, 3000 + i);
+  }
+  TEST_ASSERT_FALSE(waiting[0].open(*auth, 3100));
+  TEST_ASSERT_TRUE(waiting[1].open(*auth, 3100));
+
+  // A new key forgets every challenge and session.
+  Client pending(40);
+  auth->issue(pending.challenge, 4000);
+  TEST_ASSERT_TRUE(auth->setKey((const uint8_t*)kKey, sizeof(kKey) - 1));
+  TEST_ASSERT_FALSE(pending.open(*auth, 4001));
+  TEST_ASSERT_EQUAL(LAN_AUTH_NO_SESSION, client.request(*auth, "GET", "/toggle?pin=4", "", 4001));
+}
+
+void test_tampered_requests_are_refused(void) {
+  Client client(1);
+  auth->issue(client.challenge, 0);
+  TEST_ASSERT_TRUE(client.open(*auth, 0));
+  std::string body = "{\"name\":\"evening\",\"actions\":[]}";
+  uint8_t mac[kHmacLength];
+  client.sign("POST", "/scene", body, 1, mac);
+  auto verify = [&](uint32_t id, uint64_t n, const char* method, const char* target, size_t length, uint32_t now) {
+    return auth->verify(id, n, method, target, body.data(), length, mac, now);
+  };
+  TEST_ASSERT_EQUAL(LAN_AUTH_BAD_MAC, verify(client.id, 1, "GET", "/scene", body.size(), 1));
+  TEST_ASSERT_EQUAL(LAN_AUTH_BAD_MAC, verify(client.id, 1, "POST", "/scene?x", body.size(), 1));
+  TEST_ASSERT_EQUAL(LAN_AUTH_BAD_MAC, verify(client.id, 1, "POST", "/scene", body.size() - 1, 1));
+  TEST_ASSERT_EQUAL(LAN_AUTH_BAD_MAC, verify(client.id, 2, "POST", "/scene", body.size(), 1));
+  TEST_ASSERT_EQUAL(LAN_AUTH_NO_SESSION, verify(client.id + 2, 1, "POST", "/scene", body.size(), 1));
+  mac[31] ^= 1;
+  TEST_ASSERT_EQUAL(LAN_AUTH_BAD_MAC, verify(client.id, 1, "POST", "/scene", body.size(), 1));
+  mac[31] ^= 1;
+  // The forgeries did not burn counter 1.
+  TEST_ASSERT_EQUAL(LAN_AUTH_OK, verify(client.id, 1, "POST", "/scene", body.size(), 1));
+  TEST_ASSERT_EQUAL(LAN_AUTH_REPLAYED, verify(client.id, 1, "POST", "/scene", body.size(), 2));
+}
+
+void test_replay_window_edges(void) {
+  ReplayWindow window;
+  TEST_ASSERT_FALSE(window.fresh(0));
+  TEST_ASSERT_TRUE(window.fresh(1));
+  window.mark(100);
+  TEST_ASSERT_FALSE(window.fresh(100));
+  TEST_ASSERT_TRUE(window.fresh(101));
+  TEST_ASSERT_TRUE(window.fresh(99));
+  TEST_ASSERT_TRUE(window.fresh(37));   // 63 behind: the window's last slot
+  TEST_ASSERT_FALSE(window.fresh(36));  // 64 behind: out of it
+  window.mark(37);
+  TEST_ASSERT_FALSE(window.fresh(37));
+  // Sliding by one keeps what was seen, one slot further back; 37 drops out.
+  window.mark(101);
+  TEST_ASSERT_FALSE(window.fresh(100));
+  TEST_ASSERT_FALSE(window.fresh(37));
+  TEST_ASSERT_TRUE(window.fresh(38));
+  // A jump of 64 or more forgets everything before it.
+  window.mark(165);
+  TEST_ASSERT_FALSE(window.fresh(101));
+  TEST_ASSERT_TRUE(window.fresh(102));
+  window.mark(10000);
+  TEST_ASSERT_FALSE(window.fresh(165));
+  TEST_ASSERT_TRUE(window.fresh(9999));
+}
+
+// Concurrent requests from one session arrive out of order.
+void test_out_of_order_counters(void) {
+  Client client(1);
+  auth->issue(client.challenge, 0);
+  TEST_ASSERT_TRUE(client.open(*auth, 0));
+  const uint64_t order[] = { 3, 1, 2, 70, 7, 6, 5, 4 };
+  for (uint64_t n : order) {
+    uint8_t mac[kHmacLength];
+    client.sign("GET", "/toggle?pin=2", "", n, mac);
+    // 7 is 63 behind 70, the last the window holds; 6 and older are out.
+    LanAuthResult expected = n >= 4 && n <= 6 ? LAN_AUTH_REPLAYED : LAN_AUTH_OK;
+    TEST_ASSERT_EQUAL(expected, auth->verify(client.id, n, "GET", "/toggle?pin=2", "", 0, mac, 10));
+  }
+}
+
+void test_least_recently_used_session_is_evicted(void) {
+  std::vector<Client> clients;
+  for (int i = 0; i < (int)LanAuth::kSessions; i++) {
+    clients.emplace_back((uint8_t)(i + 1));
+    auth->issue(clients.back().challenge, i);
+    TEST_ASSERT_TRUE(clients.back().open(*auth, i));
+  }
+  // All but client 3 are used again.
+  for (int i = 0; i < (int)LanAuth::kSessions; i++) {
+    if (i != 3) TEST_ASSERT_EQUAL(LAN_AUTH_OK, clients[i].request(*auth, "GET", "/toggle?pin=1", "", 100 + i));
+  }
+  Client newcomer(50);
+  auth->issue(newcomer.challenge, 200);
+  TEST_ASSERT_TRUE(newcomer.open(*auth, 200));
+  TEST_ASSERT_EQUAL(LanAuth::kSessions, auth->liveSessions(200));
+  TEST_ASSERT_EQUAL(LAN_AUTH_NO_SESSION, clients[3].request(*auth, "GET", "/toggle?pin=1", "", 201));
+  for (int i = 0; i < (int)LanAuth::kSessions; i++) {
+    if (i != 3) TEST_ASSERT_EQUAL(LAN_AUTH_OK, clients[i].request(*auth, "GET", "/toggle?pin=1", "", 202));
+  }
+}
+
+void test_sessions_expire(void) {
+  Client idle(1);
+  auth->issue(idle.challenge, 0);
+  TEST_ASSERT_TRUE(idle.open(*auth, 0));
+  TEST_ASSERT_EQUAL(LAN_AUTH_OK, idle.request(*auth, "GET", "/toggle?pin=1", "", IDLE_MS));
+  TEST_ASSERT_EQUAL(LAN_AUTH_EXPIRED, idle.request(*auth, "GET", "/toggle?pin=1", "", 2 * IDLE_MS + 1));
+  TEST_ASSERT_EQUAL(LAN_AUTH_NO_SESSION, idle.request(*auth, "GET", "/toggle?pin=1", "", 2 * IDLE_MS + 2));
+
+  Client busy(2);
+  auth->issue(busy.challenge, 0);
+  TEST_ASSERT_TRUE(busy.open(*auth, 0));
+  uint32_t now = 0;
+  for (; now <= LIFETIME_MS; now += IDLE_MS / 2) {
+    TEST_ASSERT_EQUAL(LAN_AUTH_OK, busy.request(*auth, "GET", "/toggle?pin=1", "", now));
+  }
+  TEST_ASSERT_EQUAL(LAN_AUTH_EXPIRED, busy.request(*auth, "GET", "/toggle?pin=1", "", now));
+}
+
+// What signing adds to a /toggle and to a 700-byte /scene on the host, with
+// the session key's pads hashed once at open() rather than per request.
+void test_benchmark_request_overhead(void) {
+  Client client(1);
+  auth->issue(client.challenge, 0);
+  TEST_ASSERT_TRUE(client.open(*auth, 0));
+  std::string scene = "{\"name\":\"evening\",\"delay_ms\":500,\"actions\":[";
+  while (scene.size() < 690) scene += "{\"mac\":\"24:6F:28:AA:BB:CC\",\"pin\":4,\"state\":\"ON\"},";
+  scene.back() = ']';
+  scene += "}";
+
+  struct Case { const char* method; const char* target; std::string body; };
+  const Case cases[] = { { "GET", "/toggle?pin=4", "" }, { "POST", "/scene", scene } };
+  const int requests = 20000;
+  for (const Case& c : cases) {
+    std::vector<uint8_t> macs(requests * kHmacLength);
+    uint64_t first = client.counter + 1;
+    for (int i = 0; i < requests; i++) client.sign(c.method, c.target, c.body, first + i, &macs[i * kHmacLength]);
+    client.counter += requests;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; i++) {
+      TEST_ASSERT_EQUAL(LAN_AUTH_OK, auth->verify(client.id, first + i, c.method, c.target, c.body.data(),
+                                                  c.body.size(), &macs[i * kHmacLength], 1));
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / requests;
+
+    // The same check with a one-shot HMAC keyed per request.
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; i++) {
+      uint8_t mac[kHmacLength];
+      client.sign(c.method, c.target, c.body, first + i, mac);
+      TEST_ASSERT_TRUE(equalsConstantTime(mac, &macs[i * kHmacLength], kHmacLength));
+    }
+    double oneShotNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                       requests;
+    char line[160];
+    snprintf(line, sizeof(line), "%-4s %-14s %3u byte body: verify %6.0f ns, one-shot HMAC %6.0f ns", c.method,
+             c.target, (unsigned)c.body.size(), ns, oneShotNs);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN(1000000.0, ns);
+  }
+
+  const int opens = 2000;
+  std::vector<Client> openers;
+  for (int i = 0; i < opens; i++) openers.emplace_back((uint8_t)i);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < opens; i++) {
+    auth->issue(openers[i].challenge, 10);
+    TEST_ASSERT_TRUE(openers[i].open(*auth, 10));
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / opens;
+  char line[80];
+  snprintf(line, sizeof(line), "session open (issue + open): %.1f us", us);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_open_needs_a_fresh_challenge);
+  RUN_TEST(test_tampered_requests_are_refused);
+  RUN_TEST(test_replay_window_edges);
+  RUN_TEST(test_out_of_order_counters);
+  RUN_TEST(test_least_recently_used_session_is_evicted);
+  RUN_TEST(test_sessions_expire);
+  RUN_TEST(test_benchmark_request_overhead);
+  return UNITY_END();
+}
@@ -0,0 +1,268 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "body_buffer.h"
+#include "state_snapshot.h"
+
+// Host counterpart of scripts/load_test.py, which needs a controller on the
+// bench. Client threads drive the local API's request path the way the load
+// test's default mix does (state=8, toggle=1, scene=1): one server thread
+// answers in order, as AsyncWebServer's single task does, serving /state from
+// the StateSnapshot with ETags, flipping appliances for /toggle, and taking
+// /scene bodies that the clients assemble in BodyBuffers concurrently.
+
+#define APPLIANCES 64
+#define CLIENTS 16
+#define REQUESTS_PER_CLIENT 4000
+#define SCENE_BODY 700
+
+enum Kind { KIND_STATE, KIND_TOGGLE, KIND_SCENE, KIND_COUNT };
+static const char* kKindNames[KIND_COUNT] = { "state", "toggle", "scene" };
+
+struct Appliance {
+  bool state;
+  uint32_t version;
+};
+
+static std::mutex appliancesLock;
+static Appliance appliances[APPLIANCES];
+static StateSnapshot* snapshot;
+
+// Shaped like serializeState(): a name, pin, state and version per appliance.
+static size_t serializeState(char* buffer, size_t capacity) {
+  std::lock_guard<std::mutex> lock(appliancesLock);
+  size_t length = (size_t)snprintf(buffer, capacity, "{\"mac\":\"24:6F:28:AA:BB:CC\",\"appliances\":[");
+  for (int i = 0; i < APPLIANCES; i++) {
+    char entry[160];
+    int n = snprintf(entry, sizeof(entry),
+                     "%s{\"name\":\"Living room ceiling light no. %02d\",\"pin\":%d,\"state\":\"%s\",\"version\":%u}",
+                     i ? "," : "", i, 100 + i, appliances[i].state ? "ON" : "OFF", (unsigned)appliances[i].version);
+    if (length + n < capacity) memcpy(buffer + length, entry, n + 1);
+    length += n;
+  }
+  if (length + 2 < capacity) memcpy(buffer + length, "]}", 3);
+  return length + 2;
+}
+
+struct Response {
+  int status;
+  std::string etag;
+  std::string body;
+};
+
+struct Request {
+  Kind kind;
+  std::string ifNoneMatch;
+  int pin;
+  void* body;  // KIND_SCENE: the assembled BodyBuffer, freed by the server
+  std::promise<Response> done;
+};
+
+// One task answering requests in arrival order.
+class Server {
+public:
+  void submit(Request* request) {
+    std::lock_guard<std::mutex> lock(queueLock);
+    queue.push_back(request);
+    ready.notify_one();
+  }
+
+  void run() {
+    for (;;) {
+      Request* request;
+      {
+        std::unique_lock<std::mutex> lock(queueLock);
+        ready.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) return;
+        request = queue.front();
+        queue.pop_front();
+      }
+      request->done.set_value(handle(*request));
+    }
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> lock(queueLock);
+    stopping = true;
+    ready.notify_one();
+  }
+
+  uint32_t rebuilds = 0;
+
+private:
+  Response handle(Request& request) {
+    Response response;
+    if (request.kind == KIND_STATE) {
+      if (snapshot->isDirty()) {
+        TEST_ASSERT_TRUE(snapshot->rebuild(serializeState));
+        rebuilds++;
+      }
+      response.etag = snapshot->etag();
+      if (snapshot->matches(request.ifNoneMatch.c_str())) {
+        response.status = 304;
+      } else {
+        response.status = 200;
+        response.body.assign(snapshot->body(), snapshot->length());
+      }
+    } else if (request.kind == KIND_TOGGLE) {
+      std::lock_guard<std::mutex> lock(appliancesLock);
+      Appliance& appliance = appliances[request.pin];
+      appliance.state = !appliance.state;
+      appliance.version++;
+      snapshot->markDirty();
+      response.status = 200;
+    } else {
+      response.status = BodyBuffer::statusOf(request.body) == BODY_COMPLETE ? 202 : 400;
+      free(request.body);
+    }
+    return response;
+  }
+
+  std::mutex queueLock;
+  std::condition_variable ready;
+  std::deque<Request*> queue;
+  bool stopping = false;
+};
+
+// A /scene body split the way TCP segments arrive, assembled on the client's
+// thread so several BodyBuffers are being filled at once.
+static void* assembleScene(std::mt19937& rng) {
+  std::string body = "{\"name\":\"evening\",\"delay_ms\":500,\"actions\":[";
+  while (body.size() < SCENE_BODY - 60) {
+    char action[64];
+    snprintf(action, sizeof(action), "{\"mac\":\"24:6F:28:AA:BB:%02X\",\"pin\":%u,\"state\":\"ON\"},",
+             (unsigned)(rng() % 256), (unsigned)(rng() % 40));
+    body += action;
+  }
+  body.back() = ']';
+  body += "}";
+  void* slot = nullptr;
+  for (size_t at = 0; at < body.size();) {
+    size_t len = std::min(body.size() - at, (size_t)(1 + rng() % 536));
+    BodyBuffer::append(slot, (const uint8_t*)body.data() + at, len, at, body.size(), 1024);
+    at += len;
+  }
+  TEST_ASSERT_EQUAL_MEMORY(body.data(), static_cast<BodyBuffer*>(slot)->data(), body.size());
+  return slot;
+}
+
+static double percentile(std::vector<double>& values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(p * (values.size() - 1) + 0.5)];
+}
+
+void setUp(void) {
+  memset(appliances, 0, sizeof(appliances));
+  snapshot = new StateSnapshot();
+  snapshot->seed(0x5EED);
+}
+
+void tearDown(void) {
+  delete snapshot;
+}
+
+void test_mixed_load(void) {
+  Server server;
+  std::thread serverThread([&server] { server.run(); });
+
+  std::vector<std::vector<double> > latencyUs[KIND_COUNT];
+  for (auto& perClient : latencyUs) perClient.resize(CLIENTS);
+  std::vector<uint32_t> notModified(CLIENTS);
+  std::vector<std::thread> clients;
+  auto start = std::chrono::steady_clock::now();
+  for (int c = 0; c < CLIENTS; c++) {
+    clients.emplace_back([&, c] {
+      std::mt19937 rng(c);
+      std::string etag;
+      for (int i = 0; i < REQUESTS_PER_CLIENT; i++) {
+        uint32_t roll = rng() % 10;
+        Request request;
+        request.kind = roll < 8 ? KIND_STATE : roll < 9 ? KIND_TOGGLE : KIND_SCENE;
+        request.pin = rng() % APPLIANCES;
+        request.ifNoneMatch = etag;
+        request.body = request.kind == KIND_SCENE ? assembleScene(rng) : nullptr;
+        std::future<Response> answer = request.done.get_future();
+        auto sent = std::chrono::steady_clock::now();
+        server.submit(&request);
+        Response response = answer.get();
+        latencyUs[request.kind][c].push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+        if (request.kind == KIND_SCENE) TEST_ASSERT_EQUAL(202, response.status);
+        if (request.kind != KIND_STATE) continue;
+        if (response.status == 304) {
+          // Only ever for the body this client already holds.
+          TEST_ASSERT_EQUAL_STRING(etag.c_str(), response.etag.c_str());
+          notModified[c]++;
+          continue;
+        }
+        TEST_ASSERT_EQUAL(200, response.status);
+        TEST_ASSERT_TRUE(response.etag != etag);
+        TEST_ASSERT_EQUAL('}', response.body.back());
+        etag = response.etag;
+      }
+    });
+  }
+  for (auto& client : clients) client.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  server.stop();
+  serverThread.join();
+
+  uint32_t total = CLIENTS * REQUESTS_PER_CLIENT;
+  uint32_t states = 0;
+  uint32_t toggles = 0;
+  uint32_t cached = 0;
+  for (int c = 0; c < CLIENTS; c++) cached += notModified[c];
+  char line[160];
+  for (int k = 0; k < KIND_COUNT; k++) {
+    std::vector<double> all;
+    for (const auto& perClient : latencyUs[k]) all.insert(all.end(), perClient.begin(), perClient.end());
+    if (k == KIND_STATE) states = (uint32_t)all.size();
+    if (k == KIND_TOGGLE) toggles = (uint32_t)all.size();
+    size_t count = all.size();
+    snprintf(line, sizeof(line), "%-6s %6u requests  p50 %7.1f us  p99 %7.1f us  p999 %7.1f us", kKindNames[k],
+             (unsigned)count, percentile(all, 0.5), percentile(all, 0.99), percentile(all, 0.999));
+    TEST_MESSAGE(line);
+  }
+  snprintf(line, sizeof(line), "%u requests from %d clients in %.2f s (%.0f/s); %u of %u /state answered 304, %u rebuilds",
+           (unsigned)total, CLIENTS, seconds, total / seconds, (unsigned)cached, (unsigned)states,
+           (unsigned)server.rebuilds);
+  TEST_MESSAGE(line);
+
+  // A rebuild per toggle at most, never one per poll.
+  TEST_ASSERT_LESS_OR_EQUAL(toggles + 1, server.rebuilds);
+  TEST_ASSERT_GREATER_THAN(0, cached);
+}
+
+// After the load, the snapshot matches the appliances exactly.
+void test_snapshot_reflects_final_state(void) {
+  for (int i = 0; i < APPLIANCES; i += 3) {
+    std::lock_guard<std::mutex> lock(appliancesLock);
+    appliances[i].state = true;
+    appliances[i].version = 7;
+    snapshot->markDirty();
+  }
+  TEST_ASSERT_TRUE(snapshot->rebuild(serializeState));
+  std::vector<char> expected(16384);
+  size_t length = serializeState(expected.data(), expected.size());
+  TEST_ASSERT_EQUAL(length, snapshot->length());
+  TEST_ASSERT_EQUAL_STRING(expected.data(), snapshot->body());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_mixed_load);
+  RUN_TEST(test_snapshot_reflects_final_state);
+  return UNITY_END();
+}
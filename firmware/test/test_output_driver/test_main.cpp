@@ -0,0 +1,172 @@
+#include <unity.h>
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+#include "output_driver.h"
+
+// Expander drivers against simulated buses: each chip's outputs are what the
+// last frame it acknowledged said, and the bus can be told to NACK.
+
+static std::mt19937 rng(0x0D7);
+
+class SimI2cBus : public I2cBus {
+public:
+  bool write(uint8_t address, const uint8_t* data, size_t len) override {
+    frames++;
+    if (nackAddress == address || (nackPercent && rng() % 100 < nackPercent)) return false;
+    latched[address] = std::vector<uint8_t>(data, data + len);
+    if (len == 3 && data[0] == 0x14) olat[address] = (uint16_t)(data[1] | data[2] << 8);
+    return true;
+  }
+
+  // Last acknowledged frame per address, and MCP23017 OLATA/OLATB.
+  std::map<uint8_t, std::vector<uint8_t> > latched;
+  std::map<uint8_t, uint16_t> olat;
+  int nackAddress = -1;
+  uint32_t nackPercent = 0;
+  uint32_t frames = 0;
+};
+
+class SimShiftBus : public ShiftBus {
+public:
+  void shiftOut(const uint8_t* data, size_t len) override {
+    chain.assign(data, data + len);
+    latches++;
+  }
+
+  std::vector<uint8_t> chain;
+  uint32_t latches = 0;
+};
+
+static uint16_t mcpLevels(SimI2cBus& bus, uint8_t address) {
+  TEST_ASSERT_EQUAL(1, bus.olat.count(address));
+  return bus.olat[address];
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_burst_costs_one_transaction_per_changed_chip(void) {
+  SimI2cBus bus;
+  Mcp23017Output out(bus, 0x20, 2, false);
+  TEST_ASSERT_TRUE(out.begin());
+  uint32_t before = bus.frames;
+  for (uint16_t ch = 0; ch < 16; ch++) out.write(ch, ch % 2);
+  out.flush();
+  TEST_ASSERT_EQUAL(1, bus.frames - before);
+  TEST_ASSERT_EQUAL(0xAAAA, mcpLevels(bus, 0x20));
+  TEST_ASSERT_EQUAL(0, mcpLevels(bus, 0x21));
+  out.flush();
+  TEST_ASSERT_EQUAL(1, bus.frames - before);
+  TEST_ASSERT_EQUAL(16, out.writes());
+  TEST_ASSERT_EQUAL(1, out.transactions());
+}
+
+void test_active_low_inverts(void) {
+  SimI2cBus bus;
+  Pcf8574Output out(bus, 0x38, 1, true);
+  TEST_ASSERT_TRUE(out.begin());
+  TEST_ASSERT_EQUAL(0xFF, bus.latched[0x38][0]);
+  out.write(3, true);
+  out.flush();
+  TEST_ASSERT_EQUAL(0xF7, bus.latched[0x38][0]);
+}
+
+void test_nacked_frame_is_resent(void) {
+  SimI2cBus bus;
+  Mcp23017Output out(bus, 0x20, 2, false);
+  TEST_ASSERT_TRUE(out.begin());
+  bus.nackAddress = 0x21;
+  out.write(2, true);
+  out.write(20, true);
+  out.flush();
+  TEST_ASSERT_EQUAL(0x0004, mcpLevels(bus, 0x20));
+  TEST_ASSERT_EQUAL(0, mcpLevels(bus, 0x21));
+  TEST_ASSERT_EQUAL(1, out.failures());
+
+  // Only the chip that failed goes out again, until it acknowledges.
+  uint32_t before = bus.frames;
+  out.flush();
+  TEST_ASSERT_EQUAL(1, bus.frames - before);
+  bus.nackAddress = -1;
+  out.flush();
+  TEST_ASSERT_EQUAL(0x0010, mcpLevels(bus, 0x21));
+  before = bus.frames;
+  out.flush();
+  TEST_ASSERT_EQUAL(0, bus.frames - before);
+}
+
+void test_shift_chain_order(void) {
+  SimShiftBus bus;
+  Shift595Output out(bus, 3, false);
+  TEST_ASSERT_TRUE(out.begin());
+  out.write(0, true);
+  out.write(23, true);
+  out.flush();
+  // The first byte shifted ends up in the last chip.
+  TEST_ASSERT_EQUAL(3, bus.chain.size());
+  TEST_ASSERT_EQUAL(0x80, bus.chain[0]);
+  TEST_ASSERT_EQUAL(0x00, bus.chain[1]);
+  TEST_ASSERT_EQUAL(0x01, bus.chain[2]);
+}
+
+// Writers on several threads and a flush tick on another, over a bus that
+// drops one frame in five: once writes stop and a flush succeeds, every chip
+// shows the last level written to each of its channels.
+void test_concurrent_writes_converge_on_a_lossy_bus(void) {
+  SimI2cBus bus;
+  Mcp23017Output out(bus, 0x20, 4, false);
+  TEST_ASSERT_TRUE(out.begin());
+  bus.nackPercent = 20;
+
+  std::atomic<bool> writing(true);
+  std::thread flusher([&] {
+    while (writing) {
+      out.flush();
+      std::this_thread::yield();
+    }
+  });
+  std::vector<uint8_t> last(64);
+  std::vector<std::thread> writers;
+  for (int w = 0; w < 4; w++) {
+    writers.emplace_back([&, w] {
+      std::mt19937 local(w);
+      // Each writer owns 16 channels, so the last value per channel is known.
+      for (int i = 0; i < 20000; i++) {
+        uint16_t ch = (uint16_t)(w * 16 + local() % 16);
+        bool on = local() & 1;
+        out.write(ch, on);
+        last[ch] = on;
+        if (i % 16 == 0) std::this_thread::yield();
+      }
+    });
+  }
+  for (auto& writer : writers) writer.join();
+  writing = false;
+  flusher.join();
+
+  bus.nackPercent = 0;
+  out.flush();
+  for (uint8_t chip = 0; chip < 4; chip++) {
+    uint16_t expected = 0;
+    for (int bit = 0; bit < 16; bit++) expected |= (uint16_t)(last[chip * 16 + bit] << bit);
+    TEST_ASSERT_EQUAL(expected, mcpLevels(bus, 0x20 + chip));
+  }
+  char line[120];
+  snprintf(line, sizeof(line), "%u writes, %u transactions, %u failed flushes", (unsigned)out.writes(),
+           (unsigned)out.transactions(), (unsigned)out.failures());
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_costs_one_transaction_per_changed_chip);
+  RUN_TEST(test_active_low_inverts);
+  RUN_TEST(test_nacked_frame_is_resent);
+  RUN_TEST(test_shift_chain_order);
+  RUN_TEST(test_concurrent_writes_converge_on_a_lossy_bus);
+  return UNITY_END();
+}
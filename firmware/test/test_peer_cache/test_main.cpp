@@ -0,0 +1,288 @@
+#include <unity.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "peer_cache.h"
+
+// Controllers advertise _aura._tcp with the local API port in an SRV record
+// and mac/fw/appliances in TXT, as startDiscovery() does. Here each one is a
+// thread answering DNS-SD queries on a loopback socket; the resolver parses
+// the answers and fills a PeerCache the way scanPeers() does.
+
+#define TTL_MS 900000
+#define SELF_MAC "24:6F:28:00:00:00"
+
+struct Advertisement {
+  std::string mac;
+  std::string fw;
+  int appliances;
+  uint16_t apiPort;
+};
+
+static void putU16(std::vector<uint8_t>& out, uint16_t value) {
+  out.push_back(value >> 8);
+  out.push_back(value & 0xFF);
+}
+
+static void putName(std::vector<uint8_t>& out, const std::vector<std::string>& labels) {
+  for (const auto& label : labels) {
+    out.push_back((uint8_t)label.size());
+    out.insert(out.end(), label.begin(), label.end());
+  }
+  out.push_back(0);
+}
+
+static void putRecordHeader(std::vector<uint8_t>& out, const std::vector<std::string>& name, uint16_t type) {
+  putName(out, name);
+  putU16(out, type);
+  putU16(out, 0x8001);  // IN, cache-flush
+  putU16(out, 0);
+  putU16(out, 120);     // TTL seconds
+}
+
+// A response with the instance's SRV and TXT records.
+static std::vector<uint8_t> encodeAnswer(const Advertisement& ad) {
+  std::vector<std::string> instance = { "aura-" + ad.mac.substr(12, 2) + ad.mac.substr(15, 2), "_aura", "_tcp", "local" };
+  std::vector<uint8_t> out;
+  putU16(out, 0);       // id
+  putU16(out, 0x8400);  // response, authoritative
+  putU16(out, 0);
+  putU16(out, 2);
+  putU16(out, 0);
+  putU16(out, 0);
+
+  putRecordHeader(out, instance, 33);
+  std::vector<std::string> target = { instance[0], "local" };
+  size_t targetLength = 1;
+  for (const auto& label : target) targetLength += 1 + label.size();
+  putU16(out, (uint16_t)(6 + targetLength));
+  putU16(out, 0);
+  putU16(out, 0);
+  putU16(out, ad.apiPort);
+  putName(out, target);
+
+  putRecordHeader(out, instance, 16);
+  std::vector<std::string> txt = { "mac=" + ad.mac, "fw=" + ad.fw, "appliances=" + std::to_string(ad.appliances) };
+  size_t txtLength = 0;
+  for (const auto& entry : txt) txtLength += 1 + entry.size();
+  putU16(out, (uint16_t)txtLength);
+  for (const auto& entry : txt) {
+    out.push_back((uint8_t)entry.size());
+    out.insert(out.end(), entry.begin(), entry.end());
+  }
+  return out;
+}
+
+struct Resolved {
+  std::string mac;
+  uint16_t port = 0;
+};
+
+static bool skipName(const uint8_t* data, size_t length, size_t& at) {
+  while (at < length) {
+    uint8_t label = data[at++];
+    if (label == 0) return true;
+    if ((label & 0xC0) == 0xC0) return at++ < length;
+    at += label;
+  }
+  return false;
+}
+
+static uint16_t readU16(const uint8_t* data) { return (uint16_t)(data[0] << 8 | data[1]); }
+
+static bool decodeAnswer(const uint8_t* data, size_t length, Resolved& out) {
+  if (length < 12 || !(data[2] & 0x80)) return false;
+  size_t at = 12;
+  for (uint16_t i = 0, answers = readU16(data + 6); i < answers; i++) {
+    if (!skipName(data, length, at) || at + 10 > length) return false;
+    uint16_t type = readU16(data + at);
+    uint16_t rdLength = readU16(data + at + 8);
+    at += 10;
+    if (at + rdLength > length) return false;
+    if (type == 33 && rdLength >= 6) out.port = readU16(data + at + 4);
+    if (type == 16) {
+      for (size_t p = at; p < at + rdLength;) {
+        std::string entry((const char*)data + p + 1, data[p]);
+        if (entry.compare(0, 4, "mac=") == 0) out.mac = entry.substr(4);
+        p += 1 + data[p];
+      }
+    }
+    at += rdLength;
+  }
+  return out.mac.size() && out.port;
+}
+
+static int loopbackSocket(uint16_t& port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, (sockaddr*)&addr, sizeof(addr));
+  socklen_t size = sizeof(addr);
+  getsockname(fd, (sockaddr*)&addr, &size);
+  port = ntohs(addr.sin_port);
+  return fd;
+}
+
+// Answers every query on its socket until stopped.
+struct Advertiser {
+  Advertisement ad;
+  int fd = -1;
+  uint16_t port = 0;
+  std::atomic<bool> running{ true };
+  std::thread thread;
+
+  explicit Advertiser(const Advertisement& ad) : ad(ad) {
+    fd = loopbackSocket(port);
+    thread = std::thread([this] {
+      std::vector<uint8_t> answer = encodeAnswer(this->ad);
+      while (running) {
+        pollfd wait = { fd, POLLIN, 0 };
+        if (poll(&wait, 1, 20) <= 0) continue;
+        uint8_t query[512];
+        sockaddr_in from;
+        socklen_t size = sizeof(from);
+        if (recvfrom(fd, query, sizeof(query), 0, (sockaddr*)&from, &size) < 12) continue;
+        sendto(fd, answer.data(), answer.size(), 0, (sockaddr*)&from, size);
+      }
+    });
+  }
+
+  ~Advertiser() {
+    running = false;
+    thread.join();
+    close(fd);
+  }
+};
+
+// Queries every advertiser and feeds the answers to the cache, skipping this
+// controller's own record like scanPeers() does.
+static int scan(PeerCache& cache, std::vector<Advertiser*>& advertisers, uint32_t nowMs) {
+  uint16_t port;
+  int fd = loopbackSocket(port);
+  std::vector<uint8_t> query;
+  putU16(query, 0);
+  putU16(query, 0);
+  putU16(query, 1);
+  putU16(query, 0);
+  putU16(query, 0);
+  putU16(query, 0);
+  putName(query, { "_aura", "_tcp", "local" });
+  putU16(query, 12);  // PTR
+  putU16(query, 1);
+  for (auto* advertiser : advertisers) {
+    sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to.sin_port = htons(advertiser->port);
+    sendto(fd, query.data(), query.size(), 0, (sockaddr*)&to, sizeof(to));
+  }
+  int answers = 0;
+  for (size_t i = 0; i < advertisers.size(); i++) {
+    pollfd wait = { fd, POLLIN, 0 };
+    if (poll(&wait, 1, 1000) <= 0) break;
+    uint8_t packet[512];
+    sockaddr_in from;
+    socklen_t size = sizeof(from);
+    ssize_t length = recvfrom(fd, packet, sizeof(packet), 0, (sockaddr*)&from, &size);
+    Resolved peer;
+    if (length <= 0 || !decodeAnswer(packet, (size_t)length, peer)) continue;
+    answers++;
+    if (peer.mac == SELF_MAC) continue;
+    cache.update(peer.mac.c_str(), from.sin_addr.s_addr, peer.port, nowMs);
+  }
+  close(fd);
+  cache.expire(nowMs);
+  return answers;
+}
+
+static std::string macFor(int i) {
+  char mac[18];
+  snprintf(mac, sizeof(mac), "24:6F:28:00:%02X:%02X", i >> 8, i & 0xFF);
+  return mac;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_advertise_and_resolve_over_loopback(void) {
+  std::vector<Advertiser*> advertisers;
+  advertisers.push_back(new Advertiser({ SELF_MAC, "2.4.0", 8, 80 }));
+  for (int i = 1; i <= 5; i++) advertisers.push_back(new Advertiser({ macFor(i), "2.4.0", 4 * i, (uint16_t)(8000 + i) }));
+
+  PeerCache cache(TTL_MS);
+  TEST_ASSERT_EQUAL(6, scan(cache, advertisers, 1000));
+  TEST_ASSERT_EQUAL(5, cache.size());
+  TEST_ASSERT_NULL(cache.find(SELF_MAC, 1000));
+  for (int i = 1; i <= 5; i++) {
+    const Peer* peer = cache.find(macFor(i).c_str(), 1000);
+    TEST_ASSERT_NOT_NULL(peer);
+    TEST_ASSERT_EQUAL(htonl(INADDR_LOOPBACK), peer->ip);
+    TEST_ASSERT_EQUAL(8000 + i, peer->port);
+  }
+
+  // A controller that stops answering ages out; the rest are refreshed.
+  delete advertisers.back();
+  advertisers.pop_back();
+  scan(cache, advertisers, 1000 + TTL_MS);
+  scan(cache, advertisers, 1000 + TTL_MS + 1);
+  TEST_ASSERT_EQUAL(4, cache.size());
+  TEST_ASSERT_NULL(cache.find(macFor(5).c_str(), 1000 + TTL_MS + 1));
+  TEST_ASSERT_NOT_NULL(cache.find(macFor(4).c_str(), 1000 + TTL_MS + 1));
+  for (auto* advertiser : advertisers) delete advertiser;
+}
+
+void test_lookups_are_served_from_the_cache(void) {
+  PeerCache cache(TTL_MS);
+  for (size_t i = 0; i < PeerCache::kCapacity; i++) cache.update(macFor(i).c_str(), 0x0100007F, 80, 0);
+  const int lookups = 200000;
+  int hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < lookups; i++) {
+    if (cache.find(macFor(i % PeerCache::kCapacity).c_str(), 1)) hits++;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookups;
+  TEST_ASSERT_EQUAL(lookups, hits);
+  char line[96];
+  snprintf(line, sizeof(line), "%.0f ns per lookup in a full cache", ns);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN(1000000.0, ns);
+}
+
+void test_full_cache_evicts_the_oldest(void) {
+  PeerCache cache(TTL_MS);
+  for (size_t i = 0; i < PeerCache::kCapacity; i++) cache.update(macFor(i).c_str(), 1, 80, 100 + (uint32_t)i);
+  cache.update(macFor(0).c_str(), 1, 80, 500);
+  cache.update(macFor(99).c_str(), 2, 80, 600);
+  TEST_ASSERT_EQUAL(PeerCache::kCapacity, cache.size());
+  TEST_ASSERT_NOT_NULL(cache.find(macFor(0).c_str(), 600));
+  TEST_ASSERT_NULL(cache.find(macFor(1).c_str(), 600));
+  TEST_ASSERT_EQUAL(2, cache.find(macFor(99).c_str(), 600)->ip);
+}
+
+void test_expiry_survives_millis_wrap(void) {
+  PeerCache cache(1000);
+  cache.update(macFor(1).c_str(), 1, 80, 0xFFFFFF00u);
+  TEST_ASSERT_NOT_NULL(cache.find(macFor(1).c_str(), 0x100));
+  TEST_ASSERT_NULL(cache.find(macFor(1).c_str(), 0x400));
+  cache.expire(0x400);
+  TEST_ASSERT_EQUAL(0, cache.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_advertise_and_resolve_over_loopback);
+  RUN_TEST(test_lookups_are_served_from_the_cache);
+  RUN_TEST(test_full_cache_evicts_the_oldest);
+  RUN_TEST(test_expiry_survives_millis_wrap);
+  return UNITY_END();
+}
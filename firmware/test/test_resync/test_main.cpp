@@ -0,0 +1,214 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+#include "backoff.h"
+
+// A fleet of controllers loses its link at once (router reboot) while the app
+// keeps writing. Each controller retries with the same Backoff as main.cpp,
+// reset only once a reopen has been replayed, and catches up with one read
+// filtered on version >= lastSeenVersion + 1, so it replays only what it
+// missed. The backend injects the outage and a share of failed reopen
+// attempts once the link is back.
+
+#define FLEET 64
+#define PINS 16
+#define OUTAGE_MS 8000
+#define RUN_MS 120000
+#define BUCKET_MS 100
+
+struct Entry { bool state; uint64_t version; };
+typedef std::map<int, Entry> Appliances;
+
+static std::mt19937 rng(0x2E5C);
+
+struct Backend {
+  std::vector<Appliances> devices;
+  uint64_t clock = 0;
+  uint32_t failPercent = 0;
+
+  // A server-timestamp version: strictly increasing.
+  uint64_t write(int device, int pin, bool state) {
+    devices[device][pin] = { state, ++clock };
+    return clock;
+  }
+
+  // The catch-up read, filtered on version >= startAt.
+  Appliances snapshot(int device, uint64_t startAt) const {
+    Appliances out;
+    for (const auto& entry : devices[device]) {
+      if (entry.second.version >= startAt) out[entry.first] = entry.second;
+    }
+    return out;
+  }
+};
+
+struct Controller {
+  Appliances state;
+  uint64_t lastSeenVersion = 0;
+  bool live = true;
+  Backoff backoff = Backoff(500, 30000);
+  uint32_t nextAttemptAt = 0;
+  uint32_t resyncedAt = 0;
+  size_t replayed = 0;
+
+  // Snapshot replay as applyStateDelta does it: version order, newer only.
+  void replay(const Appliances& snapshot) {
+    std::vector<std::pair<int, Entry> > changes(snapshot.begin(), snapshot.end());
+    std::sort(changes.begin(), changes.end(),
+              [](const std::pair<int, Entry>& a, const std::pair<int, Entry>& b) { return a.second.version < b.second.version; });
+    for (const auto& change : changes) {
+      Entry& current = state[change.first];
+      if (change.second.version <= current.version) continue;
+      current = change.second;
+      lastSeenVersion = std::max(lastSeenVersion, change.second.version);
+    }
+  }
+
+  void event(int pin, const Entry& entry) {
+    if (!live) return;
+    state[pin] = entry;
+    lastSeenVersion = std::max(lastSeenVersion, entry.version);
+  }
+};
+
+struct Run {
+  std::vector<uint32_t> resyncMs;
+  std::map<uint32_t, int> reopensPerBucket;
+  size_t replayed = 0;
+  size_t fullSnapshot = 0;
+  int attempts = 0;
+};
+
+static Run simulate(uint32_t failPercent) {
+  Backend backend;
+  backend.devices.resize(FLEET);
+  backend.failPercent = failPercent;
+  std::vector<Controller> fleet(FLEET);
+  for (int d = 0; d < FLEET; d++) {
+    fleet[d].backoff.seed(0xA0000 + d * 7919);
+    for (int pin = 0; pin < PINS; pin++) {
+      uint64_t version = backend.write(d, pin, false);
+      fleet[d].event(pin, { false, version });
+    }
+  }
+
+  Run run;
+  const uint32_t dropAt = 1000;
+  const uint32_t restoreAt = dropAt + OUTAGE_MS;
+  for (uint32_t now = 0; now < RUN_MS; now++) {
+    if (now == dropAt) {
+      for (auto& controller : fleet) {
+        controller.live = false;
+        controller.nextAttemptAt = now + controller.backoff.next();
+      }
+    }
+    // The app keeps writing: about one change per device every two seconds.
+    for (int d = 0; d < FLEET; d++) {
+      if (rng() % 2000) continue;
+      int pin = rng() % PINS;
+      bool state = rng() & 1;
+      backend.write(d, pin, state);
+      fleet[d].event(pin, backend.devices[d][pin]);
+    }
+    for (auto& controller : fleet) {
+      if (controller.live || now < controller.nextAttemptAt) continue;
+      run.attempts++;
+      bool linkUp = now >= restoreAt;
+      if (!linkUp || rng() % 100 < backend.failPercent) {
+        controller.nextAttemptAt = now + controller.backoff.next();
+        continue;
+      }
+      int d = (int)(&controller - &fleet[0]);
+      Appliances snapshot = backend.snapshot(d, controller.lastSeenVersion + 1);
+      run.reopensPerBucket[now / BUCKET_MS]++;
+      run.replayed += snapshot.size();
+      run.fullSnapshot += backend.devices[d].size();
+      controller.replay(snapshot);
+      controller.backoff.reset();
+      controller.live = true;
+      controller.resyncedAt = now;
+      run.resyncMs.push_back(now - restoreAt);
+      // Consistent the moment the snapshot is applied.
+      TEST_ASSERT_EQUAL(backend.devices[d].size(), controller.state.size());
+      for (const auto& entry : backend.devices[d]) {
+        TEST_ASSERT_EQUAL(entry.second.state, controller.state[entry.first].state);
+        TEST_ASSERT_EQUAL(entry.second.version, controller.state[entry.first].version);
+      }
+    }
+  }
+
+  for (int d = 0; d < FLEET; d++) {
+    TEST_ASSERT_TRUE(fleet[d].live);
+    for (const auto& entry : backend.devices[d]) {
+      TEST_ASSERT_EQUAL(entry.second.version, fleet[d].state[entry.first].version);
+    }
+  }
+  return run;
+}
+
+static uint32_t percentile(std::vector<uint32_t> values, double p) {
+  std::sort(values.begin(), values.end());
+  size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+static void report(const char* name, const Run& run) {
+  int peak = 0;
+  for (const auto& bucket : run.reopensPerBucket) peak = std::max(peak, bucket.second);
+  char line[200];
+  snprintf(line, sizeof(line),
+           "%s: resync after link restore p50 %u ms, p99 %u ms, max %u ms; peak %d reopens per %d ms; "
+           "%u attempts; replayed %u of %u entries",
+           name, percentile(run.resyncMs, 0.5), percentile(run.resyncMs, 0.99), percentile(run.resyncMs, 1.0), peak,
+           BUCKET_MS, (unsigned)run.attempts, (unsigned)run.replayed, (unsigned)run.fullSnapshot);
+  TEST_MESSAGE(line);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_backoff_windows(void) {
+  Backoff backoff(500, 30000);
+  backoff.seed(42);
+  uint32_t window = 500;
+  for (int attempt = 0; attempt < 40; attempt++) {
+    uint32_t delay = backoff.next();
+    TEST_ASSERT_GREATER_OR_EQUAL(window / 2, delay);
+    TEST_ASSERT_LESS_THAN(window, delay);
+    window = std::min<uint32_t>(window * 2, 30000);
+  }
+  backoff.reset();
+  TEST_ASSERT_EQUAL(0, backoff.attempts());
+  TEST_ASSERT_LESS_THAN(500, backoff.next());
+}
+
+void test_fleet_resyncs_after_outage(void) {
+  Run run = simulate(0);
+  TEST_ASSERT_EQUAL(FLEET, run.resyncMs.size());
+  // Only what changed during the outage is replayed, not every appliance.
+  TEST_ASSERT_LESS_THAN(run.fullSnapshot / 2, run.replayed);
+  int peak = 0;
+  for (const auto& bucket : run.reopensPerBucket) peak = std::max(peak, bucket.second);
+  TEST_ASSERT_LESS_THAN(FLEET / 4, peak);
+  report("clean restore", run);
+}
+
+void test_fleet_resyncs_through_failed_reopens(void) {
+  Run run = simulate(30);
+  report("30% reopens fail", run);
+  TEST_ASSERT_EQUAL(FLEET, run.resyncMs.size());
+  // Retries stay capped: half the fleet is back within one capped window.
+  TEST_ASSERT_LESS_THAN(30000, percentile(run.resyncMs, 0.5));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_backoff_windows);
+  RUN_TEST(test_fleet_resyncs_after_outage);
+  RUN_TEST(test_fleet_resyncs_through_failed_reopens);
+  return UNITY_END();
+}
@@ -0,0 +1,326 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+#include "scene_link.h"
+
+// The scene codec, clock and guard on a simulated fleet: controllers whose
+// clocks start up to ±100 s apart and drift by up to ±50 ppm exchange signed
+// beacons and scenes over a LAN that delivers in 1-8 ms, plus 30 ms for one
+// packet in ten, as the SceneClock was measured against. Every packet goes
+// through encode/decode with the home's key, and every scene through each
+// receiver's SceneGuard, as onScenePacket() does.
+
+static std::mt19937 rng(0x5CE2);
+static const uint8_t kKey[] = "home scene key, 32 bytes long!!";
+
+static void macOf(int index, uint8_t mac[6]) {
+  const uint8_t base[6] = { 0x24, 0x6F, 0x28, 0x10, 0x00, 0x00 };
+  memcpy(mac, base, 6);
+  mac[4] = (uint8_t)(index >> 8);
+  mac[5] = (uint8_t)index;
+}
+
+static ScenePacket packetFrom(const uint8_t mac[6], ScenePacketType type, uint32_t bootId, uint32_t seq,
+                              int64_t timeUs) {
+  ScenePacket packet = {};
+  packet.type = type;
+  memcpy(packet.sender, mac, 6);
+  packet.bootId = bootId;
+  packet.seq = seq;
+  packet.timeUs = timeUs;
+  return packet;
+}
+
+// Signed and checked again, as it would cross the network.
+static bool transmit(const ScenePacket& packet, ScenePacket& received) {
+  uint8_t buffer[kSceneMaxPacket];
+  size_t length = encodeScenePacket(packet, kKey, sizeof(kKey) - 1, buffer, sizeof(buffer));
+  return length && decodeScenePacket(buffer, length, kKey, sizeof(kKey) - 1, received);
+}
+
+static int64_t latencyUs() {
+  int64_t us = 1000 + rng() % 7000;
+  if (rng() % 10 == 0) us += 30000;
+  return us;
+}
+
+struct Controller {
+  uint8_t mac[6];
+  int64_t bootUs;  // local clock at true time 0
+  double ppm;
+  uint32_t bootId = 1;
+  uint32_t seq = 0;
+  SceneClock* clock;
+  SceneGuard guard;
+
+  int64_t localAt(int64_t trueUs) const { return bootUs + trueUs + (int64_t)(trueUs * ppm / 1e6); }
+  int64_t trueAt(int64_t localUs) const { return (int64_t)((localUs - bootUs) / (1 + ppm / 1e6)); }
+};
+
+struct Delivery {
+  int to;
+  ScenePacket packet;
+};
+
+struct SkewRun {
+  std::vector<double> skewMs;
+  uint32_t scenesRun = 0;
+};
+
+static SkewRun simulateFleet(int size, int scenes) {
+  std::vector<Controller> fleet(size);
+  std::vector<int64_t> beaconPhaseUs(size);
+  for (int i = 0; i < size; i++) {
+    // MACs in shuffled order, so the reference is not the first to start.
+    macOf(1 + (i * 7) % size, fleet[i].mac);
+    fleet[i].bootUs = 200000000 + (int64_t)(rng() % 200000001) - 100000000;
+    fleet[i].ppm = (double)(rng() % 101) - 50;
+    fleet[i].clock = new SceneClock(fleet[i].mac);
+    beaconPhaseUs[i] = (int64_t)(rng() % 2000) * 1000;
+  }
+
+  std::multimap<int64_t, Delivery> inFlight;
+  auto broadcast = [&](int from, const ScenePacket& packet, int64_t nowUs) {
+    for (int to = 0; to < size; to++) {
+      if (to != from) inFlight.insert({ nowUs + latencyUs(), { to, packet } });
+    }
+  };
+
+  // Where each scene fired, in true time, per controller.
+  std::map<uint32_t, std::vector<int64_t> > fired;
+  auto schedule = [&](int at, const ScenePacket& scene) {
+    Controller& controller = fleet[at];
+    int64_t dueUs = controller.trueAt(controller.clock->toLocal(scene.timeUs));
+    fired[scene.seq ^ ((uint32_t)scene.sender[5] << 24)].push_back(dueUs);
+  };
+
+  const int64_t warmupUs = 20000000;
+  const int64_t sceneEveryUs = 1500000;
+  const int64_t endUs = warmupUs + scenes * sceneEveryUs + 5000000;
+  int sent = 0;
+  for (int64_t nowUs = 0; nowUs < endUs; nowUs += 1000) {
+    while (!inFlight.empty() && inFlight.begin()->first <= nowUs) {
+      int64_t atUs = inFlight.begin()->first;
+      Delivery delivery = inFlight.begin()->second;
+      inFlight.erase(inFlight.begin());
+      Controller& to = fleet[delivery.to];
+      ScenePacket packet;
+      TEST_ASSERT_TRUE(transmit(delivery.packet, packet));
+      int64_t localUs = to.localAt(atUs);
+      if (packet.type == SCENE_BEACON) {
+        int64_t before = to.clock->offset();
+        if (to.clock->onBeacon(packet, localUs)) to.guard.rebase(to.clock->offset() - before);
+      } else if (to.guard.accept(packet, to.clock->now(localUs))) {
+        schedule(delivery.to, packet);
+      }
+    }
+    for (int i = 0; i < size; i++) {
+      if (nowUs % 2000000 != beaconPhaseUs[i]) continue;
+      Controller& from = fleet[i];
+      int64_t networkNowUs = from.clock->now(from.localAt(nowUs));
+      broadcast(i, packetFrom(from.mac, SCENE_BEACON, from.bootId, ++from.seq, networkNowUs), nowUs);
+    }
+    if (nowUs >= warmupUs && sent < scenes && (nowUs - warmupUs) % sceneEveryUs == 0) {
+      int i = rng() % size;
+      Controller& from = fleet[i];
+      int64_t networkNowUs = from.clock->now(from.localAt(nowUs));
+      ScenePacket scene = packetFrom(from.mac, SCENE_RUN, from.bootId, ++from.seq, networkNowUs + 500000);
+      strcpy(scene.name, "goodnight");
+      TEST_ASSERT_TRUE(from.guard.accept(scene, networkNowUs));
+      schedule(i, scene);
+      broadcast(i, scene, nowUs);
+      sent++;
+    }
+  }
+
+  SkewRun run;
+  for (const auto& scene : fired) {
+    TEST_ASSERT_EQUAL(size, scene.second.size());
+    int64_t first = *std::min_element(scene.second.begin(), scene.second.end());
+    int64_t last = *std::max_element(scene.second.begin(), scene.second.end());
+    run.skewMs.push_back((last - first) / 1000.0);
+    run.scenesRun++;
+  }
+  for (auto& controller : fleet) delete controller.clock;
+  return run;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_codec_round_trip_and_tampering(void) {
+  uint8_t mac[6];
+  macOf(3, mac);
+  ScenePacket scene = packetFrom(mac, SCENE_RUN, 7, 42, 123456789);
+  strcpy(scene.name, "goodnight");
+  scene.count = 2;
+  macOf(4, scene.actions[0].mac);
+  scene.actions[0].pin = 12;
+  scene.actions[0].state = 1;
+  macOf(5, scene.actions[1].mac);
+  scene.actions[1].pin = 103;
+
+  uint8_t buffer[kSceneMaxPacket];
+  size_t length = encodeScenePacket(scene, kKey, sizeof(kKey) - 1, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL(26 + 1 + 9 + 1 + 2 * 8 + kSceneMacLength, length);
+  ScenePacket decoded;
+  TEST_ASSERT_TRUE(decodeScenePacket(buffer, length, kKey, sizeof(kKey) - 1, decoded));
+  TEST_ASSERT_EQUAL(SCENE_RUN, decoded.type);
+  TEST_ASSERT_EQUAL_MEMORY(mac, decoded.sender, 6);
+  TEST_ASSERT_EQUAL_UINT32(7, decoded.bootId);
+  TEST_ASSERT_EQUAL_UINT32(42, decoded.seq);
+  TEST_ASSERT_TRUE(decoded.timeUs == 123456789);
+  TEST_ASSERT_EQUAL_STRING("goodnight", decoded.name);
+  TEST_ASSERT_EQUAL(2, decoded.count);
+  TEST_ASSERT_EQUAL(103, decoded.actions[1].pin);
+
+  // Every byte is covered by the MAC, the boot id and sequence included.
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] ^= 0x01;
+    TEST_ASSERT_FALSE(decodeScenePacket(buffer, length, kKey, sizeof(kKey) - 1, decoded));
+    buffer[i] ^= 0x01;
+  }
+  TEST_ASSERT_FALSE(decodeScenePacket(buffer, length, (const uint8_t*)"other key", 9, decoded));
+  TEST_ASSERT_FALSE(decodeScenePacket(buffer, length - 1, kKey, sizeof(kKey) - 1, decoded));
+  TEST_ASSERT_EQUAL(0, encodeScenePacket(scene, kKey, sizeof(kKey) - 1, buffer, length - 1));
+}
+
+void test_fleet_fires_scenes_together(void) {
+  const int sizes[] = { 5, 20 };
+  for (int size : sizes) {
+    SkewRun run = simulateFleet(size, 20);
+    TEST_ASSERT_EQUAL(20, run.scenesRun);
+    std::sort(run.skewMs.begin(), run.skewMs.end());
+    char line[120];
+    snprintf(line, sizeof(line), "%2d controllers, %u scenes: skew first to last median %.1f ms, max %.1f ms", size,
+             (unsigned)run.scenesRun, run.skewMs[run.skewMs.size() / 2], run.skewMs.back());
+    TEST_MESSAGE(line);
+    // One-way delay only ever hides behind the max filter; drift over the
+    // eight-beacon window adds a millisecond or two.
+    TEST_ASSERT_LESS_THAN(10.0, run.skewMs.back());
+  }
+}
+
+void test_reference_reboot_steps_the_clock(void) {
+  uint8_t reference[6];
+  uint8_t follower[6];
+  macOf(1, reference);
+  macOf(2, follower);
+  SceneClock clock(follower);
+  int64_t localUs = 50000000;
+  uint32_t seq = 0;
+  for (int i = 0; i < 8; i++, localUs += 2000000) {
+    bool stepped = clock.onBeacon(packetFrom(reference, SCENE_BEACON, 1, ++seq, localUs + 30000000 - 2000), localUs);
+    TEST_ASSERT_TRUE(stepped == (i == 0));  // the first beacon changes the reference
+  }
+  TEST_ASSERT_TRUE(clock.offset() == 30000000 - 2000);
+  TEST_ASSERT_FALSE(clock.isReference(localUs));
+
+  // Small jitter back is not a step.
+  TEST_ASSERT_FALSE(clock.onBeacon(packetFrom(reference, SCENE_BEACON, 1, ++seq, localUs + 30000000 - 40000), localUs));
+  localUs += 2000000;
+
+  // The reference reboots: its uptime, and network time with it, restarts.
+  TEST_ASSERT_TRUE(clock.onBeacon(packetFrom(reference, SCENE_BEACON, 2, 1, 3000000), localUs));
+  TEST_ASSERT_TRUE(clock.offset() == 3000000 - localUs);
+  TEST_ASSERT_EQUAL_UINT32(0, clock.replays());
+}
+
+void test_replayed_beacons_are_ignored(void) {
+  uint8_t reference[6];
+  uint8_t departed[6];
+  uint8_t follower[6];
+  macOf(2, reference);
+  macOf(1, departed);
+  macOf(3, follower);
+  SceneClock clock(follower);
+  int64_t localUs = 10000000;
+  ScenePacket old = packetFrom(reference, SCENE_BEACON, 4, 10, 90000000);
+  TEST_ASSERT_TRUE(clock.onBeacon(old, localUs));
+  int64_t offset = clock.offset();
+
+  // A minute on, the same beacon again and one from an older boot are not
+  // steps; they are not taken at all.
+  localUs += 60000000;
+  TEST_ASSERT_FALSE(clock.onBeacon(packetFrom(reference, SCENE_BEACON, 4, 40, 150000000), localUs));
+  offset = clock.offset();
+  TEST_ASSERT_FALSE(clock.onBeacon(old, localUs));
+  TEST_ASSERT_FALSE(clock.onBeacon(packetFrom(reference, SCENE_BEACON, 3, 900, 1000), localUs));
+  TEST_ASSERT_TRUE(clock.offset() == offset);
+  TEST_ASSERT_EQUAL_UINT32(2, clock.replays());
+
+  // A lower MAC takes over and leaves; the reference takes back over once it
+  // has been silent. Its captured beacons cannot bring it back.
+  ScenePacket captured = packetFrom(departed, SCENE_BEACON, 9, 5, 5000000);
+  TEST_ASSERT_TRUE(clock.onBeacon(captured, localUs));
+  TEST_ASSERT_EQUAL_MEMORY(departed, clock.reference(), 6);
+  localUs += SceneClock::kReferenceTimeoutUs + 1;
+  TEST_ASSERT_TRUE(clock.onBeacon(packetFrom(reference, SCENE_BEACON, 4, 41, 170000000), localUs));
+  TEST_ASSERT_EQUAL_MEMORY(reference, clock.reference(), 6);
+  TEST_ASSERT_FALSE(clock.onBeacon(captured, localUs + 1000));
+  TEST_ASSERT_EQUAL_MEMORY(reference, clock.reference(), 6);
+}
+
+void test_guard_window_and_order(void) {
+  SceneGuard guard;
+  uint8_t a[6];
+  uint8_t b[6];
+  macOf(1, a);
+  macOf(2, b);
+  int64_t nowUs = 100000000;
+  const int64_t w = SceneGuard::kWindowUs;
+  TEST_ASSERT_FALSE(guard.accept(packetFrom(a, SCENE_RUN, 1, 1, nowUs - w - 1), nowUs));
+  TEST_ASSERT_FALSE(guard.accept(packetFrom(a, SCENE_RUN, 1, 1, nowUs + w + 1), nowUs));
+  TEST_ASSERT_TRUE(guard.accept(packetFrom(a, SCENE_RUN, 1, 1, nowUs - w), nowUs));
+  TEST_ASSERT_TRUE(guard.accept(packetFrom(a, SCENE_RUN, 1, 2, nowUs + 500000), nowUs));
+  // The three copies of one broadcast, and anything timed before it.
+  TEST_ASSERT_FALSE(guard.accept(packetFrom(a, SCENE_RUN, 1, 2, nowUs + 500000), nowUs));
+  TEST_ASSERT_FALSE(guard.accept(packetFrom(a, SCENE_RUN, 1, 3, nowUs + 400000), nowUs));
+  TEST_ASSERT_FALSE(guard.accept(packetFrom(a, SCENE_RUN, 1, 2, nowUs + 600000), nowUs));
+  TEST_ASSERT_TRUE(guard.accept(packetFrom(a, SCENE_RUN, 1, 3, nowUs + w), nowUs));
+  // Senders are independent; a reboot restarts the sequence.
+  TEST_ASSERT_TRUE(guard.accept(packetFrom(b, SCENE_RUN, 1, 1, nowUs), nowUs));
+  TEST_ASSERT_FALSE(guard.accept(packetFrom(a, SCENE_RUN, 0, 99, nowUs + w), nowUs));
+  nowUs += 2 * w;
+  TEST_ASSERT_TRUE(guard.accept(packetFrom(a, SCENE_RUN, 2, 1, nowUs), nowUs));
+
+  // Past kSenders the oldest slot is reused.
+  for (int i = 10; i < 10 + (int)SceneGuard::kSenders; i++) {
+    uint8_t mac[6];
+    macOf(i, mac);
+    TEST_ASSERT_TRUE(guard.accept(packetFrom(mac, SCENE_RUN, 1, 1, nowUs), nowUs));
+  }
+}
+
+// Network time steps back 40 s (the reference rebooted). A scene captured
+// before the step is refused, and so is one timed before the last scene
+// accepted, once converted into the new base.
+void test_guard_keeps_order_across_a_step(void) {
+  SceneGuard guard;
+  uint8_t a[6];
+  macOf(1, a);
+  int64_t nowUs = 45000000;
+  ScenePacket captured = packetFrom(a, SCENE_RUN, 1, 7, nowUs + 500000);
+  TEST_ASSERT_TRUE(guard.accept(captured, nowUs));
+  const int64_t deltaUs = -40000000;
+  guard.rebase(deltaUs);
+  nowUs += deltaUs + 1000000;
+  TEST_ASSERT_FALSE(guard.accept(captured, nowUs));
+  TEST_ASSERT_FALSE(guard.accept(packetFrom(a, SCENE_RUN, 1, 8, captured.timeUs + deltaUs - 1), nowUs));
+  TEST_ASSERT_TRUE(guard.accept(packetFrom(a, SCENE_RUN, 1, 9, nowUs + 500000), nowUs));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_codec_round_trip_and_tampering);
+  RUN_TEST(test_fleet_fires_scenes_together);
+  RUN_TEST(test_reference_reboot_steps_the_clock);
+  RUN_TEST(test_replayed_beacons_are_ignored);
+  RUN_TEST(test_guard_window_and_order);
+  RUN_TEST(test_guard_keeps_order_across_a_step);
+  return UNITY_END();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// An appliance stream session as the RTDB REST API sends it (chunk framing
+// already removed): the opening snapshot, a keep-alive, a versioned update, a
+// root patch, a plain string write, an update under a push id, then the
+// server cancelling and revoking the stream. The ": ..." line is an SSE
+// comment, which RTDB does not send but proxies may insert.
+static const char kApplianceStream[] =
+  "event: put\n"
+  "data: {\"path\":\"/\",\"data\":{"
+  "\"4\":{\"level\":100,\"state\":false,\"version\":1729251012345},"
+  "\"5\":{\"fade_ms\":400,\"level\":62,\"state\":true,\"version\":1729251012391},"
+  "\"12\":{\"state\":false,\"version\":1729250987002},"
+  "\"13\":{\"state\":true,\"version\":1729250987114},"
+  "\"14\":{\"state\":false,\"version\":1729250990870},"
+  "\"18\":{\"state\":false,\"version\":1729250991033},"
+  "\"19\":{\"state\":true,\"version\":1729251000412},"
+  "\"21\":{\"state\":false,\"version\":1729251000507}}}\n"
+  "\n"
+  "event: keep-alive\n"
+  "data: null\n"
+  "\n"
+  ": proxy heartbeat\n"
+  "\n"
+  "event: put\n"
+  "data: {\"path\":\"/4\",\"data\":{\"level\":100,\"state\":true,\"version\":1729251043871}}\n"
+  "\n"
+  "event: patch\n"
+  "data: {\"path\":\"/\",\"data\":{\"5\":{\"fade_ms\":400,\"level\":20,\"state\":true,\"version\":1729251044102},"
+  "\"13\":{\"state\":false,\"version\":1729251044102}}}\n"
+  "\n"
+  "event: put\n"
+  "data: {\"path\":\"/12/state\",\"data\":\"ON\"}\n"
+  "\n"
+  "event: keep-alive\n"
+  "data: null\n"
+  "\n"
+  "event: put\n"
+  "data: {\"path\":\"/-O9xQk2Lr\\u005fa7\",\"data\":{\"pin\":19,\"type\":\"toggle\"}}\n"
+  "\n"
+  "event: put\n"
+  "data: {\"path\":\"/14\",\"data\":null}\n"
+  "\n"
+  "event: cancel\n"
+  "data: null\n"
+  "\n"
+  "event: auth_revoked\n"
+  "data: credential is no longer valid\n"
+  "\n";
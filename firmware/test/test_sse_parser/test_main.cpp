@@ -0,0 +1,204 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "sse_parser.h"
+#include "stream_fixture.h"
+
+// The lean client feeds SseParser whatever each TLS read returns, so the
+// events must not depend on where the stream is cut. The fixture is one
+// appliance stream session; see stream_fixture.h.
+
+struct Event {
+  std::string name;
+  std::string data;
+};
+
+struct Collector {
+  std::vector<Event> events;
+};
+
+static void collect(void* context, const char* event, char* data, size_t length) {
+  static_cast<Collector*>(context)->events.push_back({ event, std::string(data, length) });
+}
+
+static std::vector<Event> parse(const std::string& stream, size_t chunk, size_t capacity = 4096) {
+  std::vector<char> buffer(capacity);
+  Collector collector;
+  SseParser parser(buffer.data(), capacity, collect, &collector);
+  for (size_t at = 0; at < stream.size(); at += chunk) {
+    parser.feed(stream.data() + at, std::min(chunk, stream.size() - at));
+  }
+  return collector.events;
+}
+
+static void assertSame(const std::vector<Event>& expected, const std::vector<Event>& actual) {
+  TEST_ASSERT_EQUAL(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING(expected[i].name.c_str(), actual[i].name.c_str());
+    TEST_ASSERT_EQUAL_STRING(expected[i].data.c_str(), actual[i].data.c_str());
+  }
+}
+
+static RtdbEvent parseData(std::string& data) {
+  RtdbEvent out;
+  TEST_ASSERT_TRUE(parseRtdbEvent(&data[0], data.size(), out));
+  return out;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_fixture_events(void) {
+  std::vector<Event> events = parse(kApplianceStream, sizeof(kApplianceStream));
+  const char* names[] = { "put", "keep-alive", "put", "patch", "put", "keep-alive", "put", "put", "cancel",
+                          "auth_revoked" };
+  // The comment line and its blank line deliver nothing.
+  TEST_ASSERT_EQUAL(sizeof(names) / sizeof(names[0]), events.size());
+  for (size_t i = 0; i < events.size(); i++) TEST_ASSERT_EQUAL_STRING(names[i], events[i].name.c_str());
+  TEST_ASSERT_EQUAL_STRING("null", events[1].data.c_str());
+  TEST_ASSERT_EQUAL_STRING("null", events[8].data.c_str());
+  TEST_ASSERT_EQUAL_STRING("credential is no longer valid", events[9].data.c_str());
+
+  RtdbEvent snapshot = parseData(events[0].data);
+  TEST_ASSERT_EQUAL_STRING("/", snapshot.path);
+  TEST_ASSERT_EQUAL(RTDB_JSON, snapshot.type);
+  TEST_ASSERT_EQUAL('{', snapshot.data[0]);
+  TEST_ASSERT_EQUAL('}', snapshot.data[snapshot.length - 1]);
+  TEST_ASSERT_EQUAL(snapshot.length, strlen(snapshot.data));
+
+  RtdbEvent update = parseData(events[2].data);
+  TEST_ASSERT_EQUAL_STRING("/4", update.path);
+  TEST_ASSERT_EQUAL(RTDB_JSON, update.type);
+  TEST_ASSERT_EQUAL_STRING("{\"level\":100,\"state\":true,\"version\":1729251043871}", update.data);
+
+  RtdbEvent patch = parseData(events[3].data);
+  TEST_ASSERT_EQUAL_STRING("/", patch.path);
+  TEST_ASSERT_EQUAL(RTDB_JSON, patch.type);
+
+  RtdbEvent write = parseData(events[4].data);
+  TEST_ASSERT_EQUAL_STRING("/12/state", write.path);
+  TEST_ASSERT_EQUAL(RTDB_STRING, write.type);
+  TEST_ASSERT_EQUAL_STRING("ON", write.data);
+  TEST_ASSERT_EQUAL(2, write.length);
+
+  RtdbEvent pushed = parseData(events[6].data);
+  TEST_ASSERT_EQUAL_STRING("/-O9xQk2Lr_a7", pushed.path);
+  TEST_ASSERT_EQUAL(RTDB_JSON, pushed.type);
+  TEST_ASSERT_EQUAL_STRING("{\"pin\":19,\"type\":\"toggle\"}", pushed.data);
+
+  RtdbEvent removed = parseData(events[7].data);
+  TEST_ASSERT_EQUAL_STRING("/14", removed.path);
+  TEST_ASSERT_EQUAL(RTDB_NULL, removed.type);
+}
+
+void test_events_split_across_reads(void) {
+  std::string stream = kApplianceStream;
+  std::vector<Event> expected = parse(stream, stream.size());
+  // Every chunk size up to a few lines, including one byte at a time.
+  for (size_t chunk = 1; chunk <= 200; chunk++) assertSame(expected, parse(stream, chunk));
+
+  // Reads of random size, as TLS records and TCP segments arrive.
+  std::mt19937 rng(0x55E);
+  std::vector<char> buffer(4096);
+  for (int round = 0; round < 200; round++) {
+    Collector collector;
+    SseParser parser(buffer.data(), buffer.size(), collect, &collector);
+    for (size_t at = 0; at < stream.size();) {
+      size_t length = std::min<size_t>(1 + rng() % 1460, stream.size() - at);
+      parser.feed(stream.data() + at, length);
+      at += length;
+    }
+    assertSame(expected, collector.events);
+  }
+}
+
+void test_line_endings(void) {
+  std::string lf = kApplianceStream;
+  std::string crlf, cr;
+  for (char c : lf) {
+    crlf += c == '\n' ? std::string("\r\n") : std::string(1, c);
+    cr += c == '\n' ? '\r' : c;
+  }
+  std::vector<Event> expected = parse(lf, lf.size());
+  // A CRLF split between two reads is still one line end.
+  for (size_t chunk = 1; chunk <= 7; chunk++) {
+    assertSame(expected, parse(crlf, chunk));
+    assertSame(expected, parse(cr, chunk));
+  }
+}
+
+void test_keep_alive_and_comments(void) {
+  std::string stream = ": hello\n\n:\n\nevent: keep-alive\ndata: null\n\n: bye\nretry: 1000\nid: 7\n\n";
+  std::vector<Event> events = parse(stream, 3);
+  TEST_ASSERT_EQUAL(1, events.size());
+  TEST_ASSERT_EQUAL_STRING("keep-alive", events[0].name.c_str());
+  TEST_ASSERT_EQUAL_STRING("null", events[0].data.c_str());
+
+  // Multi-line data is joined with '\n'; a field without a colon is ignored.
+  events = parse("event: put\ndata: a\ndata\ndata:b\n\n", 1);
+  TEST_ASSERT_EQUAL(1, events.size());
+  TEST_ASSERT_EQUAL_STRING("a\nb", events[0].data.c_str());
+}
+
+void test_oversized_event_is_dropped_not_truncated(void) {
+  std::string stream = kApplianceStream;
+  // Big enough for every event but the opening snapshot.
+  std::vector<char> buffer(256);
+  Collector collector;
+  SseParser parser(buffer.data(), buffer.size(), collect, &collector);
+  for (size_t at = 0; at < stream.size(); at += 64) parser.feed(stream.data() + at, std::min<size_t>(64, stream.size() - at));
+  TEST_ASSERT_EQUAL(1, parser.overflows());
+  TEST_ASSERT_EQUAL(9, parser.events());
+  TEST_ASSERT_EQUAL_STRING("keep-alive", collector.events[0].name.c_str());
+  TEST_ASSERT_EQUAL_STRING("auth_revoked", collector.events.back().name.c_str());
+}
+
+void test_benchmark_throughput(void) {
+  std::string stream;
+  while (stream.size() < (4u << 20)) stream += kApplianceStream;
+  const size_t eventsPerCopy = 10;
+  const size_t copies = stream.size() / (sizeof(kApplianceStream) - 1);
+
+  struct Counter {
+    size_t events;
+    size_t parsed;
+  } counter = { 0, 0 };
+  std::vector<char> buffer(4096);
+  SseParser parser(buffer.data(), buffer.size(), [](void* context, const char* event, char* data, size_t length) {
+    Counter* counter = static_cast<Counter*>(context);
+    counter->events++;
+    RtdbEvent parsed;
+    if ((strcmp(event, "put") == 0 || strcmp(event, "patch") == 0) && parseRtdbEvent(data, length, parsed)) {
+      counter->parsed++;
+    }
+  }, &counter);
+
+  // Fed in MSS-sized reads, as the lean client gets them.
+  auto start = std::chrono::steady_clock::now();
+  for (size_t at = 0; at < stream.size(); at += 1460) {
+    parser.feed(stream.data() + at, std::min<size_t>(1460, stream.size() - at));
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  TEST_ASSERT_EQUAL(copies * eventsPerCopy, counter.events);
+  TEST_ASSERT_EQUAL(copies * 6, counter.parsed);
+
+  char line[160];
+  snprintf(line, sizeof(line), "host: %.0f MB/s, %.0f ns per event including parseRtdbEvent (%u events)",
+           stream.size() / seconds / 1e6, seconds * 1e9 / counter.events, (unsigned)counter.events);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fixture_events);
+  RUN_TEST(test_events_split_across_reads);
+  RUN_TEST(test_line_endings);
+  RUN_TEST(test_keep_alive_and_comments);
+  RUN_TEST(test_oversized_event_is_dropped_not_truncated);
+  RUN_TEST(test_benchmark_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,126 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include "state_snapshot.h"
+
+// /state for panels of up to 64 relays with long names must be served, and a
+// rebuild must never touch the buffer a response may still be sending.
+
+static std::string state;
+static int writes = 0;
+
+static size_t writeState(char* buffer, size_t capacity) {
+  writes++;
+  if (state.size() < capacity) memcpy(buffer, state.c_str(), state.size() + 1);
+  return state.size();
+}
+
+// Roughly what serializeState() emits per appliance, with a 32-character name.
+static std::string panel(int appliances) {
+  std::string json = "{\"mac\":\"24:6F:28:AA:BB:CC\",\"appliances\":[";
+  for (int i = 0; i < appliances; i++) {
+    char entry[160];
+    snprintf(entry, sizeof(entry),
+             "%s{\"name\":\"Living room ceiling light no. %02d\",\"pin\":%d,\"state\":\"ON\",\"level\":100,"
+             "\"version\":1739000000000}",
+             i ? "," : "", i, 100 + i);
+    json += entry;
+  }
+  return json + "]}";
+}
+
+void setUp(void) {
+  writes = 0;
+}
+void tearDown(void) {}
+
+void test_small_panel_fits_the_initial_buffer(void) {
+  StateSnapshot snapshot;
+  state = panel(4);
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  TEST_ASSERT_EQUAL(1, writes);
+  TEST_ASSERT_EQUAL(StateSnapshot::kInitialCapacity, snapshot.capacity());
+  TEST_ASSERT_EQUAL_STRING(state.c_str(), snapshot.body());
+}
+
+void test_64_relay_panel_grows_the_buffer(void) {
+  StateSnapshot snapshot;
+  state = panel(64);
+  TEST_ASSERT_GREATER_THAN(StateSnapshot::kInitialCapacity, state.size());
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  TEST_ASSERT_EQUAL(state.size(), snapshot.length());
+  TEST_ASSERT_EQUAL_STRING(state.c_str(), snapshot.body());
+  char line[80];
+  snprintf(line, sizeof(line), "64 appliances: %u bytes in a %u byte buffer", (unsigned)state.size(),
+           (unsigned)snapshot.capacity());
+  TEST_MESSAGE(line);
+
+  // Both buffers have grown after two rebuilds; later ones write once.
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  writes = 0;
+  for (int i = 0; i < 10; i++) TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  TEST_ASSERT_EQUAL(10, writes);
+}
+
+void test_rebuild_keeps_the_previous_body(void) {
+  StateSnapshot snapshot;
+  state = panel(8);
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  const char* sending = snapshot.body();
+  std::string sent = state;
+  std::string etag = snapshot.etag();
+  state = panel(64);
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  TEST_ASSERT_EQUAL_STRING(sent.c_str(), sending);
+  TEST_ASSERT_FALSE(snapshot.matches(etag.c_str()));
+  TEST_ASSERT_TRUE(snapshot.matches(snapshot.etag()));
+}
+
+// A slow client still reading a body across several rebuilds, one of which
+// has to grow the buffers, sees it unchanged and it outlives the rebuilds.
+void test_held_body_survives_rebuilds(void) {
+  StateSnapshot snapshot;
+  state = panel(8);
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  std::shared_ptr<const StateSnapshot::Body> sending = snapshot.share();
+  std::string sent = state;
+  for (int appliances = 9; appliances <= 64; appliances += 11) {
+    state = panel(appliances);
+    TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+    TEST_ASSERT_EQUAL_STRING(state.c_str(), snapshot.body());
+    TEST_ASSERT_TRUE(snapshot.body() != sending->data);
+    TEST_ASSERT_EQUAL(sent.size(), sending->length);
+    TEST_ASSERT_EQUAL_STRING(sent.c_str(), sending->data);
+  }
+  // Once it is dropped, rebuilds settle back into two buffers.
+  sending.reset();
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  const char* first = snapshot.body();
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  TEST_ASSERT_TRUE(snapshot.rebuild(writeState));
+  TEST_ASSERT_TRUE(first == snapshot.body());
+}
+
+void test_etag_carries_the_boot_id(void) {
+  StateSnapshot before;
+  StateSnapshot after;
+  before.seed(1);
+  after.seed(2);
+  state = panel(1);
+  TEST_ASSERT_FALSE(after.matches(after.etag()));
+  TEST_ASSERT_TRUE(before.rebuild(writeState));
+  TEST_ASSERT_TRUE(after.rebuild(writeState));
+  TEST_ASSERT_FALSE(after.matches(before.etag()));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_small_panel_fits_the_initial_buffer);
+  RUN_TEST(test_64_relay_panel_grows_the_buffer);
+  RUN_TEST(test_rebuild_keeps_the_previous_body);
+  RUN_TEST(test_held_body_survives_rebuilds);
+  RUN_TEST(test_etag_carries_the_boot_id);
+  return UNITY_END();
+}
@@ -0,0 +1,127 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "trace.h"
+
+// The host build records toggle-pipeline spans from several threads and dumps
+// them with dumpChromeTrace(), the same bytes GET /trace streams chunk by
+// chunk. The file lands at $AURA_TRACE_FILE, or a fresh file under $TMPDIR
+// (default /tmp), for chrome://tracing or Perfetto; the path is printed.
+
+static std::string traceFile() {
+  const char* path = getenv("AURA_TRACE_FILE");
+  if (path) return path;
+  const char* dir = getenv("TMPDIR");
+  std::string name = std::string(dir && *dir ? dir : "/tmp") + "/aura-trace-XXXXXX.json";
+  int fd = mkstemps(&name[0], 5);
+  if (fd < 0) return "";
+  close(fd);
+  return name;
+}
+
+static std::string drain(ChromeTraceWriter& writer, size_t chunk) {
+  std::string out;
+  std::vector<uint8_t> buffer(chunk);
+  size_t length;
+  while ((length = writer.read(buffer.data(), chunk)) > 0) {
+    TEST_ASSERT_LESS_OR_EQUAL(chunk, length);
+    out.append((const char*)buffer.data(), length);
+  }
+  return out;
+}
+
+static size_t countOf(const std::string& text, const char* needle) {
+  size_t count = 0;
+  for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1)) count++;
+  return count;
+}
+
+static void toggle(int16_t pin) {
+  TraceScope receive("stream_receive");
+  { TraceScope parse("parse"); }
+  { TraceScope lookup("lookup", pin); }
+  { TraceScope actuate("actuate", pin); }
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_empty_trace_is_valid(void) {
+  Tracer empty;
+  ChromeTraceWriter writer(empty);
+  TEST_ASSERT_EQUAL_STRING("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}\n", drain(writer, 64).c_str());
+}
+
+void test_chunk_size_does_not_change_the_output(void) {
+  Tracer local;
+  for (int i = 0; i < 300; i++) local.record(i % 2 ? "actuate" : "cloud_report", traceNowUs(), (int16_t)(i % 3 - 1));
+  ChromeTraceWriter whole(local);
+  std::string expected = drain(whole, 1 << 16);
+  // Only the last kCapacity spans of the ring survive.
+  TEST_ASSERT_EQUAL(TraceRing::kCapacity, countOf(expected, "\"ph\":\"X\""));
+  TEST_ASSERT_EQUAL(TraceRing::kCapacity - 1, countOf(expected, "},{"));
+  const size_t chunks[] = { 1, 7, 64, 1436 };
+  for (size_t chunk : chunks) {
+    ChromeTraceWriter writer(local);
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), drain(writer, chunk).c_str());
+  }
+}
+
+void test_threads_then_dump_to_file(void) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < 50; i++) toggle((int16_t)(t * 16 + i % 16));
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  std::string path = traceFile();
+  TEST_ASSERT_FALSE(path.empty());
+  TEST_ASSERT_TRUE(dumpChromeTrace(path.c_str()));
+  FILE* file = fopen(path.c_str(), "r");
+  TEST_ASSERT_NOT_NULL(file);
+  std::string dumped;
+  char buffer[512];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) dumped.append(buffer, length);
+  fclose(file);
+
+  ChromeTraceWriter writer(tracer);
+  TEST_ASSERT_EQUAL_STRING(drain(writer, 1436).c_str(), dumped.c_str());
+  TEST_ASSERT_EQUAL(0, dumped.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[{"));
+  TEST_ASSERT_EQUAL(dumped.size() - 3, dumped.rfind("]}\n"));
+  size_t events = countOf(dumped, "\"ph\":\"X\"");
+  TEST_ASSERT_GREATER_THAN(0, events);
+  TEST_ASSERT_LESS_OR_EQUAL(Tracer::kMaxSpans, events);
+  TEST_ASSERT_EQUAL(events, countOf(dumped, "\"pid\":1"));
+  char line[200];
+  snprintf(line, sizeof(line), "%u spans (%u bytes) written to %s", (unsigned)events, (unsigned)dumped.size(),
+           path.c_str());
+  TEST_MESSAGE(line);
+}
+
+void test_record_overhead(void) {
+  const int spans = 200000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < spans; i++) TraceScope scope("bench", (int16_t)(i & 15));
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / spans;
+  char line[80];
+  snprintf(line, sizeof(line), "%.0f ns per recorded span", ns);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN(100000.0, ns);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_trace_is_valid);
+  RUN_TEST(test_chunk_size_does_not_change_the_output);
+  RUN_TEST(test_threads_then_dump_to_file);
+  RUN_TEST(test_record_overhead);
+  return UNITY_END();
+}